@@ -0,0 +1,553 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * bench_libchess: micro benchmarks of the library's hot paths
+ *
+ * Every benchmark runs over a corpus generated from a fixed seed, so results
+ * of different builds and machines measure the same work. Results are written
+ * as JSON.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_batch.h"
+#include "chess_eval.h"
+#include "magicmoves.h"
+#include "sliders.h"
+
+#define CORPUS_SIZE	1024
+#define CORPUS_PLIES	80
+#define FEN_MAX		128
+#define PRESSURE_SIZE	(32 << 20)	/* Bytes of cache pressure, beyond the last level cache */
+
+struct corpus {
+	struct chess_board *boards[CORPUS_SIZE];
+	struct chess_batch *batch;			/**< The boards in a batch */
+	char fens[CORPUS_SIZE][FEN_MAX];
+	unsigned long long occupancy[CORPUS_SIZE];	/**< Random occupancies for the magics */
+	int squares[CORPUS_SIZE];			/**< Random squares */
+	int pieces[CORPUS_SIZE];			/**< Random pieces */
+};
+
+struct bench {
+	const char *name;
+	/* Runs one pass over the corpus, returns the number of operations */
+	unsigned long long (*run)(struct corpus *corpus);
+};
+
+/* Keeps the compiler from optimizing benchmarked calls away */
+static volatile unsigned long long sink;
+
+static unsigned long long
+bench_random(unsigned long long *state)
+{
+	unsigned long long z;
+
+	/* splitmix64 */
+	z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static inline unsigned long long
+bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Positions of random games from the starting position */
+static void
+corpus_init(struct corpus *corpus, unsigned long long seed)
+{
+	unsigned n, plies;
+	struct chess_undo undo;
+	unsigned moves[CHESS_MOVES_MAX];
+
+	corpus->batch = chess_batch_init(CORPUS_SIZE);
+	if (corpus->batch == NULL) {
+		fprintf(stderr, "bench_libchess: %s\n", strerror(errno));
+		exit(1);
+	}
+	for (unsigned i = 0; i < CORPUS_SIZE; i++) {
+		corpus->boards[i] = chess_board_init();
+		if (corpus->boards[i] == NULL) {
+			fprintf(stderr, "bench_libchess: %s\n", strerror(errno));
+			exit(1);
+		}
+		chess_board_set_fen(corpus->boards[i], CHESS_FEN_STARTPOS);
+
+		plies = bench_random(&seed) % CORPUS_PLIES;
+		for (unsigned ply = 0; ply < plies; ply++) {
+			n = chess_board_generate_moves(corpus->boards[i], moves);
+			if (n == 0)
+				break;
+			chess_board_make_move(corpus->boards[i], moves[bench_random(&seed) % n], &undo);
+		}
+		chess_board_get_fen(corpus->boards[i], corpus->fens[i], FEN_MAX);
+		chess_batch_set_board(corpus->batch, i, corpus->boards[i]);
+
+		corpus->occupancy[i] = bench_random(&seed) & bench_random(&seed);
+		corpus->squares[i] = bench_random(&seed) % 64;
+		corpus->pieces[i] = CHESS_PIECE_PAWN + bench_random(&seed) % 6;
+	}
+}
+
+static void
+corpus_free(struct corpus *corpus)
+{
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		free(corpus->boards[i]);
+	chess_batch_free(corpus->batch);
+}
+
+static unsigned long long
+bench_set_clear_piece(struct corpus *corpus)
+{
+	struct chess_board *board = corpus->boards[0];
+
+	chess_board_set_fen(board, "8/8/8/8/8/8/8/8 w - - 0 1");
+	for (unsigned i = 0; i < CORPUS_SIZE; i++) {
+		chess_board_set_piece(board, corpus->squares[i], corpus->pieces[i], i & 1);
+		chess_board_clear_piece(board, corpus->squares[i], corpus->pieces[i], i & 1);
+	}
+	sink += chess_board_get_hash(board);
+	chess_board_set_fen(board, corpus->fens[0]);
+	return 2 * CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_get_piece(struct corpus *corpus)
+{
+	int piece, side;
+	unsigned long long sum = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++) {
+		chess_board_get_piece(corpus->boards[i], corpus->squares[i], &piece, &side);
+		sum += piece + side;
+	}
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_get_fen(struct corpus *corpus)
+{
+	char fen[FEN_MAX];
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sink += (unsigned long long)chess_board_get_fen(corpus->boards[i], fen, FEN_MAX)[0];
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_set_fen(struct corpus *corpus)
+{
+	struct chess_board *board = corpus->boards[0];
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++) {
+		chess_board_set_fen(board, corpus->fens[i]);
+		sink += chess_board_get_hash(board);
+	}
+	chess_board_set_fen(board, corpus->fens[0]);
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_bmagic(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += Bmagic(corpus->squares[i], corpus->occupancy[i]);
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_rmagic(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += Rmagic(corpus->squares[i], corpus->occupancy[i]);
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_bishop_compact(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += sliders_bishop(corpus->squares[i], corpus->occupancy[i]);
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_rook_compact(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += sliders_rook(corpus->squares[i], corpus->occupancy[i]);
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+/* Cache pressure: every lookup is followed by a store to a random cache line
+ * of a buffer larger than the caches, as other tenants of a shared host would
+ * do. Both variants do the same stores, the difference is the cost of the
+ * tables falling out of the caches.
+ */
+static unsigned char *
+pressure_buffer(void)
+{
+	static unsigned char *buf;
+
+	if (buf == NULL) {
+		buf = calloc(1, PRESSURE_SIZE);
+		if (buf == NULL) {
+			fprintf(stderr, "bench_libchess: %s\n", strerror(errno));
+			exit(1);
+		}
+	}
+	return buf;
+}
+
+#define PRESSURE_STORE(buf, state) \
+	do { \
+		(state) = (state) * 6364136223846793005ULL + 1442695040888963407ULL; \
+		(buf)[((state) >> 32) % PRESSURE_SIZE & ~63ULL]++; \
+	} while (0)
+
+static unsigned long long
+bench_rmagic_pressure(struct corpus *corpus)
+{
+	unsigned long long sum = 0, state = 1;
+	unsigned char *buf = pressure_buffer();
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++) {
+		sum += Rmagic(corpus->squares[i], corpus->occupancy[i]);
+		PRESSURE_STORE(buf, state);
+	}
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_rook_compact_pressure(struct corpus *corpus)
+{
+	unsigned long long sum = 0, state = 1;
+	unsigned char *buf = pressure_buffer();
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++) {
+		sum += sliders_rook(corpus->squares[i], corpus->occupancy[i]);
+		PRESSURE_STORE(buf, state);
+	}
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_is_attacked(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += chess_board_is_attacked(corpus->boards[i], corpus->squares[i], i & 1);
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+/* Attacks and mobility of both sides of every board */
+static unsigned long long
+bench_batch_attacks(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+	static unsigned long long attacks[CORPUS_SIZE];
+	static unsigned mobility[CORPUS_SIZE];
+
+	for (int side = CHESS_SIDE_WHITE; side <= CHESS_SIDE_BLACK; side++) {
+		chess_batch_attacks(corpus->batch, side, attacks, mobility);
+		for (unsigned i = 0; i < CORPUS_SIZE; i++)
+			sum += attacks[i] + mobility[i];
+	}
+	sink += sum;
+	return 2 * CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_generate_moves(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+	unsigned moves[CHESS_MOVES_MAX];
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += chess_board_generate_moves(corpus->boards[i], moves);
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_count_moves(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += chess_board_count_moves(corpus->boards[i]);
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+/* First move of a staged picker, as at a node that cuts off right away */
+static unsigned long long
+bench_picker_first(struct corpus *corpus)
+{
+	unsigned long long sum = 0;
+	struct chess_picker picker;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++) {
+		chess_picker_init(&picker, CHESS_MOVE_NONE, CHESS_MOVE_NONE, CHESS_MOVE_NONE,
+				CHESS_PICKER_MVV_LVA);
+		sum += chess_picker_next(&picker, corpus->boards[i]);
+	}
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+/* Make and unmake every legal move; the hash key is updated incrementally */
+static unsigned long long
+bench_make_unmake(struct corpus *corpus)
+{
+	unsigned n;
+	unsigned long long ops = 0, sum = 0;
+	struct chess_undo undo;
+	unsigned moves[CHESS_MOVES_MAX];
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++) {
+		n = chess_board_generate_moves(corpus->boards[i], moves);
+		for (unsigned j = 0; j < n; j++) {
+			chess_board_make_move(corpus->boards[i], moves[j], &undo);
+			sum += chess_board_get_hash(corpus->boards[i]);
+			chess_board_unmake_move(corpus->boards[i], moves[j], &undo);
+		}
+		ops += n;
+	}
+	sink += sum;
+	return ops;
+}
+
+static unsigned long long
+bench_evaluate(struct corpus *corpus)
+{
+	long long sum = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += chess_evaluate(corpus->boards[i]);
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+static unsigned long long
+bench_evaluate_batch(struct corpus *corpus)
+{
+	long long sum = 0;
+	int scores[CORPUS_SIZE];
+
+	chess_evaluate_batch((const struct chess_board *const *)corpus->boards, CORPUS_SIZE, scores, 1);
+	for (unsigned i = 0; i < CORPUS_SIZE; i++)
+		sum += scores[i];
+	sink += sum;
+	return CORPUS_SIZE;
+}
+
+/* Leaf nodes of depth 2 trees */
+static unsigned long long
+bench_perft(struct corpus *corpus)
+{
+	unsigned long long nodes = 0;
+
+	for (unsigned i = 0; i < CORPUS_SIZE; i += 16)
+		nodes += chess_board_perft(corpus->boards[i], 2);
+	sink += nodes;
+	return nodes;
+}
+
+static const struct bench benches[] = {
+	{ "set_clear_piece",	bench_set_clear_piece },
+	{ "get_piece",		bench_get_piece },
+	{ "get_fen",		bench_get_fen },
+	{ "set_fen",		bench_set_fen },
+	{ "bmagic",		bench_bmagic },
+	{ "rmagic",		bench_rmagic },
+	{ "bishop_compact",	bench_bishop_compact },
+	{ "rook_compact",	bench_rook_compact },
+	{ "rmagic_pressure",	bench_rmagic_pressure },
+	{ "rook_compact_pressure", bench_rook_compact_pressure },
+	{ "is_attacked",	bench_is_attacked },
+	{ "batch_attacks",	bench_batch_attacks },
+	{ "generate_moves",	bench_generate_moves },
+	{ "count_moves",	bench_count_moves },
+	{ "picker_first",	bench_picker_first },
+	{ "make_unmake",	bench_make_unmake },
+	{ "evaluate",		bench_evaluate },
+	{ "evaluate_batch",	bench_evaluate_batch },
+	{ "perft",		bench_perft },
+};
+
+static void
+usage(FILE *out, int code)
+{
+	fprintf(out, "Usage: bench_libchess [-s SEED] [-t SECONDS] [-o FILE] [NAME...]\n");
+	fprintf(out, "Benchmarks:");
+	for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+		fprintf(out, " %s", benches[i].name);
+	fprintf(out, "\n");
+	exit(code);
+}
+
+static bool
+selected(const char *name, int argc, char **argv)
+{
+	if (argc == 0)
+		return true;
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], name) == 0)
+			return true;
+	}
+	return false;
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt;
+	bool first;
+	unsigned long long seed, ops, cycles;
+	double mintime, start, elapsed;
+	const char *output;
+	FILE *out;
+	struct corpus *corpus;
+
+	seed = 1;
+	mintime = 0.25;
+	output = NULL;
+	while ((opt = getopt(argc, argv, "hs:t:o:")) != -1) {
+		switch (opt) {
+		case 'h':
+			usage(stdout, 0);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			mintime = strtod(optarg, NULL);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(stderr, 1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	out = output ? fopen(output, "w") : stdout;
+	corpus = malloc(sizeof(struct corpus));
+	if (out == NULL || corpus == NULL) {
+		fprintf(stderr, "bench_libchess: %s: %s\n", output ? output : "corpus", strerror(errno));
+		return 1;
+	}
+	/* The library only initializes the sliding attack backend it was
+	 * configured with, both are measured here.
+	 */
+	initmagicmoves();
+	sliders_init();
+	corpus_init(corpus, seed);
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"version\": \"%s\",\n", VERSION);
+	fprintf(out, "  \"seed\": %llu,\n", seed);
+	fprintf(out, "  \"corpus\": %u,\n", CORPUS_SIZE);
+	fprintf(out, "  \"results\": [");
+	first = true;
+	for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		if (!selected(benches[i].name, argc, argv))
+			continue;
+
+		/* Warm up caches and branch predictors */
+		benches[i].run(corpus);
+
+		ops = 0;
+		cycles = bench_cycles();
+		start = bench_now();
+		do {
+			ops += benches[i].run(corpus);
+			elapsed = bench_now() - start;
+		} while (elapsed < mintime);
+		cycles = bench_cycles() - cycles;
+
+		fprintf(out, "%s\n    { \"name\": \"%s\", \"ops\": %llu, \"seconds\": %.6f, "
+				"\"ns_per_op\": %.3f, \"cycles_per_op\": ",
+				first ? "" : ",", benches[i].name, ops, elapsed, elapsed * 1e9 / ops);
+		if (cycles)
+			fprintf(out, "%.3f }", (double)cycles / ops);
+		else
+			fprintf(out, "null }");
+		fflush(out);
+		first = false;
+	}
+	fprintf(out, "\n  ]\n}\n");
+
+	corpus_free(corpus);
+	free(corpus);
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,241 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chess.h"
+#include "chess_batch.h"
+#include "chess_private.h"
+
+/* Boards are padded to a multiple of the widest kernel */
+#define BATCH_ALIGN 64
+#define BATCH_WIDTH_MAX 8
+
+#define NOT_A_FILE 0xfefefefefefefefeULL
+#define NOT_H_FILE 0x7f7f7f7f7f7f7f7fULL
+#define NOT_AB_FILES 0xfcfcfcfcfcfcfcfcULL
+#define NOT_GH_FILES 0x3f3f3f3f3f3f3f3fULL
+
+struct chess_batch {
+	size_t size;				/**< Number of boards */
+	size_t npad;				/**< Number of boards padded to BATCH_WIDTH_MAX */
+	unsigned long long *pieces[2][6];	/**< Pieces, indexed by side and PIECE_INDEX() */
+	unsigned long long *data;		/**< Storage of the piece arrays */
+};
+
+/* Kernels */
+#define KERNEL_NAME batch_attacks_scalar
+#define KERNEL_TYPE unsigned long long
+#define KERNEL_WIDTH 1
+#define KERNEL_TARGET
+#include "batch_kernel.h"
+#undef KERNEL_NAME
+#undef KERNEL_TYPE
+#undef KERNEL_WIDTH
+#undef KERNEL_TARGET
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_X86 1
+
+typedef unsigned long long batch_v4 __attribute__((vector_size(32), aligned(32)));
+#define KERNEL_NAME batch_attacks_avx2
+#define KERNEL_TYPE batch_v4
+#define KERNEL_WIDTH 4
+#define KERNEL_TARGET __attribute__((target("avx2")))
+#include "batch_kernel.h"
+#undef KERNEL_NAME
+#undef KERNEL_TYPE
+#undef KERNEL_WIDTH
+#undef KERNEL_TARGET
+
+typedef unsigned long long batch_v8 __attribute__((vector_size(64), aligned(64)));
+#define KERNEL_NAME batch_attacks_avx512
+#define KERNEL_TYPE batch_v8
+#define KERNEL_WIDTH 8
+#define KERNEL_TARGET __attribute__((target("avx512f")))
+#include "batch_kernel.h"
+#undef KERNEL_NAME
+#undef KERNEL_TYPE
+#undef KERNEL_WIDTH
+#undef KERNEL_TARGET
+#endif /* x86 */
+
+static int batch_backend = -1;
+
+static bool
+batch_supported(int backend)
+{
+	switch (backend) {
+	case CHESS_BATCH_SCALAR:
+		return true;
+#ifdef BATCH_X86
+	case CHESS_BATCH_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	case CHESS_BATCH_AVX512:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return false;
+	}
+}
+
+int
+chess_batch_get_backend(void)
+{
+	int backend;
+
+	backend = __atomic_load_n(&batch_backend, __ATOMIC_RELAXED);
+	if (backend < 0) {
+		if (batch_supported(CHESS_BATCH_AVX512))
+			backend = CHESS_BATCH_AVX512;
+		else if (batch_supported(CHESS_BATCH_AVX2))
+			backend = CHESS_BATCH_AVX2;
+		else
+			backend = CHESS_BATCH_SCALAR;
+		__atomic_store_n(&batch_backend, backend, __ATOMIC_RELAXED);
+	}
+	return backend;
+}
+
+bool
+chess_batch_set_backend(int backend)
+{
+	if (!batch_supported(backend))
+		return false;
+	__atomic_store_n(&batch_backend, backend, __ATOMIC_RELAXED);
+	return true;
+}
+
+struct chess_batch *
+chess_batch_init(size_t n)
+{
+	size_t npad;
+	unsigned long long *data;
+	struct chess_batch *batch;
+
+	npad = (n + BATCH_WIDTH_MAX - 1) & ~(size_t)(BATCH_WIDTH_MAX - 1);
+	if (npad == 0)
+		npad = BATCH_WIDTH_MAX;
+	if (npad > SIZE_MAX / (12 * sizeof(unsigned long long))) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	batch = calloc(1, sizeof(struct chess_batch));
+	if (batch == NULL)
+		return NULL;
+	errno = posix_memalign((void **)&data, BATCH_ALIGN, 12 * npad * sizeof(unsigned long long));
+	if (errno != 0) {
+		free(batch);
+		return NULL;
+	}
+	memset(data, 0, 12 * npad * sizeof(unsigned long long));
+
+	batch->size = n;
+	batch->npad = npad;
+	batch->data = data;
+	for (int side = 0; side < 2; side++) {
+		for (int piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++)
+			batch->pieces[side][PIECE_INDEX(piece)] = data + (side * 6 + PIECE_INDEX(piece)) * npad;
+	}
+	return batch;
+}
+
+void
+chess_batch_free(struct chess_batch *batch)
+{
+	free(batch->data);
+	free(batch);
+}
+
+size_t
+chess_batch_get_size(const struct chess_batch *batch)
+{
+	return batch->size;
+}
+
+void
+chess_batch_set_board(struct chess_batch *batch, size_t index, const struct chess_board *board)
+{
+	for (int side = 0; side < 2; side++) {
+		for (int piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++)
+			batch->pieces[side][PIECE_INDEX(piece)][index] = PIECES(board, side, piece);
+	}
+}
+
+unsigned long long *
+chess_batch_get_pieces(struct chess_batch *batch, int side, int piece)
+{
+	return batch->pieces[side][PIECE_INDEX(piece)];
+}
+
+void
+chess_batch_attacks(const struct chess_batch *batch, int side,
+		unsigned long long *attacks, unsigned *mobility)
+{
+	unsigned long long att[BATCH_WIDTH_MAX] __attribute__((aligned(BATCH_ALIGN)));
+	unsigned mob[BATCH_WIDTH_MAX];
+	size_t full;
+	struct chess_batch tail;
+
+	/* The kernels store whole vectors, the last partial group of boards
+	 * goes through a bounce buffer so callers only need room for size
+	 * elements.
+	 */
+	full = batch->size & ~(size_t)(BATCH_WIDTH_MAX - 1);
+	tail = *batch;
+	tail.npad = full;
+
+	switch (chess_batch_get_backend()) {
+#ifdef BATCH_X86
+	case CHESS_BATCH_AVX512:
+		batch_attacks_avx512(&tail, side, attacks, mobility);
+		break;
+	case CHESS_BATCH_AVX2:
+		batch_attacks_avx2(&tail, side, attacks, mobility);
+		break;
+#endif
+	default:
+		batch_attacks_scalar(&tail, side, attacks, mobility);
+		break;
+	}
+
+	if (full == batch->size)
+		return;
+	for (int s = 0; s < 2; s++) {
+		for (int piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++)
+			tail.pieces[s][PIECE_INDEX(piece)] = batch->pieces[s][PIECE_INDEX(piece)] + full;
+	}
+	tail.npad = BATCH_WIDTH_MAX;
+	batch_attacks_scalar(&tail, side, att, mobility ? mob : NULL);
+	memcpy(attacks + full, att, (batch->size - full) * sizeof(unsigned long long));
+	if (mobility != NULL)
+		memcpy(mobility + full, mob, (batch->size - full) * sizeof(unsigned));
+}
@@ -0,0 +1,112 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Kogge-Stone attack kernel, included by batch.c once per backend with:
+ *   KERNEL_NAME	name of the function to define
+ *   KERNEL_TYPE	bitboard type, a scalar or a vector of bitboards
+ *   KERNEL_WIDTH	number of bitboards in KERNEL_TYPE
+ *   KERNEL_TARGET	function attributes
+ */
+
+/* Occluded fill of the generators through the empty squares, then one step
+ * further onto the first blocker.
+ */
+#define KS_FILL(gen, pro, op, s1, s2, s3, mask)			\
+	do {							\
+		pro &= (mask);					\
+		gen |= pro & (gen op s1);			\
+		pro &= (pro op s1);				\
+		gen |= pro & (gen op s2);			\
+		pro &= (pro op s2);				\
+		gen |= pro & (gen op s3);			\
+	} while (0)
+#define KS_ATTACKS(att, sliders, empty, op, s, mask)		\
+	do {							\
+		KERNEL_TYPE g_ = (sliders), p_ = (empty);	\
+		KS_FILL(g_, p_, op, s, 2 * s, 4 * s, mask);	\
+		att |= (g_ op s) & (mask);			\
+	} while (0)
+
+KERNEL_TARGET static void
+KERNEL_NAME(const struct chess_batch *batch, int side, unsigned long long *attacks, unsigned *mobility)
+{
+	for (size_t i = 0; i < batch->npad; i += KERNEL_WIDTH) {
+		KERNEL_TYPE own, occ, empty, att, b, l1, l2, r1, r2;
+		unsigned long long mob[KERNEL_WIDTH];
+
+#define LOAD(side_, piece_) (*(const KERNEL_TYPE *)(PIECES(batch, side_, piece_) + i))
+		own = LOAD(side, CHESS_PIECE_PAWN) | LOAD(side, CHESS_PIECE_KNIGHT)
+			| LOAD(side, CHESS_PIECE_BISHOP) | LOAD(side, CHESS_PIECE_ROOK)
+			| LOAD(side, CHESS_PIECE_QUEEN) | LOAD(side, CHESS_PIECE_KING);
+		occ = own | LOAD(side ^ 1, CHESS_PIECE_PAWN) | LOAD(side ^ 1, CHESS_PIECE_KNIGHT)
+			| LOAD(side ^ 1, CHESS_PIECE_BISHOP) | LOAD(side ^ 1, CHESS_PIECE_ROOK)
+			| LOAD(side ^ 1, CHESS_PIECE_QUEEN) | LOAD(side ^ 1, CHESS_PIECE_KING);
+		empty = ~occ;
+		att = own & 0; /* zero of the kernel type */
+
+		/* Sliders */
+		b = LOAD(side, CHESS_PIECE_ROOK) | LOAD(side, CHESS_PIECE_QUEEN);
+		KS_ATTACKS(att, b, empty, <<, 8, ~0ULL);
+		KS_ATTACKS(att, b, empty, >>, 8, ~0ULL);
+		KS_ATTACKS(att, b, empty, <<, 1, NOT_A_FILE);
+		KS_ATTACKS(att, b, empty, >>, 1, NOT_H_FILE);
+		b = LOAD(side, CHESS_PIECE_BISHOP) | LOAD(side, CHESS_PIECE_QUEEN);
+		KS_ATTACKS(att, b, empty, <<, 9, NOT_A_FILE);
+		KS_ATTACKS(att, b, empty, <<, 7, NOT_H_FILE);
+		KS_ATTACKS(att, b, empty, >>, 7, NOT_A_FILE);
+		KS_ATTACKS(att, b, empty, >>, 9, NOT_H_FILE);
+
+		/* Knights */
+		b = LOAD(side, CHESS_PIECE_KNIGHT);
+		l1 = (b >> 1) & NOT_H_FILE;
+		l2 = (b >> 2) & NOT_GH_FILES;
+		r1 = (b << 1) & NOT_A_FILE;
+		r2 = (b << 2) & NOT_AB_FILES;
+		l1 |= r1;
+		l2 |= r2;
+		att |= (l1 << 16) | (l1 >> 16) | (l2 << 8) | (l2 >> 8);
+
+		/* King */
+		b = LOAD(side, CHESS_PIECE_KING);
+		l1 = b | ((b >> 1) & NOT_H_FILE) | ((b << 1) & NOT_A_FILE);
+		att |= (l1 | (l1 << 8) | (l1 >> 8)) & ~b;
+
+		/* Pawns */
+		b = LOAD(side, CHESS_PIECE_PAWN);
+		if (side == CHESS_SIDE_WHITE)
+			att |= ((b << 7) & NOT_H_FILE) | ((b << 9) & NOT_A_FILE);
+		else
+			att |= ((b >> 9) & NOT_H_FILE) | ((b >> 7) & NOT_A_FILE);
+#undef LOAD
+
+		/* The output arrays belong to the caller and may be unaligned */
+		memcpy(attacks + i, &att, sizeof(att));
+		if (mobility != NULL) {
+			att &= ~own;
+			memcpy(mob, &att, sizeof(att));
+			for (size_t j = 0; j < KERNEL_WIDTH; j++)
+				mobility[i + j] = __builtin_popcountll(mob[j]);
+		}
+	}
+}
+
+#undef KS_FILL
+#undef KS_ATTACKS
@@ -18,187 +18,247 @@
  * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <assert.h>
 #include <sys/types.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* The exported accessors are defined here, see chess_inline.h */
+#define CHESS_INLINE_NO_MACROS 1
 #include "chess.h"
-#include "magicmoves.h"
-
-struct chess_board {
-	int side;				/**< Side to move */
-	int epsq;				/**< En passant square */
-	int cflag;				/**< Castling flags */
-	int isq[3];				/**< Initial squares of white king, king rook, and queen rook */
-	unsigned rhmc;				/**< Reversible half move counter */
-	unsigned fmc;				/**< Full move counter */
-	int cboard[64];				/**< cboard[sq] gives the piece on square sq. */
-	unsigned long long occupied[4];		/**< Occupied squares, (white, black, all, empty) */
-	unsigned long long pieces[2][6];	/**< Pieces */
-};
+#include "chess_private.h"
+#include "tables.h"
 
-static const unsigned long long PAWN_ATTACKS[2][64] = {
-	{0, 0, 0, 0, 0, 0, 0, 0,
-	0x0000000000020000, 0x0000000000050000, 0x00000000000a0000, 0x0000000000140000,
-	0x0000000000280000, 0x0000000000500000, 0x0000000000a00000, 0x0000000000400000,
-	0x0000000002000000, 0x0000000005000000, 0x000000000a000000, 0x0000000014000000,
-	0x0000000028000000, 0x0000000050000000, 0x00000000a0000000, 0x0000000040000000,
-	0x0000000200000000, 0x0000000500000000, 0x0000000a00000000, 0x0000001400000000,
-	0x0000002800000000, 0x0000005000000000, 0x000000a000000000, 0x0000004000000000,
-	0x0000020000000000, 0x0000050000000000, 0x00000a0000000000, 0x0000140000000000,
-	0x0000280000000000, 0x0000500000000000, 0x0000a00000000000, 0x0000400000000000,
-	0x0002000000000000, 0x0005000000000000, 0x000a000000000000, 0x0014000000000000,
-	0x0028000000000000, 0x0050000000000000, 0x00a0000000000000, 0x0040000000000000,
-	0x0200000000000000, 0x0500000000000000, 0x0a00000000000000, 0x1400000000000000,
-	0x2800000000000000, 0x5000000000000000, 0xa000000000000000, 0x4000000000000000,
-	0, 0, 0, 0, 0, 0, 0, 0},
-	{0, 0, 0, 0, 0, 0, 0, 0,
-	0x0000000000000002, 0x0000000000000005, 0x000000000000000a, 0x0000000000000014,
-	0x0000000000000028, 0x0000000000000050, 0x00000000000000a0, 0x0000000000000040,
-	0x0000000000000200, 0x0000000000000500, 0x0000000000000a00, 0x0000000000001400,
-	0x0000000000002800, 0x0000000000005000, 0x000000000000a000, 0x0000000000004000,
-	0x0000000000020000, 0x0000000000050000, 0x00000000000a0000, 0x0000000000140000,
-	0x0000000000280000, 0x0000000000500000, 0x0000000000a00000, 0x0000000000400000,
-	0x0000000002000000, 0x0000000005000000, 0x000000000a000000, 0x0000000014000000,
-	0x0000000028000000, 0x0000000050000000, 0x00000000a0000000, 0x0000000040000000,
-	0x0000000200000000, 0x0000000500000000, 0x0000000a00000000, 0x0000001400000000,
-	0x0000002800000000, 0x0000005000000000, 0x000000a000000000, 0x0000004000000000,
-	0x0000020000000000, 0x0000050000000000, 0x00000a0000000000, 0x0000140000000000,
-	0x0000280000000000, 0x0000500000000000, 0x0000a00000000000, 0x0000400000000000,
-	0, 0, 0, 0, 0, 0, 0, 0}
-};
-static const unsigned long long KNIGHT_ATTACKS[64] = {
-	0x0000000000020400, 0x0000000000050800, 0x00000000000a1100, 0x0000000000142200,
-	0x0000000000284400, 0x0000000000508800, 0x0000000000a01000, 0x0000000000402000,
-	0x0000000002040004, 0x8000000005080008, 0x000000000a110011, 0x0000000014220022,
-	0x0000000028440044, 0x0000000050880088, 0x00000000a0100010, 0x0000000040200020,
-	0x0000000204000402, 0x0000000508000885, 0x0000000a1100110a, 0x0000001422002214,
-	0x0000002844004428, 0x0000005088008850, 0x000000a0100010a0, 0x0000004020002040,
-	0x0000020400040200, 0x0000050800088500, 0x00000a1100110a00, 0x0000142200221400,
-	0x0000284400442800, 0x0000508800885000, 0x0000a0100010a000, 0x0000402000204000,
-	0x0002040004020000, 0x0005080008850000, 0x000a1100110a0000, 0x0014220022140000,
-	0x0028440044280000, 0x0050880088500000, 0x00a0100010a00000, 0x0040200020400000,
-	0x0204000402000000, 0x0508000885000000, 0x0a1100110a000000, 0x1422002214000000,
-	0x2844004428000000, 0x5088008850000000, 0xa0100010a0000000, 0x4020002040000000,
-	0x0400040200000000, 0x0800088500000000, 0x1100110a00000000, 0x2200221400000000,
-	0x4400442800000000, 0x8800885000000000, 0x100010a000000000, 0x2000204000000000,
-	0x0004020000000000, 0x0008850000000000, 0x00110a0000000000, 0x0022140000000000,
-	0x0044280000000000, 0x0088500000000000, 0x0010a00000000000, 0x0020400000000000
-};
-static const unsigned long long KING_ATTACKS[64] = {
-	0x0000000000000302, 0x0000000000000705, 0x0000000000000e0a, 0x0000000000001c14,
-	0x0000000000003828, 0x0000000000007050, 0x000000000000e0a0, 0x000000000000c040,
-	0x0000000000030203, 0x0000000000070507, 0x00000000000e0a0e, 0x00000000001c141c,
-	0x0000000000382838, 0x0000000000705070, 0x0000000000e0a0e0, 0x0000000000c040c0,
-	0x0000000003020300, 0x0000000007050700, 0x000000000e0a0e00, 0x000000001c141c00,
-	0x0000000038283800, 0x0000000070507000, 0x00000000e0a0e000, 0x00000000c040c000,
-	0x0000000302030000, 0x0000000705070000, 0x0000000e0a0e0000, 0x0000001c141c0000,
-	0x0000003828380000, 0x0000007050700000, 0x000000e0a0e00000, 0x000000c040c00000,
-	0x0000030203000000, 0x0000070507000000, 0x00000e0a0e000000, 0x00001c141c000000,
-	0x0000382838000000, 0x0000705070000000, 0x0000e0a0e0000000, 0x0000c040c0000000,
-	0x0003020300000000, 0x0007050700000000, 0x000e0a0e00000000, 0x001c141c00000000,
-	0x0038283800000000, 0x0070507000000000, 0x00e0a0e000000000, 0x00c040c000000000,
-	0x0302030000000000, 0x0705070000000000, 0x0e0a0e0000000000, 0x1c141c0000000000,
-	0x3828380000000000, 0x7050700000000000, 0xe0a0e00000000000, 0xc040c00000000000,
-	0x0203000000000000, 0x0507000000000000, 0x0a0e000000000000, 0x141c000000000000,
-	0x2838000000000000, 0x5070000000000000, 0xa0e0000000000000, 0x40c0000000000000
-};
+#define DARK_SQUARES 0xaa55aa55aa55aa55ULL
+#define FILE_A 0x0101010101010101ULL
+#define FILE_H 0x8080808080808080ULL
+
+/* Fails to compile if the board outgrows its cache lines */
+typedef char board_size_check[(sizeof(struct chess_board) == BOARD_SIZE) ? 1 : -1];
+
+/* Zobrist keys, filled by chess_init() */
+static unsigned long long zobrist_piece[2][7][64];
+static unsigned long long zobrist_castle[16];
+static unsigned long long zobrist_enpassant[8];
+static unsigned long long zobrist_side;
+
+static pthread_once_t chess_init_once = PTHREAD_ONCE_INIT;
+
+static unsigned long long
+chess_random(unsigned long long *state)
+{
+	unsigned long long z;
+
+	/* splitmix64 */
+	z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Squares strictly between a and b if they are aligned, 0 otherwise */
+static inline unsigned long long
+bb_between(int a, int b)
+{
+	return BETWEEN[a][b];
+}
+
+/* The whole line through a and b if they are aligned, 0 otherwise */
+static inline unsigned long long
+bb_line(int a, int b)
+{
+	return LINE[a][b];
+}
+
+static void
+chess_init(void)
+{
+	unsigned long long seed;
+
+	SLIDERS_INIT();
+
+	/* Fixed seed so that hash keys are stable across runs */
+	seed = 0x6c69626368657373ULL;
+	for (int side = 0; side < 2; side++)
+		for (int piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++)
+			for (int sq = 0; sq < 64; sq++)
+				zobrist_piece[side][piece][sq] = chess_random(&seed);
+	for (int i = 0; i < 16; i++)
+		zobrist_castle[i] = chess_random(&seed);
+	for (int i = 0; i < 8; i++)
+		zobrist_enpassant[i] = chess_random(&seed);
+	zobrist_side = chess_random(&seed);
+}
+
+static inline void
+board_put(struct chess_board *board, int square, int piece, int side)
+{
+	unsigned long long sqbit;
+
+	sqbit = (1ULL << square);
+	PIECES(board, side, piece) |= sqbit;
+	board->occupied[side] |= sqbit;
+	board->cboard[square] = piece;
+	board->hash ^= zobrist_piece[side][piece][square];
+}
+
+static inline void
+board_remove(struct chess_board *board, int square, int piece, int side)
+{
+	unsigned long long sqbit;
+
+	sqbit = (1ULL << square);
+	PIECES(board, side, piece) &= ~sqbit;
+	board->occupied[side] &= ~sqbit;
+	board->cboard[square] = 0;
+	board->hash ^= zobrist_piece[side][piece][square];
+}
+
+static void
+board_clear(struct chess_board *board)
+{
+	unsigned long long *history;
+
+	history = board->history;
+	memset(board, 0, sizeof(struct chess_board));
+	board->history = history;
+
+	board->side = CHESS_SIDE_WHITE;
+	board->epsq = -1;
+	board->cflag = 0;
+	board->isq[0] = 4;
+	board->isq[1] = 7;
+	board->isq[2] = 0;
+	board->rhmc = 0;
+	board->fmc = 1;
+	board->hash = zobrist_castle[0];
+}
+
+/* Pieces of both sides attacking the square with the given occupancy. Forced
+ * inline, with the compact sliders the body outgrows the inline limits of the
+ * callers in the hot paths.
+ */
+static inline __attribute__((always_inline)) unsigned long long
+board_attackers(const struct chess_board *board, int square, unsigned long long occ)
+{
+	STATS_INC(ATTACKS);
+	return (PAWN_ATTACKS[CHESS_SIDE_WHITE][square] & PIECES(board, CHESS_SIDE_BLACK, CHESS_PIECE_PAWN))
+		| (PAWN_ATTACKS[CHESS_SIDE_BLACK][square] & PIECES(board, CHESS_SIDE_WHITE, CHESS_PIECE_PAWN))
+		| (KNIGHT_ATTACKS[square] & (PIECES(board, 0, CHESS_PIECE_KNIGHT) | PIECES(board, 1, CHESS_PIECE_KNIGHT)))
+		| (KING_ATTACKS[square] & (PIECES(board, 0, CHESS_PIECE_KING) | PIECES(board, 1, CHESS_PIECE_KING)))
+		| (BISHOP_ATTACKS(square, occ) & (PIECES(board, 0, CHESS_PIECE_BISHOP) | PIECES(board, 1, CHESS_PIECE_BISHOP)
+					| PIECES(board, 0, CHESS_PIECE_QUEEN) | PIECES(board, 1, CHESS_PIECE_QUEEN)))
+		| (ROOK_ATTACKS(square, occ) & (PIECES(board, 0, CHESS_PIECE_ROOK) | PIECES(board, 1, CHESS_PIECE_ROOK)
+					| PIECES(board, 0, CHESS_PIECE_QUEEN) | PIECES(board, 1, CHESS_PIECE_QUEEN)));
+}
+
+/* Castling flags that survive a move from or to the given square */
+static inline int
+board_castle_keep(const struct chess_board *board, int square)
+{
+	int file, lost;
+
+	if (square >= 8 && square < 56)
+		return CHESS_CASTLE_WHITE | CHESS_CASTLE_BLACK;
+
+	file = square & 7;
+	lost = 0;
+	if (file == (board->isq[0] & 7))
+		lost = CHESS_CASTLE_WHITE;
+	else if (file == (board->isq[1] & 7))
+		lost = CHESS_CASTLE_KINGSIDE_WHITE;
+	else if (file == (board->isq[2] & 7))
+		lost = CHESS_CASTLE_QUEENSIDE_WHITE;
+
+	/* Black's flags are white's shifted by two */
+	if (square >= 56)
+		lost <<= 2;
+	return (CHESS_CASTLE_WHITE | CHESS_CASTLE_BLACK) & ~lost;
+}
+
+/* Rook squares of a castling move given the king's target square */
+static inline void
+board_castle_rook(const struct chess_board *board, int kto, int *rfrom, int *rto)
+{
+	int base = kto & 56;
+
+	if ((kto & 7) == 6) {
+		*rfrom = base + (board->isq[1] & 7);
+		*rto = base + 5;
+	}
+	else {
+		*rfrom = base + (board->isq[2] & 7);
+		*rto = base + 3;
+	}
+}
 
 inline int
 chess_switch_side(int side)
 {
-	assert(side >= CHESS_SIDE_WHITE && side <= CHESS_SIDE_BLACK);
-
-	return 1 ^ side;
+	return chess_inline_switch_side(side);
 }
 
 inline int
 chess_rank(int square)
 {
-	assert(square >= 0 && square <= 63);
-
-	return square >> 3;
+	return chess_inline_rank(square);
 }
 
 inline int
 chess_file(int square)
 {
-	assert(square >= 0 && square <= 63);
-
-	return square & 7;
+	return chess_inline_file(square);
 }
 
 inline char
 chess_file_char(int square)
 {
-	assert(square >= 0 && square <= 63);
-
-	return (char) chess_file(square) + 97;
+	return chess_inline_file_char(square);
 }
 
 inline int
 chess_square(int rank, int file)
 {
-	assert(rank >= 0 && rank <= 7);
-	assert(file >= 0 && file <= 7);
-
-	return (rank << 3) + file;
+	return chess_inline_square(rank, file);
 }
 
 inline int
 chess_square_left(int square)
 {
-	assert(square >= 0 && square <= 63);
-
-	if (square % 8 != 0)
-		return square - 1;
-	return -1;
+	return chess_inline_square_left(square);
 }
 
 inline int
 chess_square_right(int square)
 {
-	assert(square >= 0 && square <= 63);
-
-	if (square % 8 != 7)
-		return square + 1;
-	return -1;
+	return chess_inline_square_right(square);
 }
 
 inline int
 chess_square_up(int square)
 {
-	assert(square >= 0 && square <= 63);
-
-	if (square < 55)
-		return square + 8;
-	return -1;
+	return chess_inline_square_up(square);
 }
 
 inline int
 chess_square_down(int square)
 {
-	assert(square >= 0 && square <= 63);
-
-	if (square > 7)
-		return square - 8;
-	return -1;
+	return chess_inline_square_down(square);
 }
 
 inline bool
 chess_square_border(int square)
 {
-	int file, rank;
-
-	assert(square >= 0 && square <= 63);
-
-	file = chess_file(square);
-	rank = chess_rank(square);
-
-	return ((file == 0) || (file == 7) || (rank == 0) || (rank == 7));
+	return chess_inline_square_border(square);
 }
 
 int
@@ -294,6 +354,83 @@ chess_square_name(int square)
 	}
 }
 
+int
+chess_bb_count(unsigned long long b)
+{
+	return chess_inline_bb_count(b);
+}
+
+int
+chess_bb_lsb(unsigned long long b)
+{
+	return chess_inline_bb_lsb(b);
+}
+
+int
+chess_bb_msb(unsigned long long b)
+{
+	return chess_inline_bb_msb(b);
+}
+
+int
+chess_bb_pop(unsigned long long *b)
+{
+	return chess_inline_bb_pop(b);
+}
+
+unsigned long long
+chess_pawn_attacks(int side, int square)
+{
+	assert(side == CHESS_SIDE_WHITE || side == CHESS_SIDE_BLACK);
+	assert(square >= 0 && square <= 63);
+
+	return PAWN_ATTACKS[side][square];
+}
+
+unsigned long long
+chess_knight_attacks(int square)
+{
+	assert(square >= 0 && square <= 63);
+
+	return KNIGHT_ATTACKS[square];
+}
+
+/* The sliding piece tables are built on first use like the hash keys */
+unsigned long long
+chess_bishop_attacks(int square, unsigned long long occupied)
+{
+	assert(square >= 0 && square <= 63);
+
+	pthread_once(&chess_init_once, chess_init);
+	return BISHOP_ATTACKS(square, occupied);
+}
+
+unsigned long long
+chess_rook_attacks(int square, unsigned long long occupied)
+{
+	assert(square >= 0 && square <= 63);
+
+	pthread_once(&chess_init_once, chess_init);
+	return ROOK_ATTACKS(square, occupied);
+}
+
+unsigned long long
+chess_queen_attacks(int square, unsigned long long occupied)
+{
+	assert(square >= 0 && square <= 63);
+
+	pthread_once(&chess_init_once, chess_init);
+	return BISHOP_ATTACKS(square, occupied) | ROOK_ATTACKS(square, occupied);
+}
+
+unsigned long long
+chess_king_attacks(int square)
+{
+	assert(square >= 0 && square <= 63);
+
+	return KING_ATTACKS[square];
+}
+
 char
 chess_piece_char(int piece, int side)
 {
@@ -337,26 +474,36 @@ chess_board_init(void)
 {
 	struct chess_board *board;
 
-	board = calloc(1, sizeof(struct chess_board));
-	if (board == NULL)
+	pthread_once(&chess_init_once, chess_init);
+
+	/* The history is allocated along so that free() releases both */
+	errno = posix_memalign((void **)&board, BOARD_ALIGN,
+			sizeof(struct chess_board) + HISTORY_SIZE * sizeof(unsigned long long));
+	if (errno != 0)
 		return NULL;
 
-	board->side = CHESS_SIDE_WHITE;
-	board->epsq = -1;
-	board->cflag = 0;
-	board->isq[0] = chess_square_index("e1");
-	board->isq[1] = chess_square_index("h1");
-	board->isq[2] = chess_square_index("a1");
-	board->rhmc = 0;
-	board->fmc = 1;
+	board->history = (unsigned long long *)(board + 1);
+	board_clear(board);
 
 	return board;
 }
 
+void
+chess_board_copy(struct chess_board *dst, const struct chess_board *src)
+{
+	unsigned long long *history;
+
+	history = dst->history;
+	memcpy(dst, src, sizeof(struct chess_board));
+	dst->history = history;
+	if (history != NULL && src->history != NULL)
+		memcpy(history, src->history, HISTORY_SIZE * sizeof(unsigned long long));
+}
+
 int
 chess_board_get_side(const struct chess_board *board)
 {
-	return board->side;
+	return chess_inline_board_get_side(board);
 }
 
 void
@@ -364,13 +511,15 @@ chess_board_set_side(struct chess_board *board, int side)
 {
 	assert(side == CHESS_SIDE_WHITE || side == CHESS_SIDE_BLACK);
 
+	if (board->side != side)
+		board->hash ^= zobrist_side;
 	board->side = side;
 }
 
 int
 chess_board_get_enpassant_square(const struct chess_board *board)
 {
-	return board->epsq;
+	return chess_inline_board_get_enpassant_square(board);
 }
 
 void
@@ -378,19 +527,24 @@ chess_board_set_enpassant_square(struct chess_board *board, int square)
 {
 	assert(square >= 0 && square <= 63);
 
+	if (board->epsq >= 0)
+		board->hash ^= zobrist_enpassant[chess_file(board->epsq)];
 	board->epsq = square;
+	board->hash ^= zobrist_enpassant[chess_file(square)];
 }
 
 int
 chess_board_get_castling_flags(const struct chess_board *board)
 {
-	return board->cflag;
+	return chess_inline_board_get_castling_flags(board);
 }
 
 void
 chess_board_set_castling_flags(struct chess_board *board, int flags)
 {
+	board->hash ^= zobrist_castle[board->cflag & 15];
 	board->cflag = flags;
+	board->hash ^= zobrist_castle[board->cflag & 15];
 }
 
 int
@@ -438,19 +592,19 @@ chess_board_set_initial_qrook_square(struct chess_board *board, int square)
 unsigned
 chess_board_get_rhmc(const struct chess_board *board)
 {
-	return board->rhmc;
+	return chess_inline_board_get_rhmc(board);
 }
 
 void
 chess_board_set_rhmc(struct chess_board *board, unsigned count)
 {
-	board->rhmc = count;
+	board->rhmc = (count < CHESS_RHMC_MAX) ? count : CHESS_RHMC_MAX;
 }
 
 unsigned
 chess_board_get_fmc(const struct chess_board *board)
 {
-	return board->fmc;
+	return chess_inline_board_get_fmc(board);
 }
 
 void
@@ -462,81 +616,81 @@ chess_board_set_fmc(struct chess_board *board, unsigned count)
 void
 chess_board_set_piece(struct chess_board *board, int square, int piece, int side)
 {
-	unsigned long long sqbit;
-
 	assert(square >= 0 && square <= 63);
 	assert(piece >= CHESS_PIECE_PAWN && piece <= CHESS_PIECE_KING);
 
-	sqbit = (1ULL << square);
-	board->pieces[side][piece] |= sqbit;
-	board->occupied[side] |= sqbit;
-	board->occupied[2] |= sqbit;
-	board->occupied[3] &= ~sqbit;
-	board->cboard[square] = piece;
+	STATS_INC(SET_PIECE);
+	board_put(board, square, piece, side);
 }
 
 bool
 chess_board_get_piece(const struct chess_board *board, int square, int *piece_r, int *side_r)
 {
-	int piece;
-
-	assert(square >= 0 && square <= 63);
-
-	piece = board->cboard[square];
-	if (!piece) {
-		if (piece_r != NULL)
-			*piece_r = 0;
-		if (side_r != NULL)
-			*side_r = 0;
-		return false;
-	}
-
-	if (piece_r != NULL)
-		*piece_r = piece;
-
-	if (side_r != NULL) {
-		if ((board->pieces[CHESS_SIDE_WHITE][piece] & (1ULL << square)) != 0)
-			*side_r = CHESS_SIDE_WHITE;
-		else
-			*side_r = CHESS_SIDE_BLACK;
-	}
-
-	return true;
+	return chess_inline_board_get_piece(board, square, piece_r, side_r);
 }
 
 void
 chess_board_clear_piece(struct chess_board *board, int square, int piece, int side)
 {
-	unsigned long long sqbit;
-
 	assert(square >= 0 && square <= 63);
 	assert(piece >= CHESS_PIECE_PAWN && piece <= CHESS_PIECE_KING);
 	assert(side == CHESS_SIDE_WHITE || side == CHESS_SIDE_BLACK);
 
-	sqbit = (1ULL << square);
-	board->pieces[side][piece] &= ~sqbit;
-	board->occupied[side] &= ~sqbit;
-	board->occupied[2] &= ~sqbit;
-	board->occupied[3] |= sqbit;
-	board->cboard[square] = 0;
+	STATS_INC(CLEAR_PIECE);
+	board_remove(board, square, piece, side);
 }
 
 bool
 chess_board_has_piece(const struct chess_board *board, int square, int side)
 {
-	assert(square >= 0 && square <= 63);
-	assert(side == CHESS_SIDE_WHITE || side == CHESS_SIDE_BLACK);
+	return chess_inline_board_has_piece(board, square, side);
+}
 
-	return ((board->occupied[side] & (1ULL << square)) != 0);
+unsigned long long
+chess_board_get_pieces(const struct chess_board *board, int side, int piece)
+{
+	return chess_inline_board_get_pieces(board, side, piece);
 }
 
-char *
-chess_board_get_fen(struct chess_board *board, char *fen, size_t len)
+unsigned long long
+chess_board_get_occupied(const struct chess_board *board, int side)
+{
+	return chess_inline_board_get_occupied(board, side);
+}
+
+/* Castling right in X-FEN, where K and Q name the outermost rooks, or in
+ * Shredder-FEN, where rooks are always named by their file.
+ */
+static char
+fen_castle_char(const struct chess_board *board, int side, bool kingside, bool shredder)
+{
+	int base, rsq;
+	char c;
+	unsigned long long rooks;
+
+	base = (side == CHESS_SIDE_WHITE) ? 0 : 56;
+	rsq = base + (board->isq[kingside ? 1 : 2] & 7);
+	rooks = PIECES(board, side, CHESS_PIECE_ROOK) & (0xffULL << base);
+	if (kingside)
+		rooks &= ~((2ULL << rsq) - 1);
+	else
+		rooks &= (1ULL << rsq) - 1;
+
+	if (shredder || rooks)
+		c = 'a' + (rsq & 7);
+	else
+		c = kingside ? 'k' : 'q';
+	return (side == CHESS_SIDE_WHITE) ? toupper((unsigned char)c) : c;
+}
+
+static char *
+board_get_fen(const struct chess_board *board, char *fen, size_t len, bool shredder)
 {
 	int empty, square, piece, side, ret;
 	size_t ind;
 	const char *epsq;
 
+	STATS_INC(GET_FEN);
 	ind = 0;
 
 #define PUSHCHAR(ch)				\
@@ -588,21 +742,11 @@ chess_board_get_fen(struct chess_board *board, char *fen, size_t len)
 		PUSHCHAR('-');
 	}
 	else {
-		if (board->cflag & (CHESS_CASTLE_KINGSIDE_WHITE)) {
-			/* White can castle king side */
-			PUSHCHAR('K');
-		}
-		if (board->cflag & (CHESS_CASTLE_QUEENSIDE_WHITE)) {
-			/* White can castle king side */
-			PUSHCHAR('Q');
-		}
-		if (board->cflag & (CHESS_CASTLE_KINGSIDE_BLACK)) {
-			/* Black can castle king side */
-			PUSHCHAR('k');
-		}
-		if (board->cflag & (CHESS_CASTLE_QUEENSIDE_BLACK)) {
-			/* Black can castle king side */
-			PUSHCHAR('q');
+		for (side = CHESS_SIDE_WHITE; side <= CHESS_SIDE_BLACK; side++) {
+			if (board->cflag & (CHESS_CASTLE_KINGSIDE_WHITE << (2 * side)))
+				PUSHCHAR(fen_castle_char(board, side, true, shredder));
+			if (board->cflag & (CHESS_CASTLE_QUEENSIDE_WHITE << (2 * side)))
+				PUSHCHAR(fen_castle_char(board, side, false, shredder));
 		}
 	}
 
@@ -629,3 +773,1600 @@ chess_board_get_fen(struct chess_board *board, char *fen, size_t len)
 		return NULL;
 	return fen;
 }
+
+char *
+chess_board_get_fen(struct chess_board *board, char *fen, size_t len)
+{
+	return board_get_fen(board, fen, len, false);
+}
+
+char *
+chess_board_get_shredder_fen(const struct chess_board *board, char *fen, size_t len)
+{
+	return board_get_fen(board, fen, len, true);
+}
+
+/* Parses a castling right of X-FEN or Shredder-FEN, collecting the files of
+ * the king and the rooks, which must agree for both sides.
+ */
+static bool
+fen_castle(const struct chess_board *board, char c, int *flags, int *files)
+{
+	int side, base, kfile, rfile;
+	bool kingside;
+	unsigned long long king, rooks;
+
+	side = isupper((unsigned char)c) ? CHESS_SIDE_WHITE : CHESS_SIDE_BLACK;
+	base = (side == CHESS_SIDE_WHITE) ? 0 : 56;
+	c = tolower((unsigned char)c);
+	king = PIECES(board, side, CHESS_PIECE_KING) & (0xffULL << base);
+	rooks = PIECES(board, side, CHESS_PIECE_ROOK) & (0xffULL << base);
+
+	if (c == 'k' || c == 'q') {
+		kingside = (c == 'k');
+		*flags |= (kingside ? CHESS_CASTLE_KINGSIDE_WHITE : CHESS_CASTLE_QUEENSIDE_WHITE) << (2 * side);
+		if (!king)
+			return true; /* Keep the standard squares */
+		kfile = bb_lsb(king) & 7;
+		if (kingside)
+			rooks &= ~((2ULL << (base + kfile)) - 1);
+		else
+			rooks &= (1ULL << (base + kfile)) - 1;
+		if (!rooks)
+			return true;
+		rfile = (kingside ? bb_msb(rooks) : bb_lsb(rooks)) & 7;
+	}
+	else if (c >= 'a' && c <= 'h') {
+		if (!king)
+			return false;
+		kfile = bb_lsb(king) & 7;
+		rfile = c - 'a';
+		if (rfile == kfile)
+			return false;
+		kingside = (rfile > kfile);
+		*flags |= (kingside ? CHESS_CASTLE_KINGSIDE_WHITE : CHESS_CASTLE_QUEENSIDE_WHITE) << (2 * side);
+	}
+	else
+		return false;
+
+	if ((files[0] >= 0 && files[0] != kfile)
+			|| (files[kingside ? 1 : 2] >= 0 && files[kingside ? 1 : 2] != rfile))
+		return false;
+	files[0] = kfile;
+	files[kingside ? 1 : 2] = rfile;
+	return true;
+}
+
+bool
+chess_board_set_fen(struct chess_board *board, const char *fen)
+{
+	int rank, file, piece, side, flags, files[3];
+	const char *p;
+	char *end;
+	unsigned long count;
+
+	pthread_once(&chess_init_once, chess_init);
+	STATS_INC(SET_FEN);
+	board_clear(board);
+
+	/* Step 1: Board position */
+	p = fen;
+	rank = 7;
+	file = 0;
+	for (; *p != '\0' && *p != ' '; p++) {
+		if (*p == '/') {
+			if (file != 8 || rank == 0)
+				goto invalid;
+			--rank;
+			file = 0;
+			continue;
+		}
+		if (*p >= '1' && *p <= '8') {
+			file += *p - '0';
+			if (file > 8)
+				goto invalid;
+			continue;
+		}
+
+		side = isupper((unsigned char)*p) ? CHESS_SIDE_WHITE : CHESS_SIDE_BLACK;
+		switch (tolower((unsigned char)*p)) {
+		case 'p':
+			piece = CHESS_PIECE_PAWN;
+			break;
+		case 'n':
+			piece = CHESS_PIECE_KNIGHT;
+			break;
+		case 'b':
+			piece = CHESS_PIECE_BISHOP;
+			break;
+		case 'r':
+			piece = CHESS_PIECE_ROOK;
+			break;
+		case 'q':
+			piece = CHESS_PIECE_QUEEN;
+			break;
+		case 'k':
+			piece = CHESS_PIECE_KING;
+			break;
+		default:
+			goto invalid;
+		}
+		if (file > 7)
+			goto invalid;
+		board_put(board, chess_square(rank, file), piece, side);
+		++file;
+	}
+	if (rank != 0 || file != 8)
+		goto invalid;
+
+	/* Step 2: Side to move */
+	while (*p == ' ')
+		++p;
+	if (*p == 'w')
+		chess_board_set_side(board, CHESS_SIDE_WHITE);
+	else if (*p == 'b')
+		chess_board_set_side(board, CHESS_SIDE_BLACK);
+	else
+		goto invalid;
+	++p;
+
+	/* Step 3: Castling rights */
+	while (*p == ' ')
+		++p;
+	flags = 0;
+	files[0] = files[1] = files[2] = -1;
+	if (*p == '-')
+		++p;
+	else {
+		for (; *p != '\0' && *p != ' '; p++) {
+			if (!fen_castle(board, *p, &flags, files))
+				goto invalid;
+		}
+	}
+	for (int i = 0; i < 3; i++) {
+		if (files[i] >= 0)
+			board->isq[i] = files[i];
+	}
+	chess_board_set_castling_flags(board, flags);
+
+	/* Step 4: En passant square */
+	while (*p == ' ')
+		++p;
+	if (*p == '-')
+		++p;
+	else if (*p >= 'a' && *p <= 'h' && (p[1] == '3' || p[1] == '6')) {
+		int epsq = chess_square(p[1] - '1', *p - 'a');
+
+		/* Only record en passant squares that can be used, like
+		 * chess_board_make_move() does, so that hash keys agree. */
+		if (PAWN_ATTACKS[board->side ^ 1][epsq] & PIECES(board, board->side, CHESS_PIECE_PAWN))
+			chess_board_set_enpassant_square(board, epsq);
+		p += 2;
+	}
+	else
+		goto invalid;
+
+	/* Step 5: Move counters, optional */
+	while (*p == ' ')
+		++p;
+	if (*p == '\0')
+		return true;
+	count = strtoul(p, &end, 10);
+	if (end == p)
+		goto invalid;
+	board->rhmc = (count < CHESS_RHMC_MAX) ? count : CHESS_RHMC_MAX;
+	p = end;
+	while (*p == ' ')
+		++p;
+	if (*p == '\0')
+		return true;
+	count = strtoul(p, &end, 10);
+	if (end == p)
+		goto invalid;
+	board->fmc = count;
+
+	return true;
+
+invalid:
+	board_clear(board);
+	return false;
+}
+
+unsigned long long
+chess_board_get_hash(const struct chess_board *board)
+{
+	return chess_inline_board_get_hash(board);
+}
+
+/* Reverses the bits of every byte, which mirrors a bitboard horizontally */
+static inline unsigned long long
+bb_mirror(unsigned long long b)
+{
+	b = ((b >> 1) & 0x5555555555555555ULL) | ((b & 0x5555555555555555ULL) << 1);
+	b = ((b >> 2) & 0x3333333333333333ULL) | ((b & 0x3333333333333333ULL) << 2);
+	b = ((b >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((b & 0x0f0f0f0f0f0f0f0fULL) << 4);
+	return b;
+}
+
+/* Castling flags with the colours swapped, black's are white's shifted by two */
+static inline int
+board_flip_castle(int cflag)
+{
+	return ((cflag & CHESS_CASTLE_WHITE) << 2) | ((cflag & CHESS_CASTLE_BLACK) >> 2);
+}
+
+/* Hash key of the position with the squares transformed by sq ^ xor and the
+ * colours swapped if flip is set. Vertical flips always swap colours.
+ */
+static unsigned long long
+board_transformed_hash(const struct chess_board *board, int xor, int flip)
+{
+	unsigned long long hash, pieces;
+
+	hash = zobrist_castle[(flip ? board_flip_castle(board->cflag) : board->cflag) & 15];
+	for (int side = 0; side < 2; side++) {
+		for (int piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++) {
+			pieces = PIECES(board, side, piece);
+			while (pieces)
+				hash ^= zobrist_piece[side ^ flip][piece][bb_pop(&pieces) ^ xor];
+		}
+	}
+	if ((board->side ^ flip) == CHESS_SIDE_BLACK)
+		hash ^= zobrist_side;
+	if (board->epsq >= 0)
+		hash ^= zobrist_enpassant[chess_file(board->epsq ^ xor)];
+	return hash;
+}
+
+void
+chess_board_flip(struct chess_board *board)
+{
+	unsigned long long tmp, row[8];
+
+	/* Byte swaps flip the bitboards, swapping the sides swaps the colours */
+	for (int piece = 0; piece < 6; piece++) {
+		tmp = board->pieces[CHESS_SIDE_WHITE][piece];
+		board->pieces[CHESS_SIDE_WHITE][piece] = __builtin_bswap64(board->pieces[CHESS_SIDE_BLACK][piece]);
+		board->pieces[CHESS_SIDE_BLACK][piece] = __builtin_bswap64(tmp);
+	}
+	tmp = board->occupied[CHESS_SIDE_WHITE];
+	board->occupied[CHESS_SIDE_WHITE] = __builtin_bswap64(board->occupied[CHESS_SIDE_BLACK]);
+	board->occupied[CHESS_SIDE_BLACK] = __builtin_bswap64(tmp);
+
+	/* The mailbox is eight rows of eight bytes */
+	memcpy(row, board->cboard, sizeof(row));
+	for (int rank = 0; rank < 8; rank++)
+		memcpy(board->cboard + 8 * rank, &row[7 - rank], sizeof(row[0]));
+
+	board->side ^= 1;
+	if (board->epsq >= 0)
+		board->epsq ^= 56;
+	board->cflag = board_flip_castle(board->cflag);
+	board->hash = board_transformed_hash(board, 0, 0);
+	board->hply = 0;
+}
+
+bool
+chess_board_mirror(struct chess_board *board)
+{
+	unsigned long long row[8];
+
+	if (board->cflag & (CHESS_CASTLE_WHITE | CHESS_CASTLE_BLACK))
+		return false;
+
+	for (int side = 0; side < 2; side++) {
+		for (int piece = 0; piece < 6; piece++)
+			board->pieces[side][piece] = bb_mirror(board->pieces[side][piece]);
+		board->occupied[side] = bb_mirror(board->occupied[side]);
+	}
+
+	memcpy(row, board->cboard, sizeof(row));
+	for (int rank = 0; rank < 8; rank++)
+		row[rank] = __builtin_bswap64(row[rank]);
+	memcpy(board->cboard, row, sizeof(row));
+
+	if (board->epsq >= 0)
+		board->epsq ^= 7;
+	board->hash = board_transformed_hash(board, 0, 0);
+	board->hply = 0;
+	return true;
+}
+
+unsigned long long
+chess_board_get_canonical_hash(const struct chess_board *board)
+{
+	unsigned long long hash, min;
+
+	min = board->hash;
+	hash = board_transformed_hash(board, 56, 1);
+	if (hash < min)
+		min = hash;
+	if (board->cflag & (CHESS_CASTLE_WHITE | CHESS_CASTLE_BLACK))
+		return min;
+
+	hash = board_transformed_hash(board, 7, 0);
+	if (hash < min)
+		min = hash;
+	hash = board_transformed_hash(board, 63, 1);
+	if (hash < min)
+		min = hash;
+	return min;
+}
+
+bool
+chess_board_is_attacked(const struct chess_board *board, int square, int side)
+{
+	assert(square >= 0 && square <= 63);
+	assert(side == CHESS_SIDE_WHITE || side == CHESS_SIDE_BLACK);
+
+	return (board_attackers(board, square, OCCUPIED(board)) & board->occupied[side]) != 0;
+}
+
+bool
+chess_board_in_check(const struct chess_board *board)
+{
+	unsigned long long king;
+
+	king = PIECES(board, board->side, CHESS_PIECE_KING);
+	if (!king)
+		return false;
+	return chess_board_is_attacked(board, bb_lsb(king), chess_switch_side(board->side));
+}
+
+bool
+chess_board_gives_check(const struct chess_board *board, unsigned move)
+{
+	int side, from, to, piece, ksq, rfrom, rto;
+	unsigned long long occ, king, mine[7];
+
+	side = board->side;
+	king = PIECES(board, chess_switch_side(side), CHESS_PIECE_KING);
+	if (!king)
+		return false;
+	ksq = bb_lsb(king);
+	from = chess_move_from(move);
+	to = chess_move_to(move);
+	piece = board->cboard[from];
+
+	/* Our pieces and the occupancy once the move is made */
+	for (int p = CHESS_PIECE_PAWN; p <= CHESS_PIECE_QUEEN; p++)
+		mine[p] = PIECES(board, side, p);
+	mine[CHESS_PIECE_KING] = 0;
+	mine[piece] &= ~(1ULL << from);
+	mine[chess_move_promotion(move) ? chess_move_promotion(move) : piece] |= 1ULL << to;
+	occ = (OCCUPIED(board) & ~(1ULL << from)) | (1ULL << to);
+	if (chess_move_flags(move) & CHESS_MOVE_FLAG_ENPASSANT)
+		occ &= ~(1ULL << (to ^ 8));
+	else if (chess_move_flags(move) & CHESS_MOVE_FLAG_CASTLE) {
+		board_castle_rook(board, to, &rfrom, &rto);
+		occ = (OCCUPIED(board) & ~(1ULL << from) & ~(1ULL << rfrom)) | (1ULL << to) | (1ULL << rto);
+		mine[CHESS_PIECE_ROOK] = (mine[CHESS_PIECE_ROOK] & ~(1ULL << rfrom)) | (1ULL << rto);
+	}
+
+	return (PAWN_ATTACKS[chess_switch_side(side)][ksq] & mine[CHESS_PIECE_PAWN])
+		|| (KNIGHT_ATTACKS[ksq] & mine[CHESS_PIECE_KNIGHT])
+		|| (BISHOP_ATTACKS(ksq, occ) & (mine[CHESS_PIECE_BISHOP] | mine[CHESS_PIECE_QUEEN]))
+		|| (ROOK_ATTACKS(ksq, occ) & (mine[CHESS_PIECE_ROOK] | mine[CHESS_PIECE_QUEEN]));
+}
+
+unsigned
+chess_move(int from, int to, int promotion, int flags)
+{
+	assert(from >= 0 && from <= 63);
+	assert(to >= 0 && to <= 63);
+
+	return MOVE(from, to, promotion, flags);
+}
+
+inline int
+chess_move_from(unsigned move)
+{
+	return chess_inline_move_from(move);
+}
+
+inline int
+chess_move_to(unsigned move)
+{
+	return chess_inline_move_to(move);
+}
+
+inline int
+chess_move_promotion(unsigned move)
+{
+	return chess_inline_move_promotion(move);
+}
+
+inline int
+chess_move_flags(unsigned move)
+{
+	return chess_inline_move_flags(move);
+}
+
+char *
+chess_move_get_string(unsigned move, char *str, size_t len)
+{
+	int promotion;
+	size_t need;
+
+	promotion = chess_move_promotion(move);
+	need = promotion ? 6 : 5;
+	if (len < need)
+		return NULL;
+
+	memcpy(str, chess_square_name(chess_move_from(move)), 2);
+	memcpy(str + 2, chess_square_name(chess_move_to(move)), 2);
+	if (promotion)
+		str[4] = chess_piece_char(promotion, CHESS_SIDE_BLACK);
+	str[need - 1] = '\0';
+	return str;
+}
+
+/* Kinds of moves generated by board_generate() */
+#define GEN_TACTICAL	1	/* Captures and queen promotions */
+#define GEN_QUIET	2	/* All other moves */
+#define GEN_ALL		(GEN_TACTICAL | GEN_QUIET)
+
+/* Bodies that dispatchers expand once per side to move, and kind of moves,
+ * with those as constants. The pawn directions and ranks, castling squares
+ * and flags and the tables indexed by side then fold at compile time, and
+ * the side's bitboards are at fixed offsets of the board.
+ */
+#define SPECIALIZED static inline __attribute__((always_inline))
+
+/* Adds pawn moves, promotions to the pieces from hi down to lo */
+static inline unsigned *
+add_pawn_moves(unsigned *moves, int from, unsigned long long targets, int lo, int hi)
+{
+	int to;
+
+	while (targets) {
+		to = bb_pop(&targets);
+		if ((1ULL << to) & (RANK_1 | RANK_8)) {
+			for (int piece = hi; piece >= lo; piece--)
+				*moves++ = MOVE(from, to, piece, 0);
+		}
+		else
+			*moves++ = MOVE(from, to, 0, 0);
+	}
+	return moves;
+}
+
+/* Adds the pawn moves to the target squares from delta squares behind, see
+ * add_pawn_moves(). Promotions are added from hi down to lo.
+ */
+static inline unsigned *
+add_pawn_targets(unsigned *moves, unsigned long long targets, int delta, int lo, int hi)
+{
+	int to;
+
+	while (targets) {
+		to = bb_pop(&targets);
+		if ((1ULL << to) & (RANK_1 | RANK_8)) {
+			for (int piece = hi; piece >= lo; piece--)
+				*moves++ = MOVE(to - delta, to, piece, 0);
+		}
+		else
+			*moves++ = MOVE(to - delta, to, 0, 0);
+	}
+	return moves;
+}
+
+/* Shifts the bitboard towards higher squares by n, or lower ones if negative */
+static inline unsigned long long
+bb_shift(unsigned long long b, int n)
+{
+	return n > 0 ? b << n : b >> -n;
+}
+
+static inline unsigned *
+add_moves(unsigned *moves, int from, unsigned long long targets)
+{
+	while (targets)
+		*moves++ = MOVE(from, bb_pop(&targets), 0, 0);
+	return moves;
+}
+
+/* Whether the side to move, us, not in check, may castle with the king side
+ * (0) or queen side (1) rook.
+ */
+SPECIALIZED bool
+board_can_castle(const struct chess_board *board, int us, int i)
+{
+	int base, kfile, rfile, ksq, flag;
+	unsigned long long occ, safe, aocc;
+
+	base = (us == CHESS_SIDE_WHITE) ? 0 : 56;
+	kfile = board->isq[0] & 7;
+	rfile = board->isq[1 + i] & 7;
+	ksq = base + kfile;
+	if (i == 0)
+		flag = (us == CHESS_SIDE_WHITE) ? CHESS_CASTLE_KINGSIDE_WHITE : CHESS_CASTLE_KINGSIDE_BLACK;
+	else
+		flag = (us == CHESS_SIDE_WHITE) ? CHESS_CASTLE_QUEENSIDE_WHITE : CHESS_CASTLE_QUEENSIDE_BLACK;
+
+	occ = OCCUPIED(board);
+	if (!(board->cflag & flag)
+			|| !(PIECES(board, us, CHESS_PIECE_KING) & (1ULL << ksq))
+			|| !(PIECES(board, us, CHESS_PIECE_ROOK) & (1ULL << (base + rfile)))
+			|| (occ & CASTLE_EMPTY[us][kfile][rfile]))
+		return false;
+
+	/* The castling pieces don't shield the king once they moved */
+	aocc = occ ^ (1ULL << ksq) ^ (1ULL << (base + rfile));
+	safe = CASTLE_SAFE[us][kfile][rfile];
+	while (safe && !(board_attackers(board, bb_lsb(safe), aocc) & board->occupied[us ^ 1]))
+		safe &= safe - 1;
+	return !safe;
+}
+
+SPECIALIZED unsigned *
+board_generate_side(const struct chess_board *board, unsigned *moves, int us, int kind)
+{
+	int them, ksq, from, to, capsq, up;
+	unsigned long long occ, own, enemy, checkers, pinned, snipers;
+	unsigned long long kmask, target, b, att, push, dbl, pawns;
+
+	them = us ^ 1;
+	occ = OCCUPIED(board);
+	own = board->occupied[us];
+	enemy = board->occupied[them];
+	if (!PIECES(board, us, CHESS_PIECE_KING))
+		return moves;
+	ksq = bb_lsb(PIECES(board, us, CHESS_PIECE_KING));
+
+	/* Destination squares of the kind of moves */
+	kmask = ((kind & GEN_TACTICAL) ? enemy : 0) | ((kind & GEN_QUIET) ? ~occ : 0);
+
+	/* King moves */
+	b = KING_ATTACKS[ksq] & kmask;
+	while (b) {
+		to = bb_pop(&b);
+		if (!(board_attackers(board, to, occ ^ (1ULL << ksq)) & enemy))
+			*moves++ = MOVE(ksq, to, 0, 0);
+	}
+
+	checkers = board_attackers(board, ksq, occ) & enemy;
+	if (bb_several(checkers))
+		return moves;
+
+	/* Castling, the rook squares come from the initial square fields */
+	if (!checkers && (kind & GEN_QUIET)) {
+		int base = (us == CHESS_SIDE_WHITE) ? 0 : 56;
+
+		for (int i = 0; i < 2; i++) {
+			if (board_can_castle(board, us, i))
+				*moves++ = MOVE(ksq, base + ((i == 0) ? 6 : 2), 0, CHESS_MOVE_FLAG_CASTLE);
+		}
+	}
+
+	/* Squares that resolve a check, if any */
+	target = checkers ? (bb_between(ksq, bb_lsb(checkers)) | checkers) : ~0ULL;
+
+	/* Pieces pinned to our king */
+	pinned = 0;
+	snipers = ((ROOK_RAYS[ksq] & (PIECES(board, them, CHESS_PIECE_ROOK) | PIECES(board, them, CHESS_PIECE_QUEEN)))
+			| (BISHOP_RAYS[ksq] & (PIECES(board, them, CHESS_PIECE_BISHOP) | PIECES(board, them, CHESS_PIECE_QUEEN))));
+	while (snipers) {
+		b = bb_between(ksq, bb_pop(&snipers)) & occ;
+		if (b && !bb_several(b) && (b & own))
+			pinned |= b;
+	}
+
+	/* Pawns that are not pinned move all at once */
+	up = (us == CHESS_SIDE_WHITE) ? 8 : -8;
+	pawns = PIECES(board, us, CHESS_PIECE_PAWN);
+	b = pawns & ~pinned;
+	push = bb_shift(b, up) & ~occ;
+	dbl = bb_shift(push & ((us == CHESS_SIDE_WHITE) ? RANK_1 << 16 : RANK_8 >> 16), up) & ~occ & target;
+	push &= target;
+	if (kind & GEN_TACTICAL) {
+		moves = add_pawn_targets(moves, bb_shift(b & ~FILE_A, up - 1) & enemy & target, up - 1,
+				CHESS_PIECE_KNIGHT, CHESS_PIECE_QUEEN);
+		moves = add_pawn_targets(moves, bb_shift(b & ~FILE_H, up + 1) & enemy & target, up + 1,
+				CHESS_PIECE_KNIGHT, CHESS_PIECE_QUEEN);
+	}
+	/* Queen promotions are tactical, underpromotions quiet */
+	moves = add_pawn_targets(moves, push & (RANK_1 | RANK_8), up,
+			(kind & GEN_QUIET) ? CHESS_PIECE_KNIGHT : CHESS_PIECE_QUEEN,
+			(kind & GEN_TACTICAL) ? CHESS_PIECE_QUEEN : CHESS_PIECE_ROOK);
+	if (kind & GEN_QUIET) {
+		moves = add_pawn_targets(moves, push & ~(RANK_1 | RANK_8), up, 0, 0);
+		moves = add_pawn_targets(moves, dbl, 2 * up, 0, 0);
+	}
+
+	/* Pinned pawns may only move along the pin */
+	b = pawns & pinned;
+	while (b) {
+		from = bb_pop(&b);
+		att = PAWN_ATTACKS[us][from] & enemy;
+		push = 0;
+		if (!(occ & (1ULL << (from + up)))) {
+			push = 1ULL << (from + up);
+			if (chess_rank(from) == ((us == CHESS_SIDE_WHITE) ? 1 : 6) && !(occ & (1ULL << (from + 2 * up))))
+				push |= 1ULL << (from + 2 * up);
+		}
+		att &= target & bb_line(ksq, from);
+		push &= target & bb_line(ksq, from);
+		if (kind == GEN_ALL)
+			moves = add_pawn_moves(moves, from, att | push, CHESS_PIECE_KNIGHT, CHESS_PIECE_QUEEN);
+		else if (kind == GEN_TACTICAL) {
+			moves = add_pawn_moves(moves, from, att, CHESS_PIECE_KNIGHT, CHESS_PIECE_QUEEN);
+			moves = add_pawn_moves(moves, from, push & (RANK_1 | RANK_8), CHESS_PIECE_QUEEN, CHESS_PIECE_QUEEN);
+		}
+		else
+			moves = add_pawn_moves(moves, from, push, CHESS_PIECE_KNIGHT, CHESS_PIECE_ROOK);
+	}
+
+	/* En passant, verified by removing both pawns */
+	if ((kind & GEN_TACTICAL) && board->epsq >= 0) {
+		capsq = board->epsq - up;
+		b = PAWN_ATTACKS[them][board->epsq] & pawns;
+		while (b) {
+			unsigned long long eocc;
+
+			from = bb_pop(&b);
+			eocc = (occ ^ (1ULL << from) ^ (1ULL << capsq)) | (1ULL << board->epsq);
+			if (!(board_attackers(board, ksq, eocc) & enemy & ~(1ULL << capsq)))
+				*moves++ = MOVE(from, board->epsq, 0, CHESS_MOVE_FLAG_ENPASSANT);
+		}
+	}
+
+	/* Pieces */
+	target &= kmask;
+	b = PIECES(board, us, CHESS_PIECE_KNIGHT) & ~pinned;
+	while (b) {
+		from = bb_pop(&b);
+		moves = add_moves(moves, from, KNIGHT_ATTACKS[from] & target);
+	}
+	b = PIECES(board, us, CHESS_PIECE_BISHOP) | PIECES(board, us, CHESS_PIECE_QUEEN);
+	while (b) {
+		from = bb_pop(&b);
+		att = BISHOP_ATTACKS(from, occ) & target;
+		if (pinned & (1ULL << from))
+			att &= bb_line(ksq, from);
+		moves = add_moves(moves, from, att);
+	}
+	b = PIECES(board, us, CHESS_PIECE_ROOK) | PIECES(board, us, CHESS_PIECE_QUEEN);
+	while (b) {
+		from = bb_pop(&b);
+		att = ROOK_ATTACKS(from, occ) & target;
+		if (pinned & (1ULL << from))
+			att &= bb_line(ksq, from);
+		moves = add_moves(moves, from, att);
+	}
+
+	return moves;
+}
+
+/* One function per side and kind, each expansion of the body on its own */
+#define GENERATOR(name, side, kind)						\
+	static unsigned *							\
+	name(const struct chess_board *board, unsigned *moves)			\
+	{									\
+		return board_generate_side(board, moves, side, kind);		\
+	}
+GENERATOR(board_generate_white_tactical, CHESS_SIDE_WHITE, GEN_TACTICAL)
+GENERATOR(board_generate_white_quiet, CHESS_SIDE_WHITE, GEN_QUIET)
+GENERATOR(board_generate_white_all, CHESS_SIDE_WHITE, GEN_ALL)
+GENERATOR(board_generate_black_tactical, CHESS_SIDE_BLACK, GEN_TACTICAL)
+GENERATOR(board_generate_black_quiet, CHESS_SIDE_BLACK, GEN_QUIET)
+GENERATOR(board_generate_black_all, CHESS_SIDE_BLACK, GEN_ALL)
+#undef GENERATOR
+
+static unsigned *(*const board_generators[2][4])(const struct chess_board *, unsigned *) = {
+	{ NULL, board_generate_white_tactical, board_generate_white_quiet, board_generate_white_all },
+	{ NULL, board_generate_black_tactical, board_generate_black_quiet, board_generate_black_all },
+};
+
+static inline unsigned *
+board_generate(const struct chess_board *board, unsigned *moves, int kind)
+{
+	return board_generators[board->side][kind](board, moves);
+}
+
+unsigned
+chess_board_generate_moves(const struct chess_board *board, unsigned *moves)
+{
+	STATS_INC(GENERATE_MOVES);
+	return board_generate(board, moves, GEN_ALL) - moves;
+}
+
+/* Direct checks land on the squares the piece attacks the enemy king from,
+ * discovered checks take a piece off the line between one of our sliders and
+ * the enemy king. Promotions, en passant and castling are few and tried one by
+ * one with chess_board_gives_check().
+ */
+unsigned
+chess_board_generate_checks(const struct chess_board *board, unsigned *moves)
+{
+	int us, them, ksq, eksq, from, to, up, capsq;
+	unsigned move, *start;
+	unsigned long long occ, own, enemy, checkers, pinned, discover, snipers;
+	unsigned long long target, b, att, promo, pchk, bchk, rchk, chk;
+
+	us = board->side;
+	them = us ^ 1;
+	if (!PIECES(board, us, CHESS_PIECE_KING) || !PIECES(board, them, CHESS_PIECE_KING))
+		return 0;
+	ksq = bb_lsb(PIECES(board, us, CHESS_PIECE_KING));
+	eksq = bb_lsb(PIECES(board, them, CHESS_PIECE_KING));
+	occ = OCCUPIED(board);
+	own = board->occupied[us];
+	enemy = board->occupied[them];
+	start = moves;
+
+	/* Our pieces that are all that shields the enemy king from our sliders */
+	discover = 0;
+	snipers = ((ROOK_RAYS[eksq] & (PIECES(board, us, CHESS_PIECE_ROOK) | PIECES(board, us, CHESS_PIECE_QUEEN)))
+			| (BISHOP_RAYS[eksq] & (PIECES(board, us, CHESS_PIECE_BISHOP) | PIECES(board, us, CHESS_PIECE_QUEEN))));
+	while (snipers) {
+		b = bb_between(eksq, bb_pop(&snipers)) & occ;
+		if (b && !bb_several(b) && (b & own))
+			discover |= b;
+	}
+
+	/* The king only checks by discovery */
+	if (discover & (1ULL << ksq)) {
+		b = KING_ATTACKS[ksq] & ~own & ~bb_line(eksq, ksq);
+		while (b) {
+			to = bb_pop(&b);
+			if (!(board_attackers(board, to, occ ^ (1ULL << ksq)) & enemy))
+				*moves++ = MOVE(ksq, to, 0, 0);
+		}
+	}
+
+	checkers = board_attackers(board, ksq, occ) & enemy;
+	if (bb_several(checkers))
+		return moves - start;
+
+	/* Castling checks with the rook or by discovery */
+	if (!checkers) {
+		int base = (us == CHESS_SIDE_WHITE) ? 0 : 56;
+
+		for (int i = 0; i < 2; i++) {
+			move = MOVE(ksq, base + ((i == 0) ? 6 : 2), 0, CHESS_MOVE_FLAG_CASTLE);
+			if (((ROOK_RAYS[eksq] & (1ULL << (base + ((i == 0) ? 5 : 3)))) || (discover & (1ULL << ksq)))
+					&& board_can_castle(board, us, i) && chess_board_gives_check(board, move))
+				*moves++ = move;
+		}
+	}
+
+	/* Legal destinations, as in board_generate_side() */
+	target = (checkers ? (bb_between(ksq, bb_lsb(checkers)) | checkers) : ~0ULL) & ~own;
+	pinned = 0;
+	snipers = ((ROOK_RAYS[ksq] & (PIECES(board, them, CHESS_PIECE_ROOK) | PIECES(board, them, CHESS_PIECE_QUEEN)))
+			| (BISHOP_RAYS[ksq] & (PIECES(board, them, CHESS_PIECE_BISHOP) | PIECES(board, them, CHESS_PIECE_QUEEN))));
+	while (snipers) {
+		b = bb_between(ksq, bb_pop(&snipers)) & occ;
+		if (b && !bb_several(b) && (b & own))
+			pinned |= b;
+	}
+
+	/* Squares the pieces check from */
+	bchk = BISHOP_ATTACKS(eksq, occ);
+	rchk = ROOK_ATTACKS(eksq, occ);
+
+	/* Pawns that reach a square checking the king, promote or discover */
+	up = (us == CHESS_SIDE_WHITE) ? 8 : -8;
+	pchk = PAWN_ATTACKS[them][eksq];
+	b = bb_shift(pchk, -up) | bb_shift(pchk & ((us == CHESS_SIDE_WHITE) ? RANK_1 << 24 : RANK_8 >> 24), -2 * up)
+		| bb_shift(pchk & ~FILE_A, -up - 1) | bb_shift(pchk & ~FILE_H, -up + 1)
+		| ((us == CHESS_SIDE_WHITE) ? RANK_8 >> 8 : RANK_1 << 8) | discover;
+	b &= PIECES(board, us, CHESS_PIECE_PAWN);
+	while (b) {
+		from = bb_pop(&b);
+		att = PAWN_ATTACKS[us][from] & enemy;
+		if (!(occ & (1ULL << (from + up)))) {
+			att |= 1ULL << (from + up);
+			if (chess_rank(from) == ((us == CHESS_SIDE_WHITE) ? 1 : 6) && !(occ & (1ULL << (from + 2 * up))))
+				att |= 1ULL << (from + 2 * up);
+		}
+		att &= target;
+		if (pinned & (1ULL << from))
+			att &= bb_line(ksq, from);
+
+		promo = att & (RANK_1 | RANK_8);
+		while (promo) {
+			to = bb_pop(&promo);
+			for (int piece = CHESS_PIECE_QUEEN; piece >= CHESS_PIECE_KNIGHT; piece--) {
+				move = MOVE(from, to, piece, 0);
+				if (chess_board_gives_check(board, move))
+					*moves++ = move;
+			}
+		}
+		chk = pchk | ((discover & (1ULL << from)) ? ~bb_line(eksq, from) : 0);
+		moves = add_moves(moves, from, att & ~(RANK_1 | RANK_8) & chk);
+	}
+
+	if (board->epsq >= 0) {
+		capsq = board->epsq - up;
+		b = PAWN_ATTACKS[them][board->epsq] & PIECES(board, us, CHESS_PIECE_PAWN);
+		while (b) {
+			unsigned long long eocc;
+
+			from = bb_pop(&b);
+			eocc = (occ ^ (1ULL << from) ^ (1ULL << capsq)) | (1ULL << board->epsq);
+			move = MOVE(from, board->epsq, 0, CHESS_MOVE_FLAG_ENPASSANT);
+			if (!(board_attackers(board, ksq, eocc) & enemy & ~(1ULL << capsq))
+					&& chess_board_gives_check(board, move))
+				*moves++ = move;
+		}
+	}
+
+	b = PIECES(board, us, CHESS_PIECE_KNIGHT) & ~pinned;
+	while (b) {
+		from = bb_pop(&b);
+		chk = KNIGHT_ATTACKS[eksq] | ((discover & (1ULL << from)) ? ~bb_line(eksq, from) : 0);
+		moves = add_moves(moves, from, KNIGHT_ATTACKS[from] & target & chk);
+	}
+
+	/* Queens move in both loops and check from either kind of square */
+	b = PIECES(board, us, CHESS_PIECE_BISHOP) | PIECES(board, us, CHESS_PIECE_QUEEN);
+	while (b) {
+		from = bb_pop(&b);
+		att = BISHOP_ATTACKS(from, occ) & target;
+		if (pinned & (1ULL << from))
+			att &= bb_line(ksq, from);
+		chk = (board->cboard[from] == CHESS_PIECE_QUEEN) ? (bchk | rchk) : bchk;
+		if (discover & (1ULL << from))
+			chk |= ~bb_line(eksq, from);
+		moves = add_moves(moves, from, att & chk);
+	}
+	b = PIECES(board, us, CHESS_PIECE_ROOK) | PIECES(board, us, CHESS_PIECE_QUEEN);
+	while (b) {
+		from = bb_pop(&b);
+		att = ROOK_ATTACKS(from, occ) & target;
+		if (pinned & (1ULL << from))
+			att &= bb_line(ksq, from);
+		chk = (board->cboard[from] == CHESS_PIECE_QUEEN) ? (bchk | rchk) : rchk;
+		if (discover & (1ULL << from))
+			chk |= ~bb_line(eksq, from);
+		moves = add_moves(moves, from, att & chk);
+	}
+
+	return moves - start;
+}
+
+/* Pawn moves to the target squares, promotions counting four times */
+static inline unsigned
+count_pawn_moves(unsigned long long targets)
+{
+	return bb_count(targets) + 3 * bb_count(targets & (RANK_1 | RANK_8));
+}
+
+SPECIALIZED unsigned
+board_count_side(const struct chess_board *board, int us)
+{
+	int them, ksq, from, to, capsq, up;
+	unsigned n;
+	unsigned long long occ, own, enemy, checkers, pinned, snipers;
+	unsigned long long target, b, att, single, dbl, left, right, rank3;
+
+	them = us ^ 1;
+	occ = OCCUPIED(board);
+	own = board->occupied[us];
+	enemy = board->occupied[them];
+	if (!PIECES(board, us, CHESS_PIECE_KING))
+		return 0;
+	ksq = bb_lsb(PIECES(board, us, CHESS_PIECE_KING));
+	n = 0;
+
+	/* King moves */
+	b = KING_ATTACKS[ksq] & ~own;
+	while (b) {
+		to = bb_pop(&b);
+		if (!(board_attackers(board, to, occ ^ (1ULL << ksq)) & enemy))
+			++n;
+	}
+
+	checkers = board_attackers(board, ksq, occ) & enemy;
+	if (bb_several(checkers))
+		return n;
+	if (!checkers)
+		n += board_can_castle(board, us, 0) + board_can_castle(board, us, 1);
+
+	target = checkers ? (bb_between(ksq, bb_lsb(checkers)) | checkers) : ~0ULL;
+
+	pinned = 0;
+	snipers = ((ROOK_RAYS[ksq] & (PIECES(board, them, CHESS_PIECE_ROOK) | PIECES(board, them, CHESS_PIECE_QUEEN)))
+			| (BISHOP_RAYS[ksq] & (PIECES(board, them, CHESS_PIECE_BISHOP) | PIECES(board, them, CHESS_PIECE_QUEEN))));
+	while (snipers) {
+		b = bb_between(ksq, bb_pop(&snipers)) & occ;
+		if (b && !bb_several(b) && (b & own))
+			pinned |= b;
+	}
+
+	/* Pawns that are not pinned move all at once */
+	b = PIECES(board, us, CHESS_PIECE_PAWN);
+	if (us == CHESS_SIDE_WHITE) {
+		up = 8;
+		rank3 = RANK_1 << 16;
+		single = ((b & ~pinned) << 8) & ~occ;
+		dbl = ((single & rank3) << 8) & ~occ;
+		left = ((b & ~pinned & ~FILE_A) << 7) & enemy;
+		right = ((b & ~pinned & ~FILE_H) << 9) & enemy;
+	}
+	else {
+		up = -8;
+		rank3 = RANK_8 >> 16;
+		single = ((b & ~pinned) >> 8) & ~occ;
+		dbl = ((single & rank3) >> 8) & ~occ;
+		left = ((b & ~pinned & ~FILE_A) >> 9) & enemy;
+		right = ((b & ~pinned & ~FILE_H) >> 7) & enemy;
+	}
+	n += count_pawn_moves(single & target) + bb_count(dbl & target)
+		+ count_pawn_moves(left & target) + count_pawn_moves(right & target);
+
+	/* Pinned pawns may only move along the pin */
+	att = b & pinned;
+	while (att) {
+		unsigned long long to_bb;
+
+		from = bb_pop(&att);
+		to_bb = PAWN_ATTACKS[us][from] & enemy;
+		if (!(occ & (1ULL << (from + up)))) {
+			to_bb |= 1ULL << (from + up);
+			if (chess_rank(from) == ((us == CHESS_SIDE_WHITE) ? 1 : 6)
+					&& !(occ & (1ULL << (from + 2 * up))))
+				to_bb |= 1ULL << (from + 2 * up);
+		}
+		n += count_pawn_moves(to_bb & target & bb_line(ksq, from));
+	}
+
+	/* En passant, verified by removing both pawns */
+	if (board->epsq >= 0) {
+		capsq = board->epsq - up;
+		att = PAWN_ATTACKS[them][board->epsq] & b;
+		while (att) {
+			from = bb_pop(&att);
+			if (!(board_attackers(board, ksq, (occ ^ (1ULL << from) ^ (1ULL << capsq)) | (1ULL << board->epsq))
+						& enemy & ~(1ULL << capsq)))
+				++n;
+		}
+	}
+
+	/* Pieces */
+	target &= ~own;
+	b = PIECES(board, us, CHESS_PIECE_KNIGHT) & ~pinned;
+	while (b) {
+		from = bb_pop(&b);
+		n += bb_count(KNIGHT_ATTACKS[from] & target);
+	}
+	b = PIECES(board, us, CHESS_PIECE_BISHOP) | PIECES(board, us, CHESS_PIECE_QUEEN);
+	while (b) {
+		from = bb_pop(&b);
+		att = BISHOP_ATTACKS(from, occ) & target;
+		if (pinned & (1ULL << from))
+			att &= bb_line(ksq, from);
+		n += bb_count(att);
+	}
+	b = PIECES(board, us, CHESS_PIECE_ROOK) | PIECES(board, us, CHESS_PIECE_QUEEN);
+	while (b) {
+		from = bb_pop(&b);
+		att = ROOK_ATTACKS(from, occ) & target;
+		if (pinned & (1ULL << from))
+			att &= bb_line(ksq, from);
+		n += bb_count(att);
+	}
+
+	return n;
+}
+
+unsigned
+chess_board_count_moves(const struct chess_board *board)
+{
+	if (board->side == CHESS_SIDE_WHITE)
+		return board_count_side(board, CHESS_SIDE_WHITE);
+	return board_count_side(board, CHESS_SIDE_BLACK);
+}
+
+/* Captures, queen promotions and en passant */
+static inline bool
+board_move_is_tactical(const struct chess_board *board, unsigned move)
+{
+	if (chess_move_flags(move) & CHESS_MOVE_FLAG_CASTLE)
+		return false;
+	return board->cboard[chess_move_to(move)] != 0
+		|| (chess_move_flags(move) & CHESS_MOVE_FLAG_ENPASSANT)
+		|| chess_move_promotion(move) == CHESS_PIECE_QUEEN;
+}
+
+bool
+chess_board_is_legal_move(const struct chess_board *board, unsigned move)
+{
+	int us, from, to, piece, promotion, flags, ksq, up, capsq;
+	unsigned long long occ, own, enemy, tobit, removed;
+
+	if (move == CHESS_MOVE_NONE)
+		return false;
+	us = board->side;
+	from = chess_move_from(move);
+	to = chess_move_to(move);
+	promotion = chess_move_promotion(move);
+	flags = chess_move_flags(move);
+	own = board->occupied[us];
+	enemy = board->occupied[us ^ 1];
+	occ = own | enemy;
+	tobit = 1ULL << to;
+	if (!(own & (1ULL << from)) || !PIECES(board, us, CHESS_PIECE_KING))
+		return false;
+	piece = board->cboard[from];
+	ksq = bb_lsb(PIECES(board, us, CHESS_PIECE_KING));
+
+	if (flags & CHESS_MOVE_FLAG_CASTLE) {
+		int base = (us == CHESS_SIDE_WHITE) ? 0 : 56;
+
+		if (flags != CHESS_MOVE_FLAG_CASTLE || promotion || from != ksq
+				|| (to != base + 6 && to != base + 2)
+				|| (board_attackers(board, ksq, occ) & enemy))
+			return false;
+		return board_can_castle(board, us, (to == base + 6) ? 0 : 1);
+	}
+
+	/* Pseudo legal: the piece moves that way and promotes if it must */
+	if (own & tobit)
+		return false;
+	up = (us == CHESS_SIDE_WHITE) ? 8 : -8;
+	removed = 0;
+	if (piece == CHESS_PIECE_PAWN) {
+		if (flags & CHESS_MOVE_FLAG_ENPASSANT) {
+			if (to != board->epsq || !(PAWN_ATTACKS[us][from] & tobit))
+				return false;
+			capsq = to - up;
+			removed = 1ULL << capsq;
+		}
+		else if (flags)
+			return false;
+		else if (PAWN_ATTACKS[us][from] & enemy & tobit)
+			;
+		else if (to == from + up && !(occ & tobit))
+			;
+		else if (to == from + 2 * up && chess_rank(from) == ((us == CHESS_SIDE_WHITE) ? 1 : 6)
+				&& !(occ & ((1ULL << (from + up)) | tobit)))
+			;
+		else
+			return false;
+		if ((tobit & (RANK_1 | RANK_8))
+				? (promotion < CHESS_PIECE_KNIGHT || promotion > CHESS_PIECE_QUEEN)
+				: promotion != 0)
+			return false;
+	}
+	else {
+		unsigned long long att;
+
+		if (flags || promotion)
+			return false;
+		switch (piece) {
+		case CHESS_PIECE_KNIGHT:
+			att = KNIGHT_ATTACKS[from];
+			break;
+		case CHESS_PIECE_BISHOP:
+			att = BISHOP_ATTACKS(from, occ);
+			break;
+		case CHESS_PIECE_ROOK:
+			att = ROOK_ATTACKS(from, occ);
+			break;
+		case CHESS_PIECE_QUEEN:
+			att = BISHOP_ATTACKS(from, occ) | ROOK_ATTACKS(from, occ);
+			break;
+		default:
+			att = KING_ATTACKS[from];
+			break;
+		}
+		if (!(att & tobit))
+			return false;
+	}
+
+	/* Legal: no enemy piece but the captured one attacks the king afterwards */
+	if (piece == CHESS_PIECE_KING)
+		ksq = to;
+	occ = (occ ^ (1ULL << from) ^ removed) | tobit;
+	return !(board_attackers(board, ksq, occ) & enemy & ~(tobit | removed));
+}
+
+/* Move picker stages */
+enum {
+	PICK_HASH = 0,
+	PICK_TACTICAL_GEN,
+	PICK_TACTICAL,
+	PICK_KILLERS,
+	PICK_QUIET_GEN,
+	PICK_QUIET,
+	PICK_DONE,
+};
+
+void
+chess_picker_init(struct chess_picker *picker, unsigned hashmove, unsigned killer0, unsigned killer1, int flags)
+{
+	picker->stage = PICK_HASH;
+	picker->flags = flags;
+	picker->hashmove = hashmove;
+	picker->killers[0] = killer0;
+	picker->killers[1] = (killer1 != killer0) ? killer1 : CHESS_MOVE_NONE;
+	picker->history = NULL;
+	picker->n = picker->next = 0;
+}
+
+/* Moves the best scored move at or after the next index there */
+static unsigned
+picker_best(struct chess_picker *picker)
+{
+	unsigned i, best, tmove;
+	int tscore;
+
+	i = picker->next;
+	best = i;
+	for (unsigned j = i + 1; j < picker->n; j++) {
+		if (picker->scores[j] > picker->scores[best])
+			best = j;
+	}
+	tmove = picker->moves[i]; picker->moves[i] = picker->moves[best]; picker->moves[best] = tmove;
+	tscore = picker->scores[i]; picker->scores[i] = picker->scores[best]; picker->scores[best] = tscore;
+	return picker->moves[picker->next++];
+}
+
+unsigned
+chess_picker_next(struct chess_picker *picker, const struct chess_board *board)
+{
+	unsigned move;
+
+	for (;;) {
+		switch (picker->stage) {
+		case PICK_HASH:
+			picker->stage = PICK_TACTICAL_GEN;
+			if (picker->hashmove != CHESS_MOVE_NONE
+					&& ((picker->flags & CHESS_PICKER_TACTICAL)
+						? board_move_is_tactical(board, picker->hashmove) : true)
+					&& chess_board_is_legal_move(board, picker->hashmove))
+				return picker->hashmove;
+			picker->hashmove = CHESS_MOVE_NONE;
+			break;
+		case PICK_TACTICAL_GEN:
+			STATS_INC(GENERATE_MOVES);
+			picker->n = board_generate(board, picker->moves, GEN_TACTICAL) - picker->moves;
+			picker->next = 0;
+			if (picker->flags & CHESS_PICKER_MVV_LVA) {
+				for (unsigned i = 0; i < picker->n; i++) {
+					move = picker->moves[i];
+					/* Most valuable victim, least valuable attacker */
+					picker->scores[i] = ((chess_move_flags(move) & CHESS_MOVE_FLAG_ENPASSANT)
+							? CHESS_PIECE_PAWN : board->cboard[chess_move_to(move)]) * 16
+						+ chess_move_promotion(move) * 8 - board->cboard[chess_move_from(move)];
+				}
+			}
+			picker->stage = PICK_TACTICAL;
+			break;
+		case PICK_TACTICAL:
+			while (picker->next < picker->n) {
+				move = (picker->flags & CHESS_PICKER_MVV_LVA) ? picker_best(picker)
+					: picker->moves[picker->next++];
+				if (move != picker->hashmove)
+					return move;
+			}
+			picker->stage = (picker->flags & CHESS_PICKER_TACTICAL) ? PICK_DONE : PICK_KILLERS;
+			picker->next = 0;
+			break;
+		case PICK_KILLERS:
+			while (picker->next < 2) {
+				move = picker->killers[picker->next++];
+				if (move != CHESS_MOVE_NONE && move != picker->hashmove
+						&& chess_board_is_legal_move(board, move)
+						&& !board_move_is_tactical(board, move))
+					return move;
+				picker->killers[picker->next - 1] = CHESS_MOVE_NONE;
+			}
+			picker->stage = PICK_QUIET_GEN;
+			break;
+		case PICK_QUIET_GEN:
+			picker->n = board_generate(board, picker->moves, GEN_QUIET) - picker->moves;
+			picker->next = 0;
+			if (picker->history != NULL) {
+				for (unsigned i = 0; i < picker->n; i++)
+					picker->scores[i] = picker->history[chess_move_from(picker->moves[i])]
+						[chess_move_to(picker->moves[i])];
+			}
+			picker->stage = PICK_QUIET;
+			break;
+		case PICK_QUIET:
+			while (picker->next < picker->n) {
+				move = (picker->history != NULL) ? picker_best(picker) : picker->moves[picker->next++];
+				if (move != picker->hashmove && move != picker->killers[0] && move != picker->killers[1])
+					return move;
+			}
+			picker->stage = PICK_DONE;
+			break;
+		default:
+			return CHESS_MOVE_NONE;
+		}
+	}
+}
+
+SPECIALIZED void
+board_make_move_side(struct chess_board *board, unsigned move, struct chess_undo *undo, int us)
+{
+	int from, to, promotion, flags, them, piece;
+
+	from = chess_move_from(move);
+	to = chess_move_to(move);
+	promotion = chess_move_promotion(move);
+	flags = chess_move_flags(move);
+	them = us ^ 1;
+	piece = board->cboard[from];
+
+	assert(piece != 0);
+	assert(board->occupied[us] & (1ULL << from));
+
+	STATS_INC(MAKE_MOVE);
+
+	if (board->history != NULL)
+		board->history[board->hply & HISTORY_MASK] = board->hash;
+	++board->hply;
+
+	undo->hash = board->hash;
+	undo->epsq = board->epsq;
+	undo->cflag = board->cflag;
+	undo->rhmc = board->rhmc;
+	undo->captured = (flags & CHESS_MOVE_FLAG_ENPASSANT) ? CHESS_PIECE_PAWN : board->cboard[to];
+
+	if (board->epsq >= 0) {
+		board->hash ^= zobrist_enpassant[chess_file(board->epsq)];
+		board->epsq = -1;
+	}
+
+	if (flags & CHESS_MOVE_FLAG_CASTLE) {
+		int rfrom, rto;
+
+		board_castle_rook(board, to, &rfrom, &rto);
+		board_remove(board, from, CHESS_PIECE_KING, us);
+		board_remove(board, rfrom, CHESS_PIECE_ROOK, us);
+		board_put(board, to, CHESS_PIECE_KING, us);
+		board_put(board, rto, CHESS_PIECE_ROOK, us);
+	}
+	else {
+		if (flags & CHESS_MOVE_FLAG_ENPASSANT)
+			board_remove(board, (us == CHESS_SIDE_WHITE) ? to - 8 : to + 8, CHESS_PIECE_PAWN, them);
+		else if (undo->captured)
+			board_remove(board, to, undo->captured, them);
+		board_remove(board, from, piece, us);
+		board_put(board, to, promotion ? promotion : piece, us);
+
+		/* Only record en passant squares that can be used */
+		if (piece == CHESS_PIECE_PAWN && (from ^ to) == 16
+				&& (PAWN_ATTACKS[us][(from + to) / 2] & PIECES(board, them, CHESS_PIECE_PAWN))) {
+			board->epsq = (from + to) / 2;
+			board->hash ^= zobrist_enpassant[chess_file(board->epsq)];
+		}
+	}
+
+	if (piece == CHESS_PIECE_PAWN || undo->captured)
+		board->rhmc = 0;
+	else if (board->rhmc < CHESS_RHMC_MAX)
+		++board->rhmc;
+
+	if (board->cflag) {
+		int keep = board_castle_keep(board, from) & board_castle_keep(board, to);
+
+		if (board->cflag & ~keep) {
+			board->hash ^= zobrist_castle[board->cflag & 15];
+			board->cflag &= keep;
+			board->hash ^= zobrist_castle[board->cflag & 15];
+		}
+	}
+
+	if (us == CHESS_SIDE_BLACK)
+		++board->fmc;
+	board->side = them;
+	board->hash ^= zobrist_side;
+}
+
+void
+chess_board_make_move(struct chess_board *board, unsigned move, struct chess_undo *undo)
+{
+	if (board->side == CHESS_SIDE_WHITE)
+		board_make_move_side(board, move, undo, CHESS_SIDE_WHITE);
+	else
+		board_make_move_side(board, move, undo, CHESS_SIDE_BLACK);
+}
+
+SPECIALIZED void
+board_unmake_move_side(struct chess_board *board, unsigned move, const struct chess_undo *undo, int us)
+{
+	int from, to, flags, them, piece;
+
+	from = chess_move_from(move);
+	to = chess_move_to(move);
+	flags = chess_move_flags(move);
+	them = us ^ 1;
+
+	if (flags & CHESS_MOVE_FLAG_CASTLE) {
+		int rfrom, rto;
+
+		board_castle_rook(board, to, &rfrom, &rto);
+		board_remove(board, to, CHESS_PIECE_KING, us);
+		board_remove(board, rto, CHESS_PIECE_ROOK, us);
+		board_put(board, from, CHESS_PIECE_KING, us);
+		board_put(board, rfrom, CHESS_PIECE_ROOK, us);
+	}
+	else {
+		piece = board->cboard[to];
+		board_remove(board, to, piece, us);
+		board_put(board, from, chess_move_promotion(move) ? CHESS_PIECE_PAWN : piece, us);
+		if (flags & CHESS_MOVE_FLAG_ENPASSANT)
+			board_put(board, (us == CHESS_SIDE_WHITE) ? to - 8 : to + 8, CHESS_PIECE_PAWN, them);
+		else if (undo->captured)
+			board_put(board, to, undo->captured, them);
+	}
+
+	if (us == CHESS_SIDE_BLACK)
+		--board->fmc;
+	board->side = us;
+	board->epsq = undo->epsq;
+	board->cflag = undo->cflag;
+	board->rhmc = undo->rhmc;
+	board->hash = undo->hash;
+	--board->hply;
+}
+
+void
+chess_board_unmake_move(struct chess_board *board, unsigned move, const struct chess_undo *undo)
+{
+	/* The side to move is the opponent of the side that made the move */
+	if (board->side == CHESS_SIDE_BLACK)
+		board_unmake_move_side(board, move, undo, CHESS_SIDE_WHITE);
+	else
+		board_unmake_move_side(board, move, undo, CHESS_SIDE_BLACK);
+}
+
+unsigned
+chess_board_parse_move(const struct chess_board *board, const char *str)
+{
+	unsigned n;
+	int from, to, promotion;
+	bool castle;
+	unsigned moves[CHESS_MOVES_MAX];
+
+	if (strlen(str) < 4
+			|| str[0] < 'a' || str[0] > 'h' || str[1] < '1' || str[1] > '8'
+			|| str[2] < 'a' || str[2] > 'h' || str[3] < '1' || str[3] > '8')
+		return CHESS_MOVE_NONE;
+
+	from = chess_square(str[1] - '1', str[0] - 'a');
+	to = chess_square(str[3] - '1', str[2] - 'a');
+	switch (str[4]) {
+	case 'q':
+		promotion = CHESS_PIECE_QUEEN;
+		break;
+	case 'r':
+		promotion = CHESS_PIECE_ROOK;
+		break;
+	case 'b':
+		promotion = CHESS_PIECE_BISHOP;
+		break;
+	case 'n':
+		promotion = CHESS_PIECE_KNIGHT;
+		break;
+	default:
+		promotion = 0;
+		break;
+	}
+
+	/* Chess960 castling is written as the king taking its own rook */
+	castle = board->cboard[from] == CHESS_PIECE_KING
+		&& (PIECES(board, board->side, CHESS_PIECE_ROOK) & (1ULL << to));
+	if (castle)
+		to = (from & 56) + ((to > from) ? 6 : 2);
+
+	n = chess_board_generate_moves(board, moves);
+	for (unsigned i = 0; i < n; i++) {
+		if (chess_move_from(moves[i]) == from
+				&& chess_move_to(moves[i]) == to
+				&& chess_move_promotion(moves[i]) == promotion
+				&& (!castle || (chess_move_flags(moves[i]) & CHESS_MOVE_FLAG_CASTLE)))
+			return moves[i];
+	}
+	return CHESS_MOVE_NONE;
+}
+
+static int
+san_piece(char c)
+{
+	switch (c) {
+	case 'N':
+		return CHESS_PIECE_KNIGHT;
+	case 'B':
+		return CHESS_PIECE_BISHOP;
+	case 'R':
+		return CHESS_PIECE_ROOK;
+	case 'Q':
+		return CHESS_PIECE_QUEEN;
+	case 'K':
+		return CHESS_PIECE_KING;
+	default:
+		return 0;
+	}
+}
+
+unsigned
+chess_board_parse_san(const struct chess_board *board, const char *san)
+{
+	int piece, promotion, to, from_file, from_rank;
+	unsigned n, found;
+	size_t len;
+	char buf[16];
+	unsigned moves[CHESS_MOVES_MAX];
+
+	/* Strip check, mate and annotation suffixes */
+	len = strlen(san);
+	while (len > 0 && strchr("+#!?", san[len - 1]) != NULL)
+		--len;
+	if (len < 2 || len >= sizeof(buf))
+		return CHESS_MOVE_NONE;
+	memcpy(buf, san, len);
+	buf[len] = '\0';
+
+	n = chess_board_generate_moves(board, moves);
+
+	if (strcmp(buf, "O-O") == 0 || strcmp(buf, "0-0") == 0
+			|| strcmp(buf, "O-O-O") == 0 || strcmp(buf, "0-0-0") == 0) {
+		bool kingside = (len == 3);
+
+		for (unsigned i = 0; i < n; i++) {
+			if ((chess_move_flags(moves[i]) & CHESS_MOVE_FLAG_CASTLE)
+					&& ((chess_file(chess_move_to(moves[i])) == 6) == kingside))
+				return moves[i];
+		}
+		return CHESS_MOVE_NONE;
+	}
+
+	/* Promotion suffix: =Q or Q */
+	promotion = 0;
+	if (len > 2 && san_piece(buf[len - 1]) && san_piece(buf[len - 1]) != CHESS_PIECE_KING) {
+		promotion = san_piece(buf[len - 1]);
+		buf[--len] = '\0';
+		if (buf[len - 1] == '=')
+			buf[--len] = '\0';
+	}
+
+	/* Target square */
+	if (len < 2 || buf[len - 2] < 'a' || buf[len - 2] > 'h' || buf[len - 1] < '1' || buf[len - 1] > '8')
+		return CHESS_MOVE_NONE;
+	to = chess_square(buf[len - 1] - '1', buf[len - 2] - 'a');
+	len -= 2;
+
+	/* Piece and disambiguation */
+	piece = CHESS_PIECE_PAWN;
+	from_file = from_rank = -1;
+	for (size_t i = 0; i < len; i++) {
+		if (i == 0 && san_piece(buf[i]))
+			piece = san_piece(buf[i]);
+		else if (buf[i] >= 'a' && buf[i] <= 'h')
+			from_file = buf[i] - 'a';
+		else if (buf[i] >= '1' && buf[i] <= '8')
+			from_rank = buf[i] - '1';
+		else if (buf[i] != 'x' && buf[i] != '-')
+			return CHESS_MOVE_NONE;
+	}
+
+	found = CHESS_MOVE_NONE;
+	for (unsigned i = 0; i < n; i++) {
+		int from = chess_move_from(moves[i]);
+
+		if (chess_move_to(moves[i]) != to
+				|| chess_move_promotion(moves[i]) != promotion
+				|| board->cboard[from] != piece
+				|| (chess_move_flags(moves[i]) & CHESS_MOVE_FLAG_CASTLE)
+				|| (from_file >= 0 && chess_file(from) != from_file)
+				|| (from_rank >= 0 && chess_rank(from) != from_rank))
+			continue;
+		if (found != CHESS_MOVE_NONE)
+			return CHESS_MOVE_NONE; /* ambiguous */
+		found = moves[i];
+	}
+	return found;
+}
+
+unsigned long long
+chess_board_perft(struct chess_board *board, unsigned depth)
+{
+	unsigned n;
+	unsigned long long nodes;
+	struct chess_undo undo;
+	unsigned moves[CHESS_MOVES_MAX];
+
+	/* The leaves only need to be counted */
+	if (depth <= 1)
+		return (depth == 1) ? chess_board_count_moves(board) : 1;
+
+	n = chess_board_generate_moves(board, moves);
+	nodes = 0;
+	for (unsigned i = 0; i < n; i++) {
+		chess_board_make_move(board, moves[i], &undo);
+		nodes += chess_board_perft(board, depth - 1);
+		chess_board_unmake_move(board, moves[i], &undo);
+	}
+	return nodes;
+}
+
+unsigned
+chess_board_get_repetitions(const struct chess_board *board)
+{
+	unsigned n, count;
+
+	if (board->history == NULL)
+		return 0;
+
+	/* Only positions since the last irreversible move can repeat, and a
+	 * position can first repeat four plies later with the same side to move.
+	 */
+	n = board->rhmc;
+	if (n > board->hply)
+		n = board->hply;
+	if (n > HISTORY_MASK)
+		n = HISTORY_MASK;
+
+	count = 0;
+	for (unsigned i = 4; i <= n; i += 2) {
+		if (board->history[(board->hply - i) & HISTORY_MASK] == board->hash)
+			++count;
+	}
+	return count;
+}
+
+bool
+chess_board_is_repetition(const struct chess_board *board)
+{
+	unsigned n;
+
+	if (board->history == NULL)
+		return false;
+
+	n = board->rhmc;
+	if (n > board->hply)
+		n = board->hply;
+	if (n > HISTORY_MASK)
+		n = HISTORY_MASK;
+
+	for (unsigned i = 4; i <= n; i += 2) {
+		if (board->history[(board->hply - i) & HISTORY_MASK] == board->hash)
+			return true;
+	}
+	return false;
+}
+
+bool
+chess_board_is_threefold_repetition(const struct chess_board *board)
+{
+	return chess_board_get_repetitions(board) >= 2;
+}
+
+bool
+chess_board_is_fifty_moves(const struct chess_board *board)
+{
+	if (board->rhmc < 100)
+		return false;
+
+	/* Checkmate on the hundredth half move takes precedence */
+	return !chess_board_in_check(board) || chess_board_count_moves(board) > 0;
+}
+
+bool
+chess_board_is_insufficient_material(const struct chess_board *board)
+{
+	unsigned long long minors, bishops;
+
+	if (PIECES(board, 0, CHESS_PIECE_PAWN) | PIECES(board, 1, CHESS_PIECE_PAWN)
+			| PIECES(board, 0, CHESS_PIECE_ROOK) | PIECES(board, 1, CHESS_PIECE_ROOK)
+			| PIECES(board, 0, CHESS_PIECE_QUEEN) | PIECES(board, 1, CHESS_PIECE_QUEEN))
+		return false;
+
+	/* King against king and a minor piece */
+	minors = PIECES(board, 0, CHESS_PIECE_KNIGHT) | PIECES(board, 1, CHESS_PIECE_KNIGHT)
+		| PIECES(board, 0, CHESS_PIECE_BISHOP) | PIECES(board, 1, CHESS_PIECE_BISHOP);
+	if (!bb_several(minors))
+		return true;
+
+	/* Only bishops, all on squares of the same colour */
+	bishops = PIECES(board, 0, CHESS_PIECE_BISHOP) | PIECES(board, 1, CHESS_PIECE_BISHOP);
+	return minors == bishops
+		&& (!(bishops & DARK_SQUARES) || !(bishops & ~DARK_SQUARES));
+}
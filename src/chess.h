@@ -93,6 +93,105 @@
  **/
 #define CHESS_CASTLE_BLACK (CHESS_CASTLE_KINGSIDE_BLACK | CHESS_CASTLE_QUEENSIDE_BLACK)
 
+/**
+ * This result is used to represent a game won by white.
+ **/
+#define CHESS_RESULT_WHITE_WINS 0
+/**
+ * This result is used to represent a drawn game.
+ **/
+#define CHESS_RESULT_DRAW 1
+/**
+ * This result is used to represent a game won by black.
+ **/
+#define CHESS_RESULT_BLACK_WINS 2
+/**
+ * This result is used to represent an unknown or unfinished game.
+ **/
+#define CHESS_RESULT_UNKNOWN 3
+
+/**
+ * Forsyth–Edwards Notation of the standard starting position.
+ **/
+#define CHESS_FEN_STARTPOS "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+/**
+ * Upper bound of the number of legal moves in any chess position.
+ * Move arrays passed to chess_board_generate_moves() must be at least this
+ * long.
+ **/
+#define CHESS_MOVES_MAX 256
+
+/**
+ * Largest reversible half move counter the board holds, larger counts
+ * saturate to it. They make no difference to the fifty-move rule.
+ **/
+#define CHESS_RHMC_MAX 65535
+
+/**
+ * This move is used to represent no move.
+ **/
+#define CHESS_MOVE_NONE 0
+
+/**
+ * This move flag is used to represent an en passant capture.
+ **/
+#define CHESS_MOVE_FLAG_ENPASSANT 0x0001
+
+/**
+ * This move flag is used to represent castling.
+ * The move's source and target squares are those of the king, the target
+ * being on the g or c file also in Chess960.
+ **/
+#define CHESS_MOVE_FLAG_CASTLE 0x0002
+
+/**
+ * This structure holds the state needed to take back a move.
+ * It is filled by chess_board_make_move() and consumed by
+ * chess_board_unmake_move().
+ **/
+struct chess_undo {
+	unsigned long long hash;	/**< Hash key before the move */
+	int captured;			/**< Captured piece or 0 */
+	int epsq;			/**< En passant square before the move */
+	int cflag;			/**< Castling flags before the move */
+	unsigned rhmc;			/**< Reversible half move counter before the move */
+};
+
+/**
+ * Move picker flag to order captures by most valuable victim, least valuable
+ * attacker.
+ **/
+#define CHESS_PICKER_MVV_LVA 0x0001
+
+/**
+ * Move picker flag to stop after the captures and queen promotions, as in a
+ * quiescence search.
+ **/
+#define CHESS_PICKER_TACTICAL 0x0002
+
+/**
+ * This structure holds the state of a move picker, which yields the legal
+ * moves of a position in stages: the hash move, captures and queen
+ * promotions, killer moves, then all other moves. Each stage is generated
+ * only when the previous one is exhausted.
+ * Initialize it with chess_picker_init(), the fields are private but for
+ * history.
+ **/
+struct chess_picker {
+	unsigned moves[CHESS_MOVES_MAX];
+	int scores[CHESS_MOVES_MAX];
+	unsigned n, next;
+	int stage;
+	int flags;
+	unsigned hashmove;
+	unsigned killers[2];
+	/** Scores of quiet moves indexed by source and target square, quiet
+	 * moves are yielded in generation order if NULL, the default.
+	 **/
+	const int (*history)[64];
+};
+
 /**
  * Switches the side from white to black or vice versa.
  * \param side Side, either CHESS_WHITE or CHESS_BLACK
@@ -172,6 +271,72 @@ chess_square_index(const char *square);
 const char *
 chess_square_name(int square);
 
+/**
+ * Returns the number of squares of the bitboard.
+ * Bitboards have bit sq set for square sq, a1 is 0 and h8 is 63.
+ **/
+int
+chess_bb_count(unsigned long long b);
+
+/**
+ * Returns the lowest square of the bitboard, which must not be empty.
+ **/
+int
+chess_bb_lsb(unsigned long long b);
+
+/**
+ * Returns the highest square of the bitboard, which must not be empty.
+ **/
+int
+chess_bb_msb(unsigned long long b);
+
+/**
+ * Removes the lowest square of the bitboard, which must not be empty, and
+ * returns it. Loops over the squares of a bitboard read:
+ * while (b) { sq = chess_bb_pop(&b); ... }
+ **/
+int
+chess_bb_pop(unsigned long long *b);
+
+/**
+ * Returns the squares attacked by a pawn of the given side on the square.
+ **/
+unsigned long long
+chess_pawn_attacks(int side, int square);
+
+/**
+ * Returns the squares attacked by a knight on the square.
+ **/
+unsigned long long
+chess_knight_attacks(int square);
+
+/**
+ * Returns the squares attacked by a bishop on the square, the attacks stop at
+ * the first occupied square of each direction.
+ **/
+unsigned long long
+chess_bishop_attacks(int square, unsigned long long occupied);
+
+/**
+ * Returns the squares attacked by a rook on the square, the attacks stop at
+ * the first occupied square of each direction.
+ **/
+unsigned long long
+chess_rook_attacks(int square, unsigned long long occupied);
+
+/**
+ * Returns the squares attacked by a queen on the square, the attacks stop at
+ * the first occupied square of each direction.
+ **/
+unsigned long long
+chess_queen_attacks(int square, unsigned long long occupied);
+
+/**
+ * Returns the squares attacked by a king on the square.
+ **/
+unsigned long long
+chess_king_attacks(int square);
+
 /**
  * Returns the character representation of the piece.
  **/
@@ -190,6 +355,13 @@ struct chess_board;
 struct chess_board *
 chess_board_init(void);
 
+/**
+ * Copies the position and its history, for repetition detection, to another
+ * board.
+ **/
+void
+chess_board_copy(struct chess_board *dst, const struct chess_board *src);
+
 /**
  * Returns the side to move.
  **/
@@ -279,6 +451,7 @@ chess_board_get_rhmc(const struct chess_board *board);
 /**
  * Sets the reversible half move counter.
  * Used to determine if a draw can be claimed under the fifty-move rule.
+ * Counts above CHESS_RHMC_MAX are stored as CHESS_RHMC_MAX.
  **/
 void
 chess_board_set_rhmc(struct chess_board *board, unsigned count);
@@ -322,8 +495,22 @@ chess_board_clear_piece(struct chess_board *board, int square, int piece, int si
 bool
 chess_board_has_piece(const struct chess_board *board, int square, int side);
 
+/**
+ * Returns the bitboard of the pieces of the given side and type.
+ **/
+unsigned long long
+chess_board_get_pieces(const struct chess_board *board, int side, int piece);
+
+/**
+ * Returns the bitboard of the squares occupied by the given side.
+ **/
+unsigned long long
+chess_board_get_occupied(const struct chess_board *board, int side);
+
 /**
  * Returns the Forsyth–Edwards Notation of the current position.
+ * Castling rights are written in X-FEN: KQkq unless there is another rook
+ * outside of the castling rook, in which case the rook's file is used.
  * Returns NULL if there wasn't enough room to hold the notation.
  * \param fen String to hold the FEN notation
  * \param len Length of the string
@@ -331,4 +518,237 @@ chess_board_has_piece(const struct chess_board *board, int square, int side);
 char *
 chess_board_get_fen(struct chess_board *board, char *fen, size_t len);
 
+/**
+ * Returns the Shredder-FEN of the current position, where castling rights are
+ * always written as the files of the castling rooks (HAha).
+ * Returns NULL if there wasn't enough room to hold the notation.
+ * \param fen String to hold the FEN notation
+ * \param len Length of the string
+ **/
+char *
+chess_board_get_shredder_fen(const struct chess_board *board, char *fen, size_t len);
+
+/**
+ * Sets up the position described by the given Forsyth–Edwards Notation.
+ * Castling rights may be given in X-FEN or Shredder-FEN for Chess960, the
+ * initial king and rook squares are set accordingly. The move counters may be
+ * omitted.
+ * Returns true on success, false if the notation is invalid in which case the
+ * board is left empty.
+ **/
+bool
+chess_board_set_fen(struct chess_board *board, const char *fen);
+
+/**
+ * Returns the Zobrist hash key of the current position.
+ * The key is maintained incrementally by the functions modifying the board.
+ **/
+unsigned long long
+chess_board_get_hash(const struct chess_board *board);
+
+/**
+ * Flips the board vertically and swaps the colours of the pieces, the side to
+ * move and the castling rights. The result is the same position seen from the
+ * other side of the board.
+ * The position history is forgotten as if the position was set anew.
+ **/
+void
+chess_board_flip(struct chess_board *board);
+
+/**
+ * Mirrors the board horizontally, the a-file becomes the h-file.
+ * The position history is forgotten as if the position was set anew.
+ * Returns false and leaves the board unchanged if there are castling rights,
+ * which do not survive mirroring.
+ **/
+bool
+chess_board_mirror(struct chess_board *board);
+
+/**
+ * Returns the smallest hash key of the position and its flipped and, without
+ * castling rights, mirrored forms. Positions equal under these symmetries
+ * share the same key, which is the key chess_board_get_hash() returns for one
+ * of them.
+ **/
+unsigned long long
+chess_board_get_canonical_hash(const struct chess_board *board);
+
+/**
+ * Returns true if the given square is attacked by the given side.
+ **/
+bool
+chess_board_is_attacked(const struct chess_board *board, int square, int side);
+
+/**
+ * Returns true if the side to move is in check.
+ **/
+bool
+chess_board_in_check(const struct chess_board *board);
+
+/**
+ * Returns a move from the given squares.
+ * \param promotion Piece to promote to or 0.
+ * \param flags Move flags, a combination of CHESS_MOVE_FLAG_*.
+ **/
+unsigned
+chess_move(int from, int to, int promotion, int flags);
+
+/**
+ * Returns the source square of the move.
+ **/
+int
+chess_move_from(unsigned move);
+
+/**
+ * Returns the target square of the move.
+ **/
+int
+chess_move_to(unsigned move);
+
+/**
+ * Returns the piece the move promotes to or 0.
+ **/
+int
+chess_move_promotion(unsigned move);
+
+/**
+ * Returns the flags of the move.
+ **/
+int
+chess_move_flags(unsigned move);
+
+/**
+ * Returns the coordinate notation (e2e4, e7e8q) of the move as used by UCI.
+ * Returns NULL if there wasn't enough room to hold the notation.
+ * \param str String to hold the notation
+ * \param len Length of the string
+ **/
+char *
+chess_move_get_string(unsigned move, char *str, size_t len);
+
+/**
+ * Generates the legal moves in the current position.
+ * Returns the number of moves.
+ * \param moves Array of at least CHESS_MOVES_MAX elements
+ **/
+unsigned
+chess_board_generate_moves(const struct chess_board *board, unsigned *moves);
+
+/**
+ * Returns the number of legal moves in the current position.
+ * Faster than chess_board_generate_moves() as no move list is written.
+ **/
+unsigned
+chess_board_count_moves(const struct chess_board *board);
+
+/**
+ * Returns true if the legal move gives check, without making it.
+ **/
+bool
+chess_board_gives_check(const struct chess_board *board, unsigned move);
+
+/**
+ * Generates the legal moves giving check in the current position.
+ * Returns the number of moves.
+ * \param moves Array of at least CHESS_MOVES_MAX elements
+ **/
+unsigned
+chess_board_generate_checks(const struct chess_board *board, unsigned *moves);
+
+/**
+ * Checks whether the move is legal in the current position, without
+ * generating moves. Useful to check moves coming from elsewhere, like a hash
+ * table or another position.
+ **/
+bool
+chess_board_is_legal_move(const struct chess_board *board, unsigned move);
+
+/**
+ * Initializes a move picker.
+ * The hash and killer moves need not be legal, they are skipped if they are
+ * not, and may be CHESS_MOVE_NONE.
+ * \param flags Bitwise or of CHESS_PICKER_* flags
+ **/
+void
+chess_picker_init(struct chess_picker *picker, unsigned hashmove, unsigned killer0, unsigned killer1, int flags);
+
+/**
+ * Returns the next legal move or CHESS_MOVE_NONE when there are no more.
+ * The board must be in the same position for all calls.
+ **/
+unsigned
+chess_picker_next(struct chess_picker *picker, const struct chess_board *board);
+
+/**
+ * Makes the given legal move on the board.
+ * \param undo Structure to save the state needed by chess_board_unmake_move()
+ **/
+void
+chess_board_make_move(struct chess_board *board, unsigned move, struct chess_undo *undo);
+
+/**
+ * Takes back the given move made by chess_board_make_move().
+ **/
+void
+chess_board_unmake_move(struct chess_board *board, unsigned move, const struct chess_undo *undo);
+
+/**
+ * Parses a move in coordinate notation (e2e4, e7e8q).
+ * Castling may also be written as the king taking its own rook (e1h1), as is
+ * done for Chess960.
+ * Returns the legal move or CHESS_MOVE_NONE if the move is invalid.
+ **/
+unsigned
+chess_board_parse_move(const struct chess_board *board, const char *str);
+
+/**
+ * Parses a move in Standard Algebraic Notation (e4, Nbd7, exd8=Q+, O-O).
+ * Returns the legal move or CHESS_MOVE_NONE if the move is invalid or
+ * ambiguous.
+ **/
+unsigned
+chess_board_parse_san(const struct chess_board *board, const char *san);
+
+/**
+ * Counts the leaf nodes of the legal move tree of the given depth.
+ **/
+unsigned long long
+chess_board_perft(struct chess_board *board, unsigned depth);
+
+/**
+ * Returns how many times the current position occurred before.
+ * Positions are recorded by chess_board_make_move() and forgotten when the
+ * board is set from FEN, only positions since the last capture or pawn move
+ * are looked at.
+ **/
+unsigned
+chess_board_get_repetitions(const struct chess_board *board);
+
+/**
+ * Returns true if the current position occurred before.
+ * This is the check used by search, where a single repetition is a draw.
+ **/
+bool
+chess_board_is_repetition(const struct chess_board *board);
+
+/**
+ * Returns true if the current position occurred at least three times.
+ **/
+bool
+chess_board_is_threefold_repetition(const struct chess_board *board);
+
+/**
+ * Returns true if a draw can be claimed by the fifty move rule.
+ **/
+bool
+chess_board_is_fifty_moves(const struct chess_board *board);
+
+/**
+ * Returns true if neither side has enough material to checkmate: king against
+ * king and at most one minor piece, or kings and bishops all on squares of the
+ * same colour.
+ **/
+bool
+chess_board_is_insufficient_material(const struct chess_board *board);
+
 #endif /* !LIBCHESS_GUARD_CHESS_H */
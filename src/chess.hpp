@@ -0,0 +1,169 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_HPP
+#define LIBCHESS_GUARD_CHESS_HPP 1
+
+#include <cstddef>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+
+extern "C" {
+#include "chess.h"
+#include "chess_inline.h"
+}
+
+/**
+ * \file
+ * C++ interface
+ *
+ * The chess namespace wraps the inline fast paths of chess_inline.h for C++11
+ * programs, adds ranges over the squares of bitboards and owning pointers for
+ * boards. The rest of the C interface is used as is.
+ **/
+
+namespace chess {
+
+/** Returns the rank of the square, see chess_rank() **/
+inline int
+rank(int square)
+{
+	return chess_inline_rank(square);
+}
+
+/** Returns the file of the square, see chess_file() **/
+inline int
+file(int square)
+{
+	return chess_inline_file(square);
+}
+
+/** Returns the square on the given rank and file, see chess_square() **/
+inline int
+square(int rank, int file)
+{
+	return chess_inline_square(rank, file);
+}
+
+/** Returns the other side, see chess_switch_side() **/
+inline int
+switch_side(int side)
+{
+	return chess_inline_switch_side(side);
+}
+
+/** Returns the source square of the move, see chess_move_from() **/
+inline int
+move_from(unsigned move)
+{
+	return chess_inline_move_from(move);
+}
+
+/** Returns the target square of the move, see chess_move_to() **/
+inline int
+move_to(unsigned move)
+{
+	return chess_inline_move_to(move);
+}
+
+/** Returns the promotion piece of the move, see chess_move_promotion() **/
+inline int
+move_promotion(unsigned move)
+{
+	return chess_inline_move_promotion(move);
+}
+
+/** Returns the number of squares of the bitboard **/
+inline int
+popcount(unsigned long long b)
+{
+	return chess_inline_bb_count(b);
+}
+
+/** Returns the lowest square of the bitboard, which must not be empty **/
+inline int
+lsb(unsigned long long b)
+{
+	return chess_inline_bb_lsb(b);
+}
+
+/** Removes and returns the lowest square of the bitboard, which must not be empty **/
+inline int
+pop_lsb(unsigned long long &b)
+{
+	return chess_inline_bb_pop(&b);
+}
+
+/**
+ * Range over the squares of a bitboard, lowest first:
+ * for (int sq : chess::squares(b)) ...
+ **/
+class squares {
+public:
+	class iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef int value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const int *pointer;
+		typedef int reference;
+
+		explicit iterator(unsigned long long b) : b_(b) {}
+		int operator*() const { return chess_inline_bb_lsb(b_); }
+		iterator &operator++() { b_ &= b_ - 1; return *this; }
+		iterator operator++(int) { iterator it(*this); ++*this; return it; }
+		bool operator==(const iterator &other) const { return b_ == other.b_; }
+		bool operator!=(const iterator &other) const { return b_ != other.b_; }
+	private:
+		unsigned long long b_;
+	};
+
+	explicit squares(unsigned long long b) : b_(b) {}
+	iterator begin() const { return iterator(b_); }
+	iterator end() const { return iterator(0); }
+	int size() const { return chess_inline_bb_count(b_); }
+	bool empty() const { return b_ == 0; }
+
+private:
+	unsigned long long b_;
+};
+
+/** Frees boards allocated by chess_board_init() **/
+struct board_deleter {
+	void operator()(struct chess_board *board) const { std::free(board); }
+};
+
+/** Owning pointer to a board **/
+typedef std::unique_ptr<struct chess_board, board_deleter> board_ptr;
+
+/**
+ * Allocates an empty board, see chess_board_init().
+ * Returns a null pointer on failure and sets errno accordingly.
+ **/
+inline board_ptr
+make_board()
+{
+	return board_ptr(chess_board_init());
+}
+
+} /* namespace chess */
+
+#endif /* !LIBCHESS_GUARD_CHESS_HPP */
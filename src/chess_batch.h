@@ -0,0 +1,113 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_BATCH_H
+#define LIBCHESS_GUARD_CHESS_BATCH_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chess.h"
+
+/**
+ * \file
+ * Attack generation over batches of boards
+ *
+ * A batch holds the piece bitboards of many independent positions in a
+ * structure of arrays layout: one array per side and piece, with one bitboard
+ * per board. Attacks are computed for several boards at once with
+ * Kogge-Stone fills in vector registers.
+ **/
+
+/**
+ * Portable scalar backend, one board at a time.
+ **/
+#define CHESS_BATCH_SCALAR 0
+/**
+ * AVX2 backend, four boards at a time.
+ **/
+#define CHESS_BATCH_AVX2 1
+/**
+ * AVX-512 backend, eight boards at a time.
+ **/
+#define CHESS_BATCH_AVX512 2
+
+/**
+ * This opaque structure represents a batch of boards.
+ **/
+struct chess_batch;
+
+/**
+ * Initializes and returns a batch of the given number of empty boards.
+ * Returns NULL on failure and sets errno accordingly.
+ **/
+struct chess_batch *
+chess_batch_init(size_t n);
+
+/**
+ * Frees the batch.
+ **/
+void
+chess_batch_free(struct chess_batch *batch);
+
+/**
+ * Returns the number of boards in the batch.
+ **/
+size_t
+chess_batch_get_size(const struct chess_batch *batch);
+
+/**
+ * Copies the pieces of the board into the batch at the given index.
+ **/
+void
+chess_batch_set_board(struct chess_batch *batch, size_t index, const struct chess_board *board);
+
+/**
+ * Returns the array of bitboards of the given side and piece, one per board.
+ * The array may be filled directly instead of using chess_batch_set_board().
+ **/
+unsigned long long *
+chess_batch_get_pieces(struct chess_batch *batch, int side, int piece);
+
+/**
+ * Computes the squares attacked by the given side on every board.
+ * \param attacks Array to hold the attacked squares of each board
+ * \param mobility Array to hold the number of attacked squares not occupied
+ * by the side's own pieces on each board, may be NULL
+ **/
+void
+chess_batch_attacks(const struct chess_batch *batch, int side,
+		unsigned long long *attacks, unsigned *mobility);
+
+/**
+ * Returns the backend used by chess_batch_attacks(), one of CHESS_BATCH_*.
+ * By default the widest backend the CPU supports is used.
+ **/
+int
+chess_batch_get_backend(void);
+
+/**
+ * Selects the backend used by chess_batch_attacks().
+ * Returns false if the CPU does not support the backend.
+ **/
+bool
+chess_batch_set_backend(int backend);
+
+#endif /* !LIBCHESS_GUARD_CHESS_BATCH_H */
@@ -0,0 +1,135 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_EVAL_H
+#define LIBCHESS_GUARD_CHESS_EVAL_H 1
+
+#include <stddef.h>
+
+#include "chess.h"
+
+/**
+ * \file
+ * Static evaluation
+ **/
+
+/**
+ * Game phase of a position with all minor and major pieces on the board.
+ * The phase decreases towards 0 as pieces are exchanged and the evaluation
+ * is interpolated between its middle game and end game terms accordingly.
+ **/
+#define CHESS_EVAL_PHASE_MAX 24
+
+/**
+ * Number of evaluation parameters.
+ * The parameters are the material value of every piece and the piece-square
+ * tables, for the middle game and for the end game, from white's point of
+ * view. Black's values are mirrored.
+ **/
+#define CHESS_EVAL_PARAMS (2 * 6 + 2 * 6 * 64)
+
+/**
+ * Index of the material value of the piece among the parameters.
+ * \param phase 0 for the middle game, 1 for the end game
+ **/
+#define CHESS_EVAL_MATERIAL(phase, piece) ((phase) * 6 + (piece) - CHESS_PIECE_PAWN)
+
+/**
+ * Index of the piece-square value of the piece on the square among the
+ * parameters.
+ * \param phase 0 for the middle game, 1 for the end game
+ **/
+#define CHESS_EVAL_PST(phase, piece, square) \
+	(2 * 6 + ((phase) * 6 + (piece) - CHESS_PIECE_PAWN) * 64 + (square))
+
+/**
+ * Score of an invalid position in the result of chess_evaluate_batch_fen().
+ **/
+#define CHESS_EVAL_INVALID (-0x7fffffff - 1)
+
+/**
+ * Statically evaluates the position.
+ * The evaluation consists of material and piece-square terms, tapered by the
+ * game phase.
+ * Returns the score in centipawns from the point of view of the side to move.
+ **/
+int
+chess_evaluate(const struct chess_board *board);
+
+/**
+ * Returns the game phase of the position, between 0 and CHESS_EVAL_PHASE_MAX.
+ **/
+int
+chess_evaluate_phase(const struct chess_board *board);
+
+/**
+ * Copies the evaluation parameters.
+ * \param params Array of CHESS_EVAL_PARAMS elements
+ **/
+void
+chess_eval_get_params(int *params);
+
+/**
+ * Sets the evaluation parameters of all boards.
+ * Must not be called while positions are evaluated.
+ * \param params Array of CHESS_EVAL_PARAMS elements
+ **/
+void
+chess_eval_set_params(const int *params);
+
+/**
+ * Writes the evaluation parameters to a text file, e.g. to load tuned
+ * parameters later with chess_eval_load().
+ * Returns 0 on success, -1 on failure and sets errno accordingly.
+ **/
+int
+chess_eval_save(const char *path);
+
+/**
+ * Sets the evaluation parameters from a file written by chess_eval_save().
+ * Text from a # to the end of the line is a comment.
+ * Returns 0 on success, -1 on failure and sets errno accordingly, EINVAL means
+ * the file does not hold CHESS_EVAL_PARAMS integers.
+ * Must not be called while positions are evaluated.
+ **/
+int
+chess_eval_load(const char *path);
+
+/**
+ * Statically evaluates an array of positions with a pool of threads.
+ * The positions are handed out to the threads in blocks that fit in the
+ * cache, so every thread streams through a part of the array.
+ * \param scores Array of n elements to hold the scores
+ * \param nthreads Number of threads, 0 for one per online processor
+ **/
+void
+chess_evaluate_batch(const struct chess_board *const *boards, size_t n, int *scores, unsigned nthreads);
+
+/**
+ * Statically evaluates an array of positions given in Forsyth-Edwards
+ * notation like chess_evaluate_batch(). Invalid positions score
+ * CHESS_EVAL_INVALID.
+ * Returns 0 on success, -1 if no thread could allocate a board and sets errno
+ * accordingly.
+ **/
+int
+chess_evaluate_batch_fen(const char *const *fens, size_t n, int *scores, unsigned nthreads);
+
+#endif /* !LIBCHESS_GUARD_CHESS_EVAL_H */
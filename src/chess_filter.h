@@ -0,0 +1,119 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_FILTER_H
+#define LIBCHESS_GUARD_CHESS_FILTER_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \file
+ * Approximate sets of position hash keys
+ *
+ * The filter is a blocked Bloom filter answering whether a hash key, as
+ * returned by chess_board_get_hash() or chess_board_get_canonical_hash(), was
+ * inserted before. It never misses an inserted key but may claim, with the
+ * false positive rate it is sized for, to hold a key it does not. Each key
+ * sets one bit in each of the eight words of a single cache line, so a lookup
+ * costs one memory access. Filters live in memory or in a file mapped into
+ * memory, which keeps them across runs.
+ *
+ * Filters are not safe to modify from several threads at once.
+ **/
+
+/**
+ * This opaque structure represents a filter.
+ **/
+struct chess_filter;
+
+/**
+ * Initializes and returns an empty filter in memory.
+ * Returns NULL on failure and sets errno accordingly, EINVAL means the false
+ * positive rate is not between 0 and 1.
+ * \param nkeys Number of keys the filter is sized for
+ * \param fpr False positive rate with nkeys keys inserted
+ **/
+struct chess_filter *
+chess_filter_init(uint64_t nkeys, double fpr);
+
+/**
+ * Opens the filter at the given path, creating it with the given size if the
+ * file does not exist. The file is mapped into memory and written back as keys
+ * are inserted. The size of an existing filter is kept.
+ * Returns NULL on failure and sets errno accordingly, EINVAL means the file is
+ * not a valid filter or the false positive rate is not between 0 and 1.
+ * \param nkeys Number of keys a new filter is sized for
+ * \param fpr False positive rate of a new filter with nkeys keys inserted
+ **/
+struct chess_filter *
+chess_filter_open(const char *path, uint64_t nkeys, double fpr);
+
+/**
+ * Writes a filter opened from a file back to the file.
+ * Returns 0 on success, -1 on failure and sets errno accordingly.
+ **/
+int
+chess_filter_sync(struct chess_filter *filter);
+
+/**
+ * Frees the filter, a filter opened from a file is unmapped and the file is
+ * left to the kernel to write back.
+ **/
+void
+chess_filter_free(struct chess_filter *filter);
+
+/**
+ * Returns the size of the filter in bytes.
+ **/
+size_t
+chess_filter_get_size(const struct chess_filter *filter);
+
+/**
+ * Returns the number of inserted keys the filter did not hold before.
+ **/
+uint64_t
+chess_filter_get_count(const struct chess_filter *filter);
+
+/**
+ * Returns true if the key may have been inserted, false if it was not.
+ **/
+bool
+chess_filter_contains(const struct chess_filter *filter, uint64_t key);
+
+/**
+ * Inserts the key.
+ * Returns true if the filter may have held the key before, false otherwise.
+ **/
+bool
+chess_filter_insert(struct chess_filter *filter, uint64_t key);
+
+/**
+ * Inserts the keys in order, prefetching the cache lines of the keys ahead.
+ * Repeated keys within the batch are seen as held after their first insert.
+ * Returns the number of keys the filter did not hold before.
+ * \param held Array of n elements to save the return values of
+ *             chess_filter_insert() for each key in, may be NULL.
+ **/
+size_t
+chess_filter_insert_batch(struct chess_filter *filter, const uint64_t *keys, size_t n, bool *held);
+
+#endif /* !LIBCHESS_GUARD_CHESS_FILTER_H */
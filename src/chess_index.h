@@ -0,0 +1,126 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_INDEX_H
+#define LIBCHESS_GUARD_CHESS_INDEX_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \file
+ * On-disk position index
+ *
+ * The index maps position hash keys, as returned by chess_board_get_hash(), to
+ * the games the position occurred in. It is a single file holding a sorted
+ * array of fixed size entries, the game id array the entries point into and a
+ * sparse array of fence keys, one for every block of entries. The file is
+ * mapped into memory and queried in place.
+ **/
+
+/**
+ * This structure represents an entry of the index.
+ * Entries are stored in this form on disk.
+ **/
+struct chess_index_entry {
+	uint64_t key;		/**< Position hash key */
+	uint32_t count[3];	/**< Games won by white, drawn and won by black */
+	uint32_t ngames;	/**< Number of games, including those with unknown result */
+	uint64_t games;		/**< Offset of the first game id in the game id array */
+};
+
+/**
+ * This opaque structure represents an index opened for reading.
+ **/
+struct chess_index;
+
+/**
+ * This opaque structure represents an index being built.
+ **/
+struct chess_index_builder;
+
+/**
+ * Opens the index at the given path.
+ * Returns NULL on failure and sets errno accordingly, EINVAL means the file is
+ * not a valid index.
+ **/
+struct chess_index *
+chess_index_open(const char *path);
+
+/**
+ * Closes the index.
+ **/
+void
+chess_index_close(struct chess_index *index);
+
+/**
+ * Returns the number of distinct positions in the index.
+ **/
+uint64_t
+chess_index_get_size(const struct chess_index *index);
+
+/**
+ * Looks up the position with the given hash key.
+ * Returns a pointer into the index or NULL if the position is not found.
+ **/
+const struct chess_index_entry *
+chess_index_lookup(const struct chess_index *index, uint64_t key);
+
+/**
+ * Returns the ids of the games of the entry in ascending order.
+ * The array has entry->ngames elements.
+ **/
+const uint32_t *
+chess_index_get_games(const struct chess_index *index, const struct chess_index_entry *entry);
+
+/**
+ * Initializes and returns an index builder writing to the given path.
+ * Positions are sorted in memory in runs which are spilled to temporary files
+ * next to the index and merged when the index is finished.
+ * Returns NULL on failure and sets errno accordingly.
+ * \param memory Memory in bytes to use for sorting
+ * \param nthreads Number of threads to sort each run with
+ **/
+struct chess_index_builder *
+chess_index_builder_init(const char *path, size_t memory, unsigned nthreads);
+
+/**
+ * Adds an occurrence of a position.
+ * Game ids must be added in ascending order.
+ * Returns 0 on success, -1 on failure and sets errno accordingly.
+ * \param result Result of the game, one of CHESS_RESULT_*
+ **/
+int
+chess_index_builder_add(struct chess_index_builder *builder, uint64_t key, uint32_t game, int result);
+
+/**
+ * Frees the builder without writing the index.
+ **/
+void
+chess_index_builder_free(struct chess_index_builder *builder);
+
+/**
+ * Writes the index and frees the builder.
+ * Returns 0 on success, -1 on failure and sets errno accordingly.
+ **/
+int
+chess_index_builder_finish(struct chess_index_builder *builder);
+
+#endif /* !LIBCHESS_GUARD_CHESS_INDEX_H */
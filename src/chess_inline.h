@@ -0,0 +1,372 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_INLINE_H
+#define LIBCHESS_GUARD_CHESS_INLINE_H 1
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chess.h"
+
+/**
+ * \file
+ * Inline fast paths
+ *
+ * This header exposes the board layout and inline versions of the small
+ * accessors and bitboard helpers of chess.h, which otherwise cost a call through the procedure
+ * linkage table of the shared library. Including it turns calls of those
+ * accessors into the inline versions by function-like macros of the same
+ * name; the functions themselves stay exported, so taking their address or
+ * writing the name in parentheses, as in (chess_rank)(square), still calls
+ * the library. Define CHESS_INLINE_NO_MACROS before including to only get the
+ * chess_inline_ prefixed functions.
+ *
+ * The layout is bound to the library version the program is built against.
+ * Boards must still be allocated by chess_board_init() and modified through
+ * the functions of chess.h.
+ **/
+
+/**
+ * This structure represents a board.
+ * The board takes four cache lines: the bitboards, hash key and history used
+ * by move generation and search fill the first two, the mailbox the third and
+ * the narrow state fields the fourth.
+ **/
+struct chess_board {
+	unsigned long long pieces[2][6];	/**< Pieces, indexed by side and piece - CHESS_PIECE_PAWN */
+	unsigned long long occupied[2];		/**< Occupied squares of each side */
+	unsigned long long hash;		/**< Zobrist hash key */
+	unsigned long long *history;		/**< Hash keys of the previous positions or NULL */
+	uint8_t cboard[64];			/**< cboard[sq] gives the piece on square sq. */
+	uint8_t side;				/**< Side to move */
+	int8_t epsq;				/**< En passant square or -1 */
+	uint8_t cflag;				/**< Castling flags */
+	uint8_t isq[3];				/**< Initial squares of white king, king rook, and queen rook */
+	uint16_t rhmc;				/**< Reversible half move counter, saturates at CHESS_RHMC_MAX */
+	uint32_t fmc;				/**< Full move counter */
+	uint32_t hply;				/**< Number of moves made since the position was set */
+} __attribute__((aligned(64)));
+
+/* The bitboard helpers use the compiler's builtins, which become single
+ * instructions on targets that have them, and portable bit tricks otherwise.
+ */
+
+/** Inline version of chess_bb_count() **/
+static inline int
+chess_inline_bb_count(unsigned long long b)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(b);
+#else
+	b = b - ((b >> 1) & 0x5555555555555555ULL);
+	b = (b & 0x3333333333333333ULL) + ((b >> 2) & 0x3333333333333333ULL);
+	b = (b + (b >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (int)((b * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/** Inline version of chess_bb_lsb() **/
+static inline int
+chess_inline_bb_lsb(unsigned long long b)
+{
+	assert(b != 0);
+
+#ifdef __GNUC__
+	return __builtin_ctzll(b);
+#else
+	return chess_inline_bb_count((b & (0 - b)) - 1);
+#endif
+}
+
+/** Inline version of chess_bb_msb() **/
+static inline int
+chess_inline_bb_msb(unsigned long long b)
+{
+	assert(b != 0);
+
+#ifdef __GNUC__
+	return 63 - __builtin_clzll(b);
+#else
+	b |= b >> 1;
+	b |= b >> 2;
+	b |= b >> 4;
+	b |= b >> 8;
+	b |= b >> 16;
+	b |= b >> 32;
+	return chess_inline_bb_count(b) - 1;
+#endif
+}
+
+/** Inline version of chess_bb_pop() **/
+static inline int
+chess_inline_bb_pop(unsigned long long *b)
+{
+	int sq;
+
+	sq = chess_inline_bb_lsb(*b);
+	*b &= *b - 1;
+	return sq;
+}
+
+/** Inline version of chess_switch_side() **/
+static inline int
+chess_inline_switch_side(int side)
+{
+	assert(side >= CHESS_SIDE_WHITE && side <= CHESS_SIDE_BLACK);
+
+	return 1 ^ side;
+}
+
+/** Inline version of chess_rank() **/
+static inline int
+chess_inline_rank(int square)
+{
+	assert(square >= 0 && square <= 63);
+
+	return square >> 3;
+}
+
+/** Inline version of chess_file() **/
+static inline int
+chess_inline_file(int square)
+{
+	assert(square >= 0 && square <= 63);
+
+	return square & 7;
+}
+
+/** Inline version of chess_file_char() **/
+static inline char
+chess_inline_file_char(int square)
+{
+	return (char) chess_inline_file(square) + 97;
+}
+
+/** Inline version of chess_square() **/
+static inline int
+chess_inline_square(int rank, int file)
+{
+	assert(rank >= 0 && rank <= 7);
+	assert(file >= 0 && file <= 7);
+
+	return (rank << 3) + file;
+}
+
+/** Inline version of chess_square_left() **/
+static inline int
+chess_inline_square_left(int square)
+{
+	assert(square >= 0 && square <= 63);
+
+	return (square & 7) != 0 ? square - 1 : -1;
+}
+
+/** Inline version of chess_square_right() **/
+static inline int
+chess_inline_square_right(int square)
+{
+	assert(square >= 0 && square <= 63);
+
+	return (square & 7) != 7 ? square + 1 : -1;
+}
+
+/** Inline version of chess_square_up() **/
+static inline int
+chess_inline_square_up(int square)
+{
+	assert(square >= 0 && square <= 63);
+
+	return square < 55 ? square + 8 : -1;
+}
+
+/** Inline version of chess_square_down() **/
+static inline int
+chess_inline_square_down(int square)
+{
+	assert(square >= 0 && square <= 63);
+
+	return square > 7 ? square - 8 : -1;
+}
+
+/** Inline version of chess_square_border() **/
+static inline bool
+chess_inline_square_border(int square)
+{
+	int file, rank;
+
+	file = chess_inline_file(square);
+	rank = chess_inline_rank(square);
+
+	return ((file == 0) || (file == 7) || (rank == 0) || (rank == 7));
+}
+
+/** Inline version of chess_move_from() **/
+static inline int
+chess_inline_move_from(unsigned move)
+{
+	return move & 63;
+}
+
+/** Inline version of chess_move_to() **/
+static inline int
+chess_inline_move_to(unsigned move)
+{
+	return (move >> 6) & 63;
+}
+
+/** Inline version of chess_move_promotion() **/
+static inline int
+chess_inline_move_promotion(unsigned move)
+{
+	return (move >> 12) & 7;
+}
+
+/** Inline version of chess_move_flags() **/
+static inline int
+chess_inline_move_flags(unsigned move)
+{
+	return (move >> 15) & 3;
+}
+
+/** Inline version of chess_board_get_side() **/
+static inline int
+chess_inline_board_get_side(const struct chess_board *board)
+{
+	return board->side;
+}
+
+/** Inline version of chess_board_get_enpassant_square() **/
+static inline int
+chess_inline_board_get_enpassant_square(const struct chess_board *board)
+{
+	return board->epsq;
+}
+
+/** Inline version of chess_board_get_castling_flags() **/
+static inline int
+chess_inline_board_get_castling_flags(const struct chess_board *board)
+{
+	return board->cflag;
+}
+
+/** Inline version of chess_board_get_rhmc() **/
+static inline unsigned
+chess_inline_board_get_rhmc(const struct chess_board *board)
+{
+	return board->rhmc;
+}
+
+/** Inline version of chess_board_get_fmc() **/
+static inline unsigned
+chess_inline_board_get_fmc(const struct chess_board *board)
+{
+	return board->fmc;
+}
+
+/** Inline version of chess_board_get_hash() **/
+static inline unsigned long long
+chess_inline_board_get_hash(const struct chess_board *board)
+{
+	return board->hash;
+}
+
+/** Inline version of chess_board_has_piece() **/
+static inline bool
+chess_inline_board_has_piece(const struct chess_board *board, int square, int side)
+{
+	assert(square >= 0 && square <= 63);
+	assert(side == CHESS_SIDE_WHITE || side == CHESS_SIDE_BLACK);
+
+	return ((board->occupied[side] >> square) & 1) != 0;
+}
+
+/** Inline version of chess_board_get_pieces() **/
+static inline unsigned long long
+chess_inline_board_get_pieces(const struct chess_board *board, int side, int piece)
+{
+	assert(side == CHESS_SIDE_WHITE || side == CHESS_SIDE_BLACK);
+	assert(piece >= CHESS_PIECE_PAWN && piece <= CHESS_PIECE_KING);
+
+	return board->pieces[side][piece - CHESS_PIECE_PAWN];
+}
+
+/** Inline version of chess_board_get_occupied() **/
+static inline unsigned long long
+chess_inline_board_get_occupied(const struct chess_board *board, int side)
+{
+	assert(side == CHESS_SIDE_WHITE || side == CHESS_SIDE_BLACK);
+
+	return board->occupied[side];
+}
+
+/** Inline version of chess_board_get_piece() **/
+static inline bool
+chess_inline_board_get_piece(const struct chess_board *board, int square, int *piece_r, int *side_r)
+{
+	int piece;
+
+	assert(square >= 0 && square <= 63);
+
+	piece = board->cboard[square];
+	if (piece_r != NULL)
+		*piece_r = piece;
+	if (side_r != NULL)
+		*side_r = piece ? (int)((board->occupied[CHESS_SIDE_BLACK] >> square) & 1) : 0;
+	return piece != 0;
+}
+
+#ifndef CHESS_INLINE_NO_MACROS
+#define chess_bb_count(b)			chess_inline_bb_count(b)
+#define chess_bb_lsb(b)				chess_inline_bb_lsb(b)
+#define chess_bb_msb(b)				chess_inline_bb_msb(b)
+#define chess_bb_pop(b)				chess_inline_bb_pop(b)
+#define chess_switch_side(side)			chess_inline_switch_side(side)
+#define chess_rank(square)			chess_inline_rank(square)
+#define chess_file(square)			chess_inline_file(square)
+#define chess_file_char(square)			chess_inline_file_char(square)
+#define chess_square(rank, file)		chess_inline_square(rank, file)
+#define chess_square_left(square)		chess_inline_square_left(square)
+#define chess_square_right(square)		chess_inline_square_right(square)
+#define chess_square_up(square)			chess_inline_square_up(square)
+#define chess_square_down(square)		chess_inline_square_down(square)
+#define chess_square_border(square)		chess_inline_square_border(square)
+#define chess_move_from(move)			chess_inline_move_from(move)
+#define chess_move_to(move)			chess_inline_move_to(move)
+#define chess_move_promotion(move)		chess_inline_move_promotion(move)
+#define chess_move_flags(move)			chess_inline_move_flags(move)
+#define chess_board_get_side(board)		chess_inline_board_get_side(board)
+#define chess_board_get_enpassant_square(board)	chess_inline_board_get_enpassant_square(board)
+#define chess_board_get_castling_flags(board)	chess_inline_board_get_castling_flags(board)
+#define chess_board_get_rhmc(board)		chess_inline_board_get_rhmc(board)
+#define chess_board_get_fmc(board)		chess_inline_board_get_fmc(board)
+#define chess_board_get_hash(board)		chess_inline_board_get_hash(board)
+#define chess_board_get_pieces(board, side, piece) \
+	chess_inline_board_get_pieces(board, side, piece)
+#define chess_board_get_occupied(board, side)	chess_inline_board_get_occupied(board, side)
+#define chess_board_has_piece(board, square, side) \
+	chess_inline_board_has_piece(board, square, side)
+#define chess_board_get_piece(board, square, piece_r, side_r) \
+	chess_inline_board_get_piece(board, square, piece_r, side_r)
+#endif /* !CHESS_INLINE_NO_MACROS */
+
+#endif /* !LIBCHESS_GUARD_CHESS_INLINE_H */
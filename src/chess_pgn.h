@@ -0,0 +1,83 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_PGN_H
+#define LIBCHESS_GUARD_CHESS_PGN_H 1
+
+#include <stdio.h>
+
+#include "chess.h"
+
+/**
+ * \file
+ * Portable Game Notation reader
+ **/
+
+/**
+ * This opaque structure represents a PGN reader.
+ **/
+struct chess_pgn;
+
+/**
+ * Initializes and returns a PGN reader reading from the given stream.
+ * Returns NULL if memory allocation fails and sets errno accordingly.
+ **/
+struct chess_pgn *
+chess_pgn_init(FILE *fp);
+
+/**
+ * Frees the PGN reader. The stream is not closed.
+ **/
+void
+chess_pgn_free(struct chess_pgn *pgn);
+
+/**
+ * Reads the next game.
+ * On return the board holds the starting position of the game, taken from the
+ * FEN tag if there is one, and the moves of the main line are available via
+ * chess_pgn_get_moves(). Comments, variations and annotations are skipped.
+ * Returns 1 if a game was read, 0 at end of file, -1 if the game had an
+ * illegal move or an invalid FEN tag (errno is set to EINVAL, the moves up to
+ * the error are kept) or if reading failed (errno is set accordingly).
+ **/
+int
+chess_pgn_read_game(struct chess_pgn *pgn, struct chess_board *board);
+
+/**
+ * Returns the moves of the last game read.
+ * \param nmoves Pointer to save the number of moves.
+ **/
+const unsigned *
+chess_pgn_get_moves(const struct chess_pgn *pgn, unsigned *nmoves);
+
+/**
+ * Returns the result of the last game read, one of CHESS_RESULT_*.
+ **/
+int
+chess_pgn_get_result(const struct chess_pgn *pgn);
+
+/**
+ * Returns the value of the given tag of the last game read or NULL if the game
+ * doesn't have the tag.
+ **/
+const char *
+chess_pgn_get_tag(const struct chess_pgn *pgn, const char *name);
+
+#endif /* !LIBCHESS_GUARD_CHESS_PGN_H */
@@ -0,0 +1,128 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_PRIVATE_H
+#define LIBCHESS_GUARD_CHESS_PRIVATE_H 1
+
+/* Helpers shared by the library's translation units, the board layout is in
+ * chess_inline.h. This header is not installed.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chess_inline.h"
+#include "chess_stats.h"
+#ifdef ENABLE_COMPACT_SLIDERS
+#include "sliders.h"
+#else
+#include "magicmoves.h"
+#endif
+
+#define BOARD_ALIGN 64
+#define BOARD_SIZE 256
+
+/* Piece bitboards are indexed from 0, CHESS_PIECE_PAWN is 1 */
+#define PIECE_INDEX(piece)		((piece) - CHESS_PIECE_PAWN)
+#define PIECES(board, side, piece)	((board)->pieces[side][PIECE_INDEX(piece)])
+#define OCCUPIED(board)			((board)->occupied[CHESS_SIDE_WHITE] | (board)->occupied[CHESS_SIDE_BLACK])
+
+/* The position history is a ring of hash keys allocated right after the board
+ * by chess_board_init(). Repetitions can not reach back further than the
+ * reversible half move counter, which makes the game drawn at 100.
+ */
+#define HISTORY_SIZE 128
+#define HISTORY_MASK (HISTORY_SIZE - 1)
+
+/* Move encoding: from (6 bits), to (6 bits), promotion (3 bits), flags */
+#define MOVE_FROM_SHIFT		0
+#define MOVE_TO_SHIFT		6
+#define MOVE_PROMOTION_SHIFT	12
+#define MOVE_FLAGS_SHIFT	15
+#define MOVE(from, to, promotion, flags) \
+	(((unsigned)(from) << MOVE_FROM_SHIFT) | ((unsigned)(to) << MOVE_TO_SHIFT) \
+	 | ((unsigned)(promotion) << MOVE_PROMOTION_SHIFT) | ((unsigned)(flags) << MOVE_FLAGS_SHIFT))
+
+#define RANK_1 0x00000000000000ffULL
+#define RANK_8 0xff00000000000000ULL
+
+/* Sliding piece attacks, from the magic bitboards by default or from the
+ * compact tables of sliders.h with --enable-compact-sliders.
+ */
+#ifdef ENABLE_COMPACT_SLIDERS
+#define SLIDERS_INIT()		sliders_init()
+#define BISHOP_ATTACKS(sq, occ)	sliders_bishop((sq), (occ))
+#define ROOK_ATTACKS(sq, occ)	sliders_rook((sq), (occ))
+#else
+#define SLIDERS_INIT()		initmagicmoves()
+#define BISHOP_ATTACKS(sq, occ)	Bmagic((sq), (occ))
+#define ROOK_ATTACKS(sq, occ)	Rmagic((sq), (occ))
+#endif /* ENABLE_COMPACT_SLIDERS */
+
+/* Lowers the ply limit of the solver's lines, for the tests */
+struct chess_solver;
+void
+solve_set_ply_max(struct chess_solver *solver, unsigned plymax) __attribute__((visibility("hidden")));
+
+/* Hot path counters, see chess_stats.h. Each thread has its own block, in a
+ * cache line of its own, registered on the first count.
+ */
+#ifdef ENABLE_STATS
+struct stats_block {
+	unsigned long long counters[CHESS_STATS_MAX];
+	struct stats_block *next;
+} __attribute__((aligned(64)));
+
+extern __thread struct stats_block *stats_local __attribute__((visibility("hidden")));
+
+struct stats_block *
+stats_register(void) __attribute__((visibility("hidden")));
+
+static inline void
+stats_add(int counter, unsigned long long n)
+{
+	struct stats_block *block;
+
+	block = stats_local;
+	if (block == NULL)
+		block = stats_register();
+	/* Only the owning thread writes, snapshots read atomically */
+	__atomic_store_n(&block->counters[counter], block->counters[counter] + n, __ATOMIC_RELAXED);
+}
+#define STATS_ADD(counter, n)	stats_add(CHESS_STATS_ ## counter, (n))
+#else
+#define STATS_ADD(counter, n)	do { } while (0)
+#endif /* ENABLE_STATS */
+#define STATS_INC(counter)	STATS_ADD(counter, 1)
+
+/* Bitboard helpers, the public ones of chess_inline.h */
+#define bb_lsb(b)	chess_inline_bb_lsb(b)
+#define bb_msb(b)	chess_inline_bb_msb(b)
+#define bb_pop(b)	chess_inline_bb_pop(b)
+#define bb_count(b)	chess_inline_bb_count(b)
+
+static inline bool
+bb_several(unsigned long long b)
+{
+	return (b & (b - 1)) != 0;
+}
+
+#endif /* !LIBCHESS_GUARD_CHESS_PRIVATE_H */
@@ -0,0 +1,240 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_SEARCH_H
+#define LIBCHESS_GUARD_CHESS_SEARCH_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chess.h"
+
+/**
+ * \file
+ * Alpha-beta search
+ **/
+
+/**
+ * Score of a position where the side to move mates right away.
+ * Mate in n plies is represented by CHESS_SCORE_MATE - n, being mated in n
+ * plies by -CHESS_SCORE_MATE + n.
+ **/
+#define CHESS_SCORE_MATE 32000
+
+/**
+ * Scores above this value in magnitude are mate scores.
+ **/
+#define CHESS_SCORE_MATE_BOUND (CHESS_SCORE_MATE - CHESS_SEARCH_DEPTH_MAX)
+
+/**
+ * Maximum search depth in plies.
+ **/
+#define CHESS_SEARCH_DEPTH_MAX 64
+
+/**
+ * This structure holds the limits of a search.
+ * Zero means no limit. The search stops as soon as any of the limits is
+ * reached, and always completes at least one iteration.
+ **/
+struct chess_search_limits {
+	unsigned depth;			/**< Depth in plies */
+	unsigned long long nodes;	/**< Number of nodes */
+	unsigned long time;		/**< Time in milliseconds */
+};
+
+/**
+ * This structure holds the result of the last completed search iteration.
+ **/
+struct chess_search_info {
+	unsigned depth;				/**< Depth in plies */
+	int score;				/**< Score from the point of view of the side to move */
+	unsigned long long nodes;		/**< Nodes searched in total */
+	unsigned long time;			/**< Time spent in total in milliseconds */
+	unsigned npv;				/**< Length of the principal variation */
+	unsigned pv[CHESS_SEARCH_DEPTH_MAX];	/**< Principal variation */
+};
+
+/**
+ * Flag of chess_search_init_shared() to back the table with huge pages where
+ * the system supports it.
+ **/
+#define CHESS_SEARCH_SHARED_HUGEPAGES 0x0001
+
+/**
+ * Flag of chess_search_init_shared() to only attach to an existing segment.
+ **/
+#define CHESS_SEARCH_SHARED_EXISTING 0x0002
+
+/**
+ * Flag of chess_search_start() to ponder: the search ignores its limits until
+ * chess_search_ponderhit() is called.
+ **/
+#define CHESS_SEARCH_PONDER 0x0001
+
+/**
+ * This structure holds statistics of a transposition table.
+ * The counters are summed over all searches, of all processes for a shared
+ * table, and updated at the end of each search.
+ **/
+struct chess_search_table_stats {
+	unsigned long long size;	/**< Number of entries */
+	unsigned long long used;	/**< Entries in use */
+	unsigned long long current;	/**< Entries stored by the last search started */
+	unsigned long long torn;	/**< Entries corrupted by concurrent writes */
+	unsigned long long searches;	/**< Number of searches run */
+	unsigned long long probes;	/**< Lookups */
+	unsigned long long hits;	/**< Lookups that found their position */
+	unsigned long long stores;	/**< Entries written */
+	unsigned long long overwrites;	/**< Entries written over another position */
+	bool shared;			/**< Whether the table is in shared memory */
+};
+
+/**
+ * This opaque structure holds the state of a search: the transposition table
+ * and the move ordering heuristics. It may be used for one search at a time.
+ **/
+struct chess_search;
+
+/**
+ * Initializes and returns a search.
+ * Returns NULL on failure and sets errno accordingly.
+ * \param memory Size of the transposition table in bytes
+ **/
+struct chess_search *
+chess_search_init(size_t memory);
+
+/**
+ * Initializes and returns a search whose transposition table lives in the
+ * named POSIX shared memory segment, so that processes searching related
+ * positions share their results. The segment is created with the given size
+ * if it does not exist, otherwise its size is kept. Entries are read and
+ * written without locks, entries torn by concurrent writers are detected and
+ * ignored.
+ * Returns NULL on failure and sets errno accordingly, EINVAL means the
+ * segment is not a transposition table.
+ * \param name Name of the segment, starting with a slash
+ * \param memory Size of the transposition table in bytes
+ * \param flags Bitwise or of CHESS_SEARCH_SHARED_* flags
+ **/
+struct chess_search *
+chess_search_init_shared(const char *name, size_t memory, int flags);
+
+/**
+ * Removes the named shared memory segment, attached searches keep their
+ * mapping until they are freed.
+ * Returns 0 on success, -1 on failure and sets errno accordingly.
+ **/
+int
+chess_search_unlink_shared(const char *name);
+
+/**
+ * Fills the statistics of the transposition table, walking all entries.
+ **/
+void
+chess_search_get_table_stats(const struct chess_search *search, struct chess_search_table_stats *stats);
+
+/**
+ * Frees the search.
+ **/
+void
+chess_search_free(struct chess_search *search);
+
+/**
+ * Clears the transposition table and the move ordering heuristics, e.g.
+ * before searching a position unrelated to the previous one.
+ * A shared table is cleared for all processes.
+ **/
+void
+chess_search_clear(struct chess_search *search);
+
+/**
+ * Searches the position with iterative deepening.
+ * The board is restored to its original state on return.
+ * Returns the best move or CHESS_MOVE_NONE if there are no legal moves.
+ * \param info Structure to hold the result, may be NULL
+ **/
+unsigned
+chess_search_run(struct chess_search *search, struct chess_board *board,
+		const struct chess_search_limits *limits, struct chess_search_info *info);
+
+/**
+ * Searches the position like chess_search_run(), reporting the best nlines
+ * moves each with its own score and principal variation. Every iteration
+ * searches the root once per line, excluding the moves of the better lines.
+ * The lines are sorted best first.
+ * Returns the number of lines filled, fewer than nlines if the position has
+ * fewer legal moves.
+ * \param lines Array of nlines structures to hold the result
+ **/
+unsigned
+chess_search_run_multipv(struct chess_search *search, struct chess_board *board,
+		const struct chess_search_limits *limits, struct chess_search_info *lines, unsigned nlines);
+
+/**
+ * Starts searching the position like chess_search_run_multipv() on a
+ * background thread and returns right away. The board is copied, the caller
+ * may change or free it. The search must be waited for with
+ * chess_search_wait() before another one is started.
+ * To ponder, make the expected reply on the board and pass
+ * CHESS_SEARCH_PONDER, the search then runs until chess_search_ponderhit() or
+ * chess_search_stop() is called, and its limits count from the ponder hit.
+ * Returns 0 on success, -1 on failure and sets errno accordingly, EBUSY means
+ * a search is already running.
+ * \param nlines Number of principal variations to search
+ * \param flags Bitwise or of CHESS_SEARCH_* flags
+ * \param callback Function called with the lines of every completed
+ *        iteration, may be NULL. It is called on a thread of its own, the
+ *        search does not wait for it and skips iterations completed while it
+ *        runs.
+ * \param data Passed to the callback
+ **/
+int
+chess_search_start(struct chess_search *search, const struct chess_board *board,
+		const struct chess_search_limits *limits, unsigned nlines, int flags,
+		void (*callback)(const struct chess_search_info *lines, unsigned nlines, void *data),
+		void *data);
+
+/**
+ * Asks the background search to stop, it stops within about a millisecond
+ * unless it has not completed its first iteration yet.
+ * May be called from any thread.
+ **/
+void
+chess_search_stop(struct chess_search *search);
+
+/**
+ * Tells a pondering search that the expected reply was played, from then on
+ * it searches within its limits.
+ * May be called from any thread.
+ **/
+void
+chess_search_ponderhit(struct chess_search *search);
+
+/**
+ * Waits for the background search to finish, after its last callback.
+ * Returns the best move or CHESS_MOVE_NONE if there are no legal moves or no
+ * search was started.
+ * \param lines Array of nlines structures to hold the result, lines beyond
+ *        the number of legal moves are zeroed, may be NULL
+ **/
+unsigned
+chess_search_wait(struct chess_search *search, struct chess_search_info *lines);
+
+#endif /* !LIBCHESS_GUARD_CHESS_SEARCH_H */
@@ -0,0 +1,117 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_SOLVE_H
+#define LIBCHESS_GUARD_CHESS_SOLVE_H 1
+
+#include <stddef.h>
+
+#include "chess.h"
+
+/**
+ * \file
+ * Proof-number mate solver
+ *
+ * The solver proves or disproves that the side to move forces mate with
+ * depth-first proof-number search. Unlike alpha-beta it has no depth limit,
+ * it follows the lines where the defender has the fewest replies, which finds
+ * deep forced mates quickly. Proof and disproof numbers are kept in a fixed
+ * size hash table, entries with the smallest subtrees are replaced first.
+ **/
+
+/**
+ * The result of a solver run is not known, a limit was reached.
+ **/
+#define CHESS_SOLVER_UNKNOWN 0
+
+/**
+ * The side to move forces mate.
+ **/
+#define CHESS_SOLVER_PROVEN 1
+
+/**
+ * The side to move does not force mate, with checks only unless
+ * CHESS_SOLVER_ALL_MOVES is given.
+ **/
+#define CHESS_SOLVER_DISPROVEN 2
+
+/**
+ * Flag of chess_solver_run() to try all moves of the attacking side, not only
+ * checks. Much slower, but finds mates with quiet moves.
+ **/
+#define CHESS_SOLVER_ALL_MOVES 0x0001
+
+/**
+ * Maximum length of the mating line reported.
+ **/
+#define CHESS_SOLVER_PV_MAX 128
+
+/**
+ * This structure holds the result of a solver run.
+ **/
+struct chess_solver_result {
+	int status;				/**< One of CHESS_SOLVER_* */
+	unsigned long long nodes;		/**< Nodes searched by all threads */
+	unsigned long time;			/**< Time spent in milliseconds */
+	unsigned npv;				/**< Length of the mating line */
+	unsigned pv[CHESS_SOLVER_PV_MAX];	/**< A mating line, longest defence first */
+};
+
+/**
+ * This opaque structure holds the node table of the solver.
+ **/
+struct chess_solver;
+
+/**
+ * Initializes and returns a solver.
+ * Returns NULL on failure and sets errno accordingly.
+ * \param memory Size of the node table in bytes
+ **/
+struct chess_solver *
+chess_solver_init(size_t memory);
+
+/**
+ * Frees the solver.
+ **/
+void
+chess_solver_free(struct chess_solver *solver);
+
+/**
+ * Clears the node table. Results of previous runs are otherwise kept and
+ * reused, they are valid for any position.
+ **/
+void
+chess_solver_clear(struct chess_solver *solver);
+
+/**
+ * Tries to prove that the side to move forces mate.
+ * The threads search from the root in different orders and share the node
+ * table, the first one to solve the position stops the others.
+ * Returns one of CHESS_SOLVER_* and fills the result if not NULL.
+ * \param nodes Maximum number of nodes in total, 0 for no limit
+ * \param nthreads Number of threads, 0 for one per online processor
+ * \param flags Bitwise or of CHESS_SOLVER_* flags
+ **/
+int
+chess_solver_run(struct chess_solver *solver, const struct chess_board *board,
+		unsigned long long nodes, unsigned nthreads, int flags,
+		struct chess_solver_result *result);
+
+#endif /* !LIBCHESS_GUARD_CHESS_SOLVE_H */
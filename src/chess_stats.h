@@ -0,0 +1,112 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LIBCHESS_GUARD_CHESS_STATS_H
+#define LIBCHESS_GUARD_CHESS_STATS_H 1
+
+#include <stdbool.h>
+
+/**
+ * \file
+ * Hot path counters
+ *
+ * When libchess is configured with --enable-stats, the library counts calls
+ * of its hot paths. Every thread counts in its own cache line, so counting
+ * does not add contention between cores. Counts are summed up on demand.
+ * Without --enable-stats nothing is counted and all counters read zero.
+ **/
+
+/**
+ * Calls of chess_board_set_piece().
+ **/
+#define CHESS_STATS_SET_PIECE 0
+/**
+ * Calls of chess_board_clear_piece().
+ **/
+#define CHESS_STATS_CLEAR_PIECE 1
+/**
+ * Lookups of the pieces attacking a square.
+ **/
+#define CHESS_STATS_ATTACKS 2
+/**
+ * Calls of chess_board_get_fen() and chess_board_get_shredder_fen().
+ **/
+#define CHESS_STATS_GET_FEN 3
+/**
+ * Calls of chess_board_set_fen().
+ **/
+#define CHESS_STATS_SET_FEN 4
+/**
+ * Calls of chess_board_generate_moves().
+ **/
+#define CHESS_STATS_GENERATE_MOVES 5
+/**
+ * Calls of chess_board_make_move().
+ **/
+#define CHESS_STATS_MAKE_MOVE 6
+/**
+ * Calls of chess_evaluate().
+ **/
+#define CHESS_STATS_EVALUATE 7
+/**
+ * Nodes visited by chess_search_run().
+ **/
+#define CHESS_STATS_SEARCH_NODES 8
+/**
+ * Number of counters.
+ **/
+#define CHESS_STATS_MAX 9
+
+/**
+ * This structure holds a snapshot of the counters, indexed by CHESS_STATS_*.
+ **/
+struct chess_stats {
+	unsigned long long counters[CHESS_STATS_MAX];
+};
+
+/**
+ * Returns true if libchess was configured with --enable-stats.
+ **/
+bool
+chess_stats_enabled(void);
+
+/**
+ * Returns the name of the counter, e.g. "set_piece".
+ **/
+const char *
+chess_stats_name(int counter);
+
+/**
+ * Sums up the counters of all threads, including threads that exited.
+ * Counts of threads still running may be a few calls behind.
+ **/
+void
+chess_stats_snapshot(struct chess_stats *stats);
+
+/**
+ * Writes a snapshot of the counters in the Prometheus text format to the file
+ * at the given path. The file is replaced atomically so that a scraper never
+ * reads a partial file.
+ * Returns 0 on success, -1 on failure and sets errno accordingly.
+ **/
+int
+chess_stats_export(const char *path);
+
+#endif /* !LIBCHESS_GUARD_CHESS_STATS_H */
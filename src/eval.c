@@ -0,0 +1,480 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_eval.h"
+#include "chess_private.h"
+
+/* Middle game and end game piece values */
+static const int MATERIAL[2][7] = {
+	{ 0, 82, 337, 365, 477, 1025, 0 },
+	{ 0, 94, 281, 297, 512, 936, 0 },
+};
+
+/* Contribution of each piece to the game phase */
+static const int PHASE[7] = { 0, 0, 1, 1, 2, 4, 0 };
+
+/*
+ * Piece-square tables from white's point of view, laid out as seen from
+ * white's side: the first row is the eighth rank.
+ */
+static const int PST[2][7][64] = {
+	{ /* Middle game */
+		{ 0 },
+		{ /* Pawn */
+			  0,   0,   0,   0,   0,   0,   0,   0,
+			 50,  50,  50,  50,  50,  50,  50,  50,
+			 10,  10,  20,  30,  30,  20,  10,  10,
+			  5,   5,  10,  25,  25,  10,   5,   5,
+			  0,   0,   0,  20,  20,   0,   0,   0,
+			  5,  -5, -10,   0,   0, -10,  -5,   5,
+			  5,  10,  10, -20, -20,  10,  10,   5,
+			  0,   0,   0,   0,   0,   0,   0,   0,
+		},
+		{ /* Knight */
+			-50, -40, -30, -30, -30, -30, -40, -50,
+			-40, -20,   0,   0,   0,   0, -20, -40,
+			-30,   0,  10,  15,  15,  10,   0, -30,
+			-30,   5,  15,  20,  20,  15,   5, -30,
+			-30,   0,  15,  20,  20,  15,   0, -30,
+			-30,   5,  10,  15,  15,  10,   5, -30,
+			-40, -20,   0,   5,   5,   0, -20, -40,
+			-50, -40, -30, -30, -30, -30, -40, -50,
+		},
+		{ /* Bishop */
+			-20, -10, -10, -10, -10, -10, -10, -20,
+			-10,   0,   0,   0,   0,   0,   0, -10,
+			-10,   0,   5,  10,  10,   5,   0, -10,
+			-10,   5,   5,  10,  10,   5,   5, -10,
+			-10,   0,  10,  10,  10,  10,   0, -10,
+			-10,  10,  10,  10,  10,  10,  10, -10,
+			-10,   5,   0,   0,   0,   0,   5, -10,
+			-20, -10, -10, -10, -10, -10, -10, -20,
+		},
+		{ /* Rook */
+			  0,   0,   0,   0,   0,   0,   0,   0,
+			  5,  10,  10,  10,  10,  10,  10,   5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			  0,   0,   0,   5,   5,   0,   0,   0,
+		},
+		{ /* Queen */
+			-20, -10, -10,  -5,  -5, -10, -10, -20,
+			-10,   0,   0,   0,   0,   0,   0, -10,
+			-10,   0,   5,   5,   5,   5,   0, -10,
+			 -5,   0,   5,   5,   5,   5,   0,  -5,
+			  0,   0,   5,   5,   5,   5,   0,  -5,
+			-10,   5,   5,   5,   5,   5,   0, -10,
+			-10,   0,   5,   0,   0,   0,   0, -10,
+			-20, -10, -10,  -5,  -5, -10, -10, -20,
+		},
+		{ /* King */
+			-30, -40, -40, -50, -50, -40, -40, -30,
+			-30, -40, -40, -50, -50, -40, -40, -30,
+			-30, -40, -40, -50, -50, -40, -40, -30,
+			-30, -40, -40, -50, -50, -40, -40, -30,
+			-20, -30, -30, -40, -40, -30, -30, -20,
+			-10, -20, -20, -20, -20, -20, -20, -10,
+			 20,  20,   0,   0,   0,   0,  20,  20,
+			 20,  30,  10,   0,   0,  10,  30,  20,
+		},
+	},
+	{ /* End game */
+		{ 0 },
+		{ /* Pawn */
+			  0,   0,   0,   0,   0,   0,   0,   0,
+			 80,  80,  80,  80,  80,  80,  80,  80,
+			 50,  50,  50,  50,  50,  50,  50,  50,
+			 30,  30,  30,  30,  30,  30,  30,  30,
+			 15,  15,  15,  15,  15,  15,  15,  15,
+			  5,   5,   5,   5,   5,   5,   5,   5,
+			  0,   0,   0,   0,   0,   0,   0,   0,
+			  0,   0,   0,   0,   0,   0,   0,   0,
+		},
+		{ /* Knight */
+			-50, -40, -30, -30, -30, -30, -40, -50,
+			-40, -20,   0,   0,   0,   0, -20, -40,
+			-30,   0,  10,  15,  15,  10,   0, -30,
+			-30,   5,  15,  20,  20,  15,   5, -30,
+			-30,   0,  15,  20,  20,  15,   0, -30,
+			-30,   5,  10,  15,  15,  10,   5, -30,
+			-40, -20,   0,   5,   5,   0, -20, -40,
+			-50, -40, -30, -30, -30, -30, -40, -50,
+		},
+		{ /* Bishop */
+			-20, -10, -10, -10, -10, -10, -10, -20,
+			-10,   0,   0,   0,   0,   0,   0, -10,
+			-10,   0,   5,  10,  10,   5,   0, -10,
+			-10,   5,   5,  10,  10,   5,   5, -10,
+			-10,   0,  10,  10,  10,  10,   0, -10,
+			-10,  10,  10,  10,  10,  10,  10, -10,
+			-10,   5,   0,   0,   0,   0,   5, -10,
+			-20, -10, -10, -10, -10, -10, -10, -20,
+		},
+		{ /* Rook */
+			  0,   0,   0,   0,   0,   0,   0,   0,
+			  5,  10,  10,  10,  10,  10,  10,   5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			 -5,   0,   0,   0,   0,   0,   0,  -5,
+			  0,   0,   0,   5,   5,   0,   0,   0,
+		},
+		{ /* Queen */
+			-20, -10, -10,  -5,  -5, -10, -10, -20,
+			-10,   0,   0,   0,   0,   0,   0, -10,
+			-10,   0,   5,   5,   5,   5,   0, -10,
+			 -5,   0,   5,   5,   5,   5,   0,  -5,
+			  0,   0,   5,   5,   5,   5,   0,  -5,
+			-10,   5,   5,   5,   5,   5,   0, -10,
+			-10,   0,   5,   0,   0,   0,   0, -10,
+			-20, -10, -10,  -5,  -5, -10, -10, -20,
+		},
+		{ /* King */
+			-50, -40, -30, -20, -20, -30, -40, -50,
+			-30, -20, -10,   0,   0, -10, -20, -30,
+			-30, -10,  20,  30,  30,  20, -10, -30,
+			-30, -10,  30,  40,  40,  30, -10, -30,
+			-30, -10,  30,  40,  40,  30, -10, -30,
+			-30, -10,  20,  30,  30,  20, -10, -30,
+			-30, -30,   0,   0,   0,   0, -30, -30,
+			-50, -30, -30, -30, -30, -30, -30, -50,
+		},
+	},
+};
+
+/* Material plus piece-square value, indexed by [phase][side][piece][square],
+ * negated for black. Filled by eval_init() from the parameters.
+ */
+static int eval_table[2][2][7][64];
+
+/* Parameters in the CHESS_EVAL_MATERIAL() and CHESS_EVAL_PST() layout,
+ * the tables above unless others are set.
+ */
+static int eval_params[CHESS_EVAL_PARAMS];
+
+static pthread_once_t eval_init_once = PTHREAD_ONCE_INIT;
+
+static void
+eval_build(void)
+{
+	for (int phase = 0; phase < 2; phase++) {
+		for (int piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++) {
+			for (int sq = 0; sq < 64; sq++) {
+				int v = eval_params[CHESS_EVAL_MATERIAL(phase, piece)]
+					+ eval_params[CHESS_EVAL_PST(phase, piece, sq)];
+
+				eval_table[phase][CHESS_SIDE_WHITE][piece][sq] = v;
+				eval_table[phase][CHESS_SIDE_BLACK][piece][sq ^ 56] = -v;
+			}
+		}
+	}
+}
+
+static void
+eval_init(void)
+{
+	for (int phase = 0; phase < 2; phase++) {
+		for (int piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++) {
+			eval_params[CHESS_EVAL_MATERIAL(phase, piece)] = MATERIAL[phase][piece];
+			/* The tables start with the eighth rank */
+			for (int sq = 0; sq < 64; sq++)
+				eval_params[CHESS_EVAL_PST(phase, piece, sq)] = PST[phase][piece][sq ^ 56];
+		}
+	}
+	eval_build();
+}
+
+/* Threads claim positions in blocks of this many, the boards of a block and
+ * their scores fit in the level 1 data cache.
+ */
+#define BATCH_BLOCK	64
+#define BATCH_PREFETCH	4	/* Boards ahead to prefetch */
+
+struct eval_batch {
+	const struct chess_board *const *boards;
+	const char *const *fens;
+	int *scores;
+	size_t n;
+	size_t next;		/**< First position of the next block, claimed atomically */
+	int error;		/**< errno of a thread that failed to start evaluating */
+};
+
+int
+chess_evaluate(const struct chess_board *board)
+{
+	int mg, eg, phase, score, sq;
+	unsigned long long b;
+
+	pthread_once(&eval_init_once, eval_init);
+	STATS_INC(EVALUATE);
+
+	mg = eg = phase = 0;
+	for (int side = 0; side < 2; side++) {
+		for (int piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++) {
+			b = PIECES(board, side, piece);
+			while (b) {
+				sq = bb_pop(&b);
+				mg += eval_table[0][side][piece][sq];
+				eg += eval_table[1][side][piece][sq];
+				phase += PHASE[piece];
+			}
+		}
+	}
+
+	if (phase > CHESS_EVAL_PHASE_MAX)
+		phase = CHESS_EVAL_PHASE_MAX;
+	score = (mg * phase + eg * (CHESS_EVAL_PHASE_MAX - phase)) / CHESS_EVAL_PHASE_MAX;
+
+	return (board->side == CHESS_SIDE_WHITE) ? score : -score;
+}
+
+int
+chess_evaluate_phase(const struct chess_board *board)
+{
+	int phase = 0;
+
+	for (int side = 0; side < 2; side++)
+		for (int piece = CHESS_PIECE_KNIGHT; piece <= CHESS_PIECE_QUEEN; piece++)
+			phase += PHASE[piece] * bb_count(PIECES(board, side, piece));
+	return (phase > CHESS_EVAL_PHASE_MAX) ? CHESS_EVAL_PHASE_MAX : phase;
+}
+
+void
+chess_eval_get_params(int *params)
+{
+	pthread_once(&eval_init_once, eval_init);
+	memcpy(params, eval_params, sizeof(eval_params));
+}
+
+void
+chess_eval_set_params(const int *params)
+{
+	pthread_once(&eval_init_once, eval_init);
+	memcpy(eval_params, params, sizeof(eval_params));
+	eval_build();
+}
+
+static const char *const eval_phase_names[2] = { "middle game", "end game" };
+static const char *const eval_piece_names[7] = { NULL, "pawn", "knight", "bishop", "rook", "queen", "king" };
+
+/* Files list the material values, then the piece-square tables laid out as
+ * in the source, eighth rank first.
+ */
+static int
+eval_file_param(int i)
+{
+	int sq;
+
+	if (i < CHESS_EVAL_PST(0, CHESS_PIECE_PAWN, 0))
+		return i;
+	sq = (i - CHESS_EVAL_PST(0, CHESS_PIECE_PAWN, 0)) % 64;
+	return i - sq + (sq ^ 56);
+}
+
+int
+chess_eval_save(const char *path)
+{
+	int piece;
+	FILE *fp;
+
+	pthread_once(&eval_init_once, eval_init);
+
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return -1;
+
+	fprintf(fp, "# libchess evaluation parameters\n");
+	for (int phase = 0; phase < 2; phase++) {
+		fprintf(fp, "# material, %s: pawn knight bishop rook queen king\n", eval_phase_names[phase]);
+		for (piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++)
+			fprintf(fp, "%d%c", eval_params[CHESS_EVAL_MATERIAL(phase, piece)],
+					piece == CHESS_PIECE_KING ? '\n' : ' ');
+	}
+	for (int phase = 0; phase < 2; phase++) {
+		for (piece = CHESS_PIECE_PAWN; piece <= CHESS_PIECE_KING; piece++) {
+			fprintf(fp, "# %s %s, eighth rank first\n", eval_phase_names[phase], eval_piece_names[piece]);
+			for (int i = 0; i < 64; i++)
+				fprintf(fp, "%4d%c", eval_params[CHESS_EVAL_PST(phase, piece, i ^ 56)],
+						(i % 8 == 7) ? '\n' : ' ');
+		}
+	}
+
+	if (ferror(fp)) {
+		fclose(fp);
+		return -1;
+	}
+	return fclose(fp);
+}
+
+int
+chess_eval_load(const char *path)
+{
+	int c, n;
+	int params[CHESS_EVAL_PARAMS];
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+
+	n = 0;
+	for (;;) {
+		c = getc(fp);
+		if (c == '#') {
+			while (c != '\n' && c != EOF)
+				c = getc(fp);
+		}
+		if (c == EOF)
+			break;
+		if (isspace(c))
+			continue;
+		ungetc(c, fp);
+		if (n == CHESS_EVAL_PARAMS || fscanf(fp, "%d", &params[eval_file_param(n)]) != 1)
+			goto invalid;
+		++n;
+	}
+	if (ferror(fp)) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	if (n != CHESS_EVAL_PARAMS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	chess_eval_set_params(params);
+	return 0;
+
+invalid:
+	fclose(fp);
+	errno = EINVAL;
+	return -1;
+}
+
+static void *
+eval_batch_thread(void *arg)
+{
+	size_t start, end;
+	struct chess_board *board;
+	struct eval_batch *batch = arg;
+
+	board = NULL;
+	if (batch->fens != NULL) {
+		board = chess_board_init();
+		if (board == NULL) {
+			batch->error = errno;
+			return NULL;
+		}
+	}
+
+	while ((start = __atomic_fetch_add(&batch->next, BATCH_BLOCK, __ATOMIC_RELAXED)) < batch->n) {
+		end = start + BATCH_BLOCK;
+		if (end > batch->n)
+			end = batch->n;
+
+		if (board == NULL) {
+			for (size_t i = start; i < end; i++) {
+				if (i + BATCH_PREFETCH < end)
+					__builtin_prefetch(batch->boards[i + BATCH_PREFETCH]);
+				batch->scores[i] = chess_evaluate(batch->boards[i]);
+			}
+		}
+		else {
+			for (size_t i = start; i < end; i++)
+				batch->scores[i] = chess_board_set_fen(board, batch->fens[i])
+					? chess_evaluate(board) : CHESS_EVAL_INVALID;
+		}
+	}
+
+	free(board);
+	return NULL;
+}
+
+static int
+eval_batch_run(struct eval_batch *batch, unsigned nthreads)
+{
+	unsigned started;
+	size_t nblocks;
+	pthread_t *threads;
+
+	pthread_once(&eval_init_once, eval_init);
+
+	if (nthreads == 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	nblocks = (batch->n + BATCH_BLOCK - 1) / BATCH_BLOCK;
+	if (nthreads > nblocks)
+		nthreads = nblocks ? nblocks : 1;
+
+	/* The calling thread evaluates too, the blocks of threads failing to
+	 * start are claimed by the others.
+	 */
+	threads = NULL;
+	started = 0;
+	if (nthreads > 1 && (threads = calloc(nthreads - 1, sizeof(pthread_t))) != NULL) {
+		for (; started < nthreads - 1; started++) {
+			if (pthread_create(&threads[started], NULL, eval_batch_thread, batch) != 0)
+				break;
+		}
+	}
+	eval_batch_thread(batch);
+	for (unsigned i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	if (batch->next < batch->n) {
+		errno = batch->error;
+		return -1;
+	}
+	return 0;
+}
+
+void
+chess_evaluate_batch(const struct chess_board *const *boards, size_t n, int *scores, unsigned nthreads)
+{
+	struct eval_batch batch = { boards, NULL, scores, n, 0, 0 };
+
+	eval_batch_run(&batch, nthreads);
+}
+
+int
+chess_evaluate_batch_fen(const char *const *fens, size_t n, int *scores, unsigned nthreads)
+{
+	struct eval_batch batch = { NULL, fens, scores, n, 0, 0 };
+
+	return eval_batch_run(&batch, nthreads);
+}
@@ -0,0 +1,354 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess_filter.h"
+
+#define FILTER_MAGIC		"LCHBLM01"
+#define FILTER_WORDS		8	/* Words of a block, one cache line */
+#define FILTER_PREFETCH		8	/* Keys prefetched ahead by batch inserts */
+#define FILTER_BLOCKS_MAX	(1ULL << 32)
+
+/* The file starts with a header of one cache line, followed by the blocks */
+struct filter_header {
+	char magic[8];
+	uint64_t nblocks;
+	uint64_t count;
+	uint64_t reserved[5];
+};
+
+struct chess_filter {
+	void *map;
+	size_t size;
+	bool file;
+	struct filter_header *header;
+	uint64_t *blocks;
+	uint64_t nblocks;
+};
+
+/* Odd multipliers picking the bit of each word, from the split block Bloom
+ * filter of Apache Parquet.
+ */
+static const uint32_t filter_salt[FILTER_WORDS] = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+/* e^-x for x >= 0, by the series on a reduced argument and squaring back */
+static double
+filter_exp(double x)
+{
+	int halvings;
+	double sum, term;
+
+	for (halvings = 0; x > 0.5; halvings++)
+		x /= 2;
+	sum = term = 1;
+	for (int i = 1; i < 16; i++) {
+		term *= -x / i;
+		sum += term;
+	}
+	while (halvings-- > 0)
+		sum *= sum;
+	return sum;
+}
+
+/* False positive rate with the given average number of keys per block. The
+ * keys of a block are Poisson distributed and each sets one bit per word.
+ */
+static double
+filter_rate(double load)
+{
+	double p, unset, set, rate;
+
+	p = filter_exp(load);
+	unset = 1;
+	rate = 0;
+	for (unsigned j = 0; j < 2 * load + 64; j++) {
+		set = 1 - unset;
+		set *= set;
+		set *= set;
+		rate += p * set * set;
+		p *= load / (j + 1);
+		unset *= 63.0 / 64.0;
+	}
+	return rate;
+}
+
+/* Number of blocks holding nkeys keys with the given false positive rate */
+static int
+filter_blocks(uint64_t nkeys, double fpr, uint64_t *nblocks)
+{
+	double lo, hi, mid, n;
+
+	if (!(fpr > 0 && fpr < 1)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* The rate grows with the load, bisect for the highest load allowed */
+	lo = 0;
+	hi = FILTER_WORDS * 64;
+	for (int i = 0; i < 64; i++) {
+		mid = (lo + hi) / 2;
+		if (filter_rate(mid) <= fpr)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	/* Blocks are picked by 32 bits of the key, up to 256 GiB */
+	n = lo > 0 ? nkeys / lo + 1 : 0;
+	if (!(n >= 1 && n <= FILTER_BLOCKS_MAX
+				&& n < (double)((SIZE_MAX - sizeof(struct filter_header)) / (FILTER_WORDS * 8)))) {
+		errno = ENOMEM;
+		return -1;
+	}
+	*nblocks = n;
+	return 0;
+}
+
+static struct chess_filter *
+filter_new(void *map, size_t size, bool file)
+{
+	struct chess_filter *filter;
+
+	filter = malloc(sizeof(struct chess_filter));
+	if (filter == NULL)
+		return NULL;
+
+	filter->map = map;
+	filter->size = size;
+	filter->file = file;
+	filter->header = map;
+	filter->blocks = (uint64_t *)(filter->header + 1);
+	filter->nblocks = filter->header->nblocks;
+
+	/* Keys land anywhere, don't read ahead */
+	madvise(map, size, MADV_RANDOM);
+	return filter;
+}
+
+struct chess_filter *
+chess_filter_init(uint64_t nkeys, double fpr)
+{
+	int save_errno;
+	size_t size;
+	uint64_t nblocks;
+	void *map;
+	struct chess_filter *filter;
+
+	if (filter_blocks(nkeys, fpr, &nblocks) < 0)
+		return NULL;
+	size = sizeof(struct filter_header) + nblocks * FILTER_WORDS * 8;
+
+	/* Anonymous mappings start zeroed and are returned on free */
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+	memcpy(((struct filter_header *)map)->magic, FILTER_MAGIC, 8);
+	((struct filter_header *)map)->nblocks = nblocks;
+
+	filter = filter_new(map, size, false);
+	if (filter == NULL) {
+		save_errno = errno;
+		munmap(map, size);
+		errno = save_errno;
+	}
+	return filter;
+}
+
+struct chess_filter *
+chess_filter_open(const char *path, uint64_t nkeys, double fpr)
+{
+	int fd, save_errno;
+	bool created;
+	size_t size;
+	uint64_t nblocks;
+	struct stat st;
+	void *map;
+	struct filter_header *h;
+	struct chess_filter *filter;
+
+	created = false;
+	nblocks = 0;
+	fd = open(path, O_RDWR);
+	if (fd < 0 && errno == ENOENT) {
+		if (filter_blocks(nkeys, fpr, &nblocks) < 0)
+			return NULL;
+		fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (fd < 0)
+			return NULL;
+		created = true;
+		if (ftruncate(fd, sizeof(struct filter_header) + nblocks * FILTER_WORDS * 8) < 0)
+			goto fail_fd;
+	}
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0)
+		goto fail_fd;
+	if ((size_t)st.st_size < sizeof(struct filter_header)) {
+		errno = EINVAL;
+		goto fail_fd;
+	}
+
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto fail_fd;
+	close(fd);
+
+	h = map;
+	if (created) {
+		memcpy(h->magic, FILTER_MAGIC, sizeof(h->magic));
+		h->nblocks = nblocks;
+	}
+	else if (memcmp(h->magic, FILTER_MAGIC, sizeof(h->magic)) != 0
+			|| h->nblocks == 0 || h->nblocks > FILTER_BLOCKS_MAX
+			|| h->nblocks != (size - sizeof(struct filter_header)) / (FILTER_WORDS * 8)
+			|| (size - sizeof(struct filter_header)) % (FILTER_WORDS * 8) != 0) {
+		munmap(map, size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	filter = filter_new(map, size, true);
+	if (filter == NULL) {
+		save_errno = errno;
+		munmap(map, size);
+		errno = save_errno;
+	}
+	return filter;
+
+fail_fd:
+	save_errno = errno;
+	close(fd);
+	if (created)
+		unlink(path);
+	errno = save_errno;
+	return NULL;
+}
+
+int
+chess_filter_sync(struct chess_filter *filter)
+{
+	if (!filter->file)
+		return 0;
+	return msync(filter->map, filter->size, MS_SYNC);
+}
+
+void
+chess_filter_free(struct chess_filter *filter)
+{
+	munmap(filter->map, filter->size);
+	free(filter);
+}
+
+size_t
+chess_filter_get_size(const struct chess_filter *filter)
+{
+	return filter->size;
+}
+
+uint64_t
+chess_filter_get_count(const struct chess_filter *filter)
+{
+	return filter->header->count;
+}
+
+/* The high half of the key picks the block, the low half the bit of each word */
+static inline uint64_t *
+filter_block(const struct chess_filter *filter, uint64_t key)
+{
+	return filter->blocks + (((key >> 32) * filter->nblocks) >> 32) * FILTER_WORDS;
+}
+
+static inline void
+filter_mask(uint64_t key, uint64_t *mask)
+{
+	for (int i = 0; i < FILTER_WORDS; i++)
+		mask[i] = 1ULL << (((uint32_t)key * filter_salt[i]) >> 26);
+}
+
+bool
+chess_filter_contains(const struct chess_filter *filter, uint64_t key)
+{
+	uint64_t miss;
+	uint64_t mask[FILTER_WORDS];
+	const uint64_t *block;
+
+	block = filter_block(filter, key);
+	filter_mask(key, mask);
+
+	/* No early exit, the loop compiles to a few vector instructions */
+	miss = 0;
+	for (int i = 0; i < FILTER_WORDS; i++)
+		miss |= mask[i] & ~block[i];
+	return miss == 0;
+}
+
+bool
+chess_filter_insert(struct chess_filter *filter, uint64_t key)
+{
+	uint64_t miss;
+	uint64_t mask[FILTER_WORDS];
+	uint64_t *block;
+
+	block = filter_block(filter, key);
+	filter_mask(key, mask);
+
+	miss = 0;
+	for (int i = 0; i < FILTER_WORDS; i++) {
+		miss |= mask[i] & ~block[i];
+		block[i] |= mask[i];
+	}
+	if (miss == 0)
+		return true;
+	++filter->header->count;
+	return false;
+}
+
+size_t
+chess_filter_insert_batch(struct chess_filter *filter, const uint64_t *keys, size_t n, bool *held)
+{
+	bool h;
+	size_t count;
+
+	count = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (i + FILTER_PREFETCH < n)
+			__builtin_prefetch(filter_block(filter, keys[i + FILTER_PREFETCH]), 1);
+		h = chess_filter_insert(filter, keys[i]);
+		if (held != NULL)
+			held[i] = h;
+		count += !h;
+	}
+	return count;
+}
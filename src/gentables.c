@@ -0,0 +1,269 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * gentables: writes the attack and geometry tables of chess.c to the standard
+ * output as tables.h. The tables are derived from the moves of the pieces on
+ * the board and checked against properties they must have; the build fails if
+ * a check does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SQ(file, rank)	((rank) * 8 + (file))
+#define BIT(sq)		(1ULL << (sq))
+
+static unsigned long long pawn_attacks[2][64];
+static unsigned long long knight_attacks[64];
+static unsigned long long king_attacks[64];
+static unsigned long long bishop_rays[64];
+static unsigned long long rook_rays[64];
+static unsigned long long between[64][64];
+static unsigned long long line[64][64];
+static unsigned long long castle_empty[2][8][8];
+static unsigned long long castle_safe[2][8][8];
+
+static const int knight_steps[8][2] = {
+	{ 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 }, { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 },
+};
+
+/* Directions of the sliding pieces, rook directions first */
+static const int ray_steps[8][2] = {
+	{ 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 }, { 1, 1 }, { 1, -1 }, { -1, -1 }, { -1, 1 },
+};
+
+static int
+on_board(int file, int rank)
+{
+	return file >= 0 && file < 8 && rank >= 0 && rank < 8;
+}
+
+/* Squares from sq stepping (df, dr) up to the edge, with stop included if the
+ * ray reaches it first
+ */
+static unsigned long long
+ray(int sq, int df, int dr, int stop)
+{
+	int f, r;
+	unsigned long long b;
+
+	b = 0;
+	for (f = sq % 8 + df, r = sq / 8 + dr; on_board(f, r); f += df, r += dr) {
+		b |= BIT(SQ(f, r));
+		if (SQ(f, r) == stop)
+			break;
+	}
+	return b;
+}
+
+static int
+popcount(unsigned long long b)
+{
+	int n;
+
+	for (n = 0; b; n++)
+		b &= b - 1;
+	return n;
+}
+
+static void
+check(int ok, const char *what, int a, int b)
+{
+	if (!ok) {
+		fprintf(stderr, "gentables: check failed: %s (%d, %d)\n", what, a, b);
+		exit(1);
+	}
+}
+
+static void
+generate(void)
+{
+	int f, r, base, kto, rto;
+	unsigned long long b;
+
+	for (int sq = 0; sq < 64; sq++) {
+		f = sq % 8;
+		r = sq / 8;
+		for (int i = 0; i < 8; i++) {
+			if (on_board(f + knight_steps[i][0], r + knight_steps[i][1]))
+				knight_attacks[sq] |= BIT(SQ(f + knight_steps[i][0], r + knight_steps[i][1]));
+			if (on_board(f + ray_steps[i][0], r + ray_steps[i][1]))
+				king_attacks[sq] |= BIT(SQ(f + ray_steps[i][0], r + ray_steps[i][1]));
+			if (i < 4)
+				rook_rays[sq] |= ray(sq, ray_steps[i][0], ray_steps[i][1], -1);
+			else
+				bishop_rays[sq] |= ray(sq, ray_steps[i][0], ray_steps[i][1], -1);
+		}
+
+		/* Pawns on the last rank attack nothing */
+		for (int df = -1; df <= 1; df += 2) {
+			if (r < 7 && on_board(f + df, r + 1))
+				pawn_attacks[0][sq] |= BIT(SQ(f + df, r + 1));
+			if (r > 0 && on_board(f + df, r - 1))
+				pawn_attacks[1][sq] |= BIT(SQ(f + df, r - 1));
+		}
+	}
+
+	for (int a = 0; a < 64; a++) {
+		for (int i = 0; i < 8; i++) {
+			b = ray(a, ray_steps[i][0], ray_steps[i][1], -1);
+			for (int s = 0; s < 64; s++) {
+				if (!(b & BIT(s)))
+					continue;
+				between[a][s] = ray(a, ray_steps[i][0], ray_steps[i][1], s) & ~BIT(s);
+				line[a][s] = b | ray(a, -ray_steps[i][0], -ray_steps[i][1], -1) | BIT(a);
+			}
+		}
+	}
+
+	/* Chess960 castling: the king goes to the g or c file and the rook next
+	 * to it, all squares in between must be empty but for the two castling
+	 * pieces. The king must not be attacked on its way, besides its own
+	 * square.
+	 */
+	for (int side = 0; side < 2; side++) {
+		base = side == 0 ? 0 : 56;
+		for (int kfile = 0; kfile < 8; kfile++) {
+			for (int rfile = 0; rfile < 8; rfile++) {
+				if (kfile == rfile)
+					continue;
+				kto = base + (rfile > kfile ? 6 : 2);
+				rto = base + (rfile > kfile ? 5 : 3);
+				castle_safe[side][kfile][rfile] = between[base + kfile][kto] | BIT(kto);
+				castle_empty[side][kfile][rfile] = (between[base + kfile][kto] | BIT(kto)
+						| between[base + rfile][rto] | BIT(rto))
+					& ~(BIT(base + kfile) | BIT(base + rfile));
+			}
+		}
+	}
+}
+
+static void
+self_check(void)
+{
+	int n, knights, kings, pawns, bishops, rooks;
+
+	knights = kings = pawns = bishops = rooks = 0;
+	for (int a = 0; a < 64; a++) {
+		knights += popcount(knight_attacks[a]);
+		kings += popcount(king_attacks[a]);
+		pawns += popcount(pawn_attacks[0][a]) + popcount(pawn_attacks[1][a]);
+		bishops += popcount(bishop_rays[a]);
+		rooks += popcount(rook_rays[a]);
+		check(popcount(rook_rays[a]) == 14, "rook rays", a, 0);
+		check(!(knight_attacks[a] & BIT(a)) && !(king_attacks[a] & BIT(a)), "own square", a, 0);
+
+		for (int b = 0; b < 64; b++) {
+			/* Attacks are mutual, pawns' with the other side */
+			check(!(knight_attacks[a] & BIT(b)) == !(knight_attacks[b] & BIT(a)), "knight symmetry", a, b);
+			check(!(king_attacks[a] & BIT(b)) == !(king_attacks[b] & BIT(a)), "king symmetry", a, b);
+			check(!(pawn_attacks[0][a] & BIT(b)) == !(pawn_attacks[1][b] & BIT(a)), "pawn symmetry", a, b);
+
+			check(between[a][b] == between[b][a], "between symmetry", a, b);
+			check(line[a][b] == line[b][a], "line symmetry", a, b);
+			if (a == b || !((rook_rays[a] | bishop_rays[a]) & BIT(b))) {
+				check(!between[a][b] && !line[a][b], "unaligned squares", a, b);
+				continue;
+			}
+
+			/* Between holds the squares one step closer to b than a */
+			n = abs(a % 8 - b % 8) > abs(a / 8 - b / 8) ? abs(a % 8 - b % 8) : abs(a / 8 - b / 8);
+			check(popcount(between[a][b]) == n - 1, "between length", a, b);
+			check((line[a][b] & (BIT(a) | BIT(b) | between[a][b])) == (BIT(a) | BIT(b) | between[a][b]),
+					"line holds between", a, b);
+			check(popcount(line[a][b]) >= n + 1 && !(line[a][b] & ~BIT(a)
+						& ~((rook_rays[a] & BIT(b)) ? rook_rays[a] : bishop_rays[a])),
+					"line along the ray", a, b);
+		}
+	}
+	check(knights == 336, "knight moves", knights, 336);
+	check(kings == 420, "king moves", kings, 420);
+	check(pawns == 2 * 98, "pawn captures", pawns, 2 * 98);
+	check(bishops == 560, "bishop moves", bishops, 560);
+	check(rooks == 896, "rook moves", rooks, 896);
+
+	/* Standard castling: e1 with h1 and a1 */
+	check(castle_empty[0][4][7] == (BIT(5) | BIT(6)), "king side empty", 4, 7);
+	check(castle_safe[0][4][7] == (BIT(5) | BIT(6)), "king side safe", 4, 7);
+	check(castle_empty[0][4][0] == (BIT(1) | BIT(2) | BIT(3)), "queen side empty", 4, 0);
+	check(castle_safe[0][4][0] == (BIT(2) | BIT(3)), "queen side safe", 4, 0);
+	for (int kfile = 0; kfile < 8; kfile++)
+		for (int rfile = 0; rfile < 8; rfile++)
+			check(castle_empty[1][kfile][rfile] == castle_empty[0][kfile][rfile] << 56
+					&& castle_safe[1][kfile][rfile] == castle_safe[0][kfile][rfile] << 56,
+					"black castling", kfile, rfile);
+}
+
+/* Prints the array with the given dimensions, innermost rows four values a line */
+static const unsigned long long *
+print_array(const unsigned long long *table, const int *dims, int ndims)
+{
+	if (ndims == 1) {
+		for (int i = 0; i < dims[0]; i++)
+			printf("%s0x%016llxULL,", i % 4 ? " " : "\n\t", *table++);
+		return table;
+	}
+	for (int i = 0; i < dims[0]; i++) {
+		printf("\n{");
+		table = print_array(table, dims + 1, ndims - 1);
+		printf("\n},");
+	}
+	return table;
+}
+
+static void
+print_table(const char *name, const unsigned long long *table, const int *dims, int ndims)
+{
+	printf("static const unsigned long long %s", name);
+	for (int i = 0; i < ndims; i++)
+		printf("[%d]", dims[i]);
+	printf(" = {");
+	print_array(table, dims, ndims);
+	printf("\n};\n\n");
+}
+
+int
+main(void)
+{
+	generate();
+	self_check();
+
+	printf("/* Generated by gentables, do not edit */\n\n");
+	printf("#ifndef LIBCHESS_GUARD_TABLES_H\n#define LIBCHESS_GUARD_TABLES_H 1\n\n");
+	print_table("PAWN_ATTACKS", &pawn_attacks[0][0], (int[]){ 2, 64 }, 2);
+	print_table("KNIGHT_ATTACKS", knight_attacks, (int[]){ 64 }, 1);
+	print_table("KING_ATTACKS", king_attacks, (int[]){ 64 }, 1);
+	printf("/* Lines through the square on the empty board, without the square */\n");
+	print_table("BISHOP_RAYS", bishop_rays, (int[]){ 64 }, 1);
+	print_table("ROOK_RAYS", rook_rays, (int[]){ 64 }, 1);
+	printf("/* Squares strictly between two aligned squares, 0 if not aligned */\n");
+	print_table("BETWEEN", &between[0][0], (int[]){ 64, 64 }, 2);
+	printf("/* The whole line through two aligned squares, 0 if not aligned */\n");
+	print_table("LINE", &line[0][0], (int[]){ 64, 64 }, 2);
+	printf("/* Castling masks indexed by [side][king file][rook file]: squares that\n");
+	printf(" * must be empty and squares the king must not be attacked on, besides\n");
+	printf(" * its own.\n */\n");
+	print_table("CASTLE_EMPTY", &castle_empty[0][0][0], (int[]){ 2, 8, 8 }, 3);
+	print_table("CASTLE_SAFE", &castle_safe[0][0][0], (int[]){ 2, 8, 8 }, 3);
+	printf("#endif /* !LIBCHESS_GUARD_TABLES_H */\n");
+
+	return ferror(stdout) || fflush(stdout) != 0;
+}
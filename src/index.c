@@ -0,0 +1,668 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_index.h"
+
+#define INDEX_MAGIC		"LCHIDX01"
+#define INDEX_FENCE_STEP	256	/* Entries per fence, 8 KiB blocks */
+#define INDEX_IOBUF		(1 << 20)
+
+/* File layout: header, entries, game ids, fence keys */
+struct index_header {
+	char magic[8];
+	uint64_t nentries;
+	uint64_t ngames;
+	uint64_t entries;	/* Offsets from the beginning of the file */
+	uint64_t games;
+	uint64_t fences;
+	uint64_t nfences;
+	uint64_t fence_step;
+};
+
+/* An occurrence of a position, sorted by key then by game */
+struct index_record {
+	uint64_t key;
+	uint32_t game;
+	uint32_t result;
+};
+
+struct chess_index {
+	void *map;
+	size_t size;
+	const struct index_header *header;
+	const struct chess_index_entry *entries;
+	const uint32_t *games;
+	const uint64_t *fences;
+};
+
+struct chess_index_builder {
+	char *path;
+	unsigned nthreads;
+	struct index_record *records;	/* Current run */
+	struct index_record *tmp;	/* Scratch space for sorting */
+	size_t nrecords, maxrecords;
+	unsigned nruns;
+};
+
+/* Input of the k-way merge, either a sorted chunk in memory or a run file */
+struct merge_source {
+	const struct index_record *next, *end;
+	FILE *fp;
+	struct index_record cur;
+};
+
+struct sort_chunk {
+	struct index_record *records;
+	struct index_record *tmp;
+	size_t n;
+	int error;
+};
+
+struct chess_index *
+chess_index_open(const char *path)
+{
+	int fd, save_errno;
+	struct stat st;
+	struct chess_index *index;
+	const struct index_header *h;
+
+	index = calloc(1, sizeof(struct chess_index));
+	if (index == NULL)
+		return NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		goto fail;
+	if (fstat(fd, &st) < 0) {
+		save_errno = errno;
+		close(fd);
+		errno = save_errno;
+		goto fail;
+	}
+	if ((size_t)st.st_size < sizeof(struct index_header)) {
+		close(fd);
+		errno = EINVAL;
+		goto fail;
+	}
+
+	index->size = st.st_size;
+	index->map = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0);
+	save_errno = errno;
+	close(fd);
+	if (index->map == MAP_FAILED) {
+		errno = save_errno;
+		goto fail;
+	}
+	/* Lookups jump around, don't read ahead */
+	madvise(index->map, index->size, MADV_RANDOM);
+
+	h = index->header = index->map;
+	if (memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0
+			|| h->fence_step == 0
+			|| h->entries + h->nentries * sizeof(struct chess_index_entry) > index->size
+			|| h->games + h->ngames * sizeof(uint32_t) > index->size
+			|| h->fences + h->nfences * sizeof(uint64_t) > index->size
+			|| h->nfences != (h->nentries + h->fence_step - 1) / h->fence_step) {
+		munmap(index->map, index->size);
+		errno = EINVAL;
+		goto fail;
+	}
+
+	index->entries = (const struct chess_index_entry *)((const char *)index->map + h->entries);
+	index->games = (const uint32_t *)((const char *)index->map + h->games);
+	index->fences = (const uint64_t *)((const char *)index->map + h->fences);
+
+	return index;
+
+fail:
+	save_errno = errno;
+	free(index);
+	errno = save_errno;
+	return NULL;
+}
+
+void
+chess_index_close(struct chess_index *index)
+{
+	munmap(index->map, index->size);
+	free(index);
+}
+
+uint64_t
+chess_index_get_size(const struct chess_index *index)
+{
+	return index->header->nentries;
+}
+
+const struct chess_index_entry *
+chess_index_lookup(const struct chess_index *index, uint64_t key)
+{
+	uint64_t lo, hi, mid, n;
+
+	n = index->header->nfences;
+	if (n == 0 || key < index->fences[0])
+		return NULL;
+
+	/* Step 1: Find the block with the last fence key <= key */
+	lo = 0;
+	hi = n;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (index->fences[mid] <= key)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	/* Step 2: Binary search within the block */
+	hi = (lo + 1) * index->header->fence_step;
+	if (hi > index->header->nentries)
+		hi = index->header->nentries;
+	lo *= index->header->fence_step;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entries[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < index->header->nentries && index->entries[lo].key == key)
+		return &index->entries[lo];
+	return NULL;
+}
+
+const uint32_t *
+chess_index_get_games(const struct chess_index *index, const struct chess_index_entry *entry)
+{
+	return index->games + entry->games;
+}
+
+static char *
+builder_tmpname(const struct chess_index_builder *builder, const char *suffix, unsigned n)
+{
+	size_t len;
+	char *name;
+
+	len = strlen(builder->path) + strlen(suffix) + 16;
+	name = malloc(len);
+	if (name == NULL)
+		return NULL;
+	snprintf(name, len, "%s.%s%u", builder->path, suffix, n);
+	return name;
+}
+
+struct chess_index_builder *
+chess_index_builder_init(const char *path, size_t memory, unsigned nthreads)
+{
+	struct chess_index_builder *builder;
+
+	builder = calloc(1, sizeof(struct chess_index_builder));
+	if (builder == NULL)
+		return NULL;
+
+	builder->nthreads = nthreads ? nthreads : 1;
+	/* Half of the memory is used as scratch space by the radix sort */
+	builder->maxrecords = memory / (2 * sizeof(struct index_record));
+	if (builder->maxrecords < 1024)
+		builder->maxrecords = 1024;
+
+	builder->path = strdup(path);
+	builder->records = malloc(builder->maxrecords * sizeof(struct index_record));
+	builder->tmp = malloc(builder->maxrecords * sizeof(struct index_record));
+	if (builder->path == NULL || builder->records == NULL || builder->tmp == NULL) {
+		chess_index_builder_free(builder);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return builder;
+}
+
+void
+chess_index_builder_free(struct chess_index_builder *builder)
+{
+	char *name;
+
+	for (unsigned i = 0; i < builder->nruns; i++) {
+		if ((name = builder_tmpname(builder, "run", i)) != NULL) {
+			unlink(name);
+			free(name);
+		}
+	}
+	free(builder->records);
+	free(builder->tmp);
+	free(builder->path);
+	free(builder);
+}
+
+/* Stable LSD radix sort by key, 16 bits per pass */
+static void *
+sort_chunk_thread(void *arg)
+{
+	size_t *count, sum, c;
+	struct index_record *src, *dst, *swap;
+	struct sort_chunk *chunk = arg;
+
+	count = calloc(4 * 65536, sizeof(size_t));
+	if (count == NULL) {
+		chunk->error = ENOMEM;
+		return NULL;
+	}
+
+	for (size_t i = 0; i < chunk->n; i++) {
+		uint64_t key = chunk->records[i].key;
+		for (unsigned pass = 0; pass < 4; pass++)
+			++count[pass * 65536 + ((key >> (16 * pass)) & 0xffff)];
+	}
+
+	src = chunk->records;
+	dst = chunk->tmp;
+	for (unsigned pass = 0; pass < 4; pass++) {
+		size_t *cnt = count + pass * 65536;
+
+		sum = 0;
+		for (unsigned d = 0; d < 65536; d++) {
+			c = cnt[d];
+			cnt[d] = sum;
+			sum += c;
+		}
+		for (size_t i = 0; i < chunk->n; i++)
+			dst[cnt[(src[i].key >> (16 * pass)) & 0xffff]++] = src[i];
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	/* An even number of passes leaves the result in place */
+	assert(src == chunk->records);
+
+	free(count);
+	return NULL;
+}
+
+static bool
+source_next(struct merge_source *src)
+{
+	if (src->fp != NULL)
+		return fread(&src->cur, sizeof(struct index_record), 1, src->fp) == 1;
+	if (src->next == src->end)
+		return false;
+	src->cur = *src->next++;
+	return true;
+}
+
+/* Ties are broken by source order which keeps game ids ascending */
+static inline bool
+source_less(const struct merge_source *src, unsigned a, unsigned b)
+{
+	if (src[a].cur.key != src[b].cur.key)
+		return src[a].cur.key < src[b].cur.key;
+	return a < b;
+}
+
+static void
+heap_sift(unsigned *heap, unsigned n, unsigned i, const struct merge_source *src)
+{
+	unsigned child, tmp;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && source_less(src, heap[child + 1], heap[child]))
+			++child;
+		if (!source_less(src, heap[child], heap[i]))
+			break;
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+/* Sorts the current run using all threads, returns the number of chunks */
+static int
+builder_sort(struct chess_index_builder *builder, struct sort_chunk *chunks)
+{
+	unsigned n;
+	size_t per, off;
+	bool *started;
+	pthread_t *threads;
+
+	n = builder->nthreads;
+	if (builder->nrecords < (size_t)n * 4096)
+		n = 1;
+	per = (builder->nrecords + n - 1) / n;
+
+	threads = calloc(n, sizeof(pthread_t));
+	started = calloc(n, sizeof(bool));
+	if (threads == NULL || started == NULL) {
+		free(threads);
+		free(started);
+		return -1;
+	}
+
+	off = 0;
+	for (unsigned i = 0; i < n; i++) {
+		chunks[i].records = builder->records + off;
+		chunks[i].tmp = builder->tmp + off;
+		chunks[i].n = (builder->nrecords - off < per) ? builder->nrecords - off : per;
+		chunks[i].error = 0;
+		off += chunks[i].n;
+		if (i > 0)
+			started[i] = (pthread_create(&threads[i], NULL, sort_chunk_thread, &chunks[i]) == 0);
+	}
+	/* Sort the first chunk and those we couldn't start a thread for here */
+	for (unsigned i = 0; i < n; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			sort_chunk_thread(&chunks[i]);
+	}
+	free(threads);
+	free(started);
+
+	for (unsigned i = 0; i < n; i++) {
+		if (chunks[i].error) {
+			errno = chunks[i].error;
+			return -1;
+		}
+	}
+	return n;
+}
+
+/* Spills the current run to a temporary file */
+static int
+builder_spill(struct chess_index_builder *builder)
+{
+	int n, ret, save_errno;
+	unsigned *heap, top;
+	char *name;
+	FILE *fp;
+	struct sort_chunk *chunks;
+	struct merge_source *src;
+
+	chunks = calloc(builder->nthreads, sizeof(struct sort_chunk));
+	src = calloc(builder->nthreads, sizeof(struct merge_source));
+	heap = calloc(builder->nthreads, sizeof(unsigned));
+	name = builder_tmpname(builder, "run", builder->nruns);
+	fp = NULL;
+	ret = -1;
+	if (chunks == NULL || src == NULL || heap == NULL || name == NULL)
+		goto out;
+	if ((n = builder_sort(builder, chunks)) < 0)
+		goto out;
+
+	fp = fopen(name, "wb");
+	if (fp == NULL)
+		goto out;
+	setvbuf(fp, NULL, _IOFBF, INDEX_IOBUF);
+	++builder->nruns;
+
+	/* Merge the sorted chunks into the run file */
+	top = 0;
+	for (int i = 0; i < n; i++) {
+		src[i].next = chunks[i].records;
+		src[i].end = chunks[i].records + chunks[i].n;
+		if (source_next(&src[i]))
+			heap[top++] = i;
+	}
+	for (unsigned i = top; i-- > 0;)
+		heap_sift(heap, top, i, src);
+	while (top > 0) {
+		if (fwrite(&src[heap[0]].cur, sizeof(struct index_record), 1, fp) != 1)
+			goto out;
+		if (!source_next(&src[heap[0]]))
+			heap[0] = heap[--top];
+		heap_sift(heap, top, 0, src);
+	}
+
+	builder->nrecords = 0;
+	ret = 0;
+out:
+	save_errno = errno;
+	if (fp != NULL && fclose(fp) != 0 && ret == 0) {
+		save_errno = errno;
+		ret = -1;
+	}
+	free(chunks);
+	free(src);
+	free(heap);
+	free(name);
+	errno = save_errno;
+	return ret;
+}
+
+int
+chess_index_builder_add(struct chess_index_builder *builder, uint64_t key, uint32_t game, int result)
+{
+	struct index_record *rec;
+
+	assert(result >= CHESS_RESULT_WHITE_WINS && result <= CHESS_RESULT_UNKNOWN);
+
+	if (builder->nrecords == builder->maxrecords && builder_spill(builder) < 0)
+		return -1;
+
+	rec = &builder->records[builder->nrecords++];
+	rec->key = key;
+	rec->game = game;
+	rec->result = result;
+	return 0;
+}
+
+static int
+copy_file(FILE *out, FILE *in)
+{
+	size_t n;
+	char buf[65536];
+
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		if (fwrite(buf, 1, n, out) != n)
+			return -1;
+	}
+	return ferror(in) ? -1 : 0;
+}
+
+static int
+push_fence(uint64_t **fences, size_t *cap, uint64_t n, uint64_t key)
+{
+	if (n == *cap) {
+		size_t newcap = *cap ? *cap * 2 : 1024;
+		uint64_t *f = realloc(*fences, newcap * sizeof(uint64_t));
+		if (f == NULL)
+			return -1;
+		*fences = f;
+		*cap = newcap;
+	}
+	(*fences)[n] = key;
+	return 0;
+}
+
+int
+chess_index_builder_finish(struct chess_index_builder *builder)
+{
+	int n, ret, save_errno;
+	unsigned nsrc, top, *heap;
+	uint32_t last_game;
+	uint64_t *fences;
+	size_t fencecap;
+	long pad;
+	char *name, *gname;
+	FILE *fp, *gfp;
+	struct sort_chunk *chunks;
+	struct merge_source *src;
+	struct index_header header;
+	struct chess_index_entry entry;
+	const struct index_record *rec;
+
+	ret = -1;
+	fp = gfp = NULL;
+	fences = NULL;
+	fencecap = 0;
+	nsrc = builder->nruns + builder->nthreads;
+	chunks = calloc(builder->nthreads, sizeof(struct sort_chunk));
+	src = calloc(nsrc, sizeof(struct merge_source));
+	heap = calloc(nsrc, sizeof(unsigned));
+	gname = builder_tmpname(builder, "games", 0);
+	if (chunks == NULL || src == NULL || heap == NULL || gname == NULL)
+		goto out;
+
+	/* Step 1: Sort the last run in memory, earlier runs are read back */
+	if ((n = builder_sort(builder, chunks)) < 0)
+		goto out;
+	for (unsigned i = 0; i < builder->nruns; i++) {
+		if ((name = builder_tmpname(builder, "run", i)) == NULL)
+			goto out;
+		src[i].fp = fopen(name, "rb");
+		free(name);
+		if (src[i].fp == NULL)
+			goto out;
+		setvbuf(src[i].fp, NULL, _IOFBF, INDEX_IOBUF);
+	}
+	for (int i = 0; i < n; i++) {
+		src[builder->nruns + i].next = chunks[i].records;
+		src[builder->nruns + i].end = chunks[i].records + chunks[i].n;
+	}
+	nsrc = builder->nruns + n;
+	top = 0;
+	for (unsigned i = 0; i < nsrc; i++) {
+		if (source_next(&src[i]))
+			heap[top++] = i;
+	}
+	for (unsigned i = top; i-- > 0;)
+		heap_sift(heap, top, i, src);
+
+	/* Step 2: Merge, writing entries to the index and game ids aside */
+	fp = fopen(builder->path, "w+b");
+	gfp = fopen(gname, "w+b");
+	if (fp == NULL || gfp == NULL)
+		goto out;
+	setvbuf(fp, NULL, _IOFBF, INDEX_IOBUF);
+	setvbuf(gfp, NULL, _IOFBF, INDEX_IOBUF);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.fence_step = INDEX_FENCE_STEP;
+	header.entries = sizeof(header);
+	if (fwrite(&header, sizeof(header), 1, fp) != 1)
+		goto out;
+
+	memset(&entry, 0, sizeof(entry));
+	last_game = 0;
+	while (top > 0) {
+		rec = &src[heap[0]].cur;
+		if (entry.ngames == 0 || rec->key != entry.key) {
+			if (entry.ngames > 0) {
+				if (fwrite(&entry, sizeof(entry), 1, fp) != 1)
+					goto out;
+				++header.nentries;
+			}
+			if (header.nentries % INDEX_FENCE_STEP == 0) {
+				if (push_fence(&fences, &fencecap, header.nfences, rec->key) < 0)
+					goto out;
+				++header.nfences;
+			}
+			memset(&entry, 0, sizeof(entry));
+			entry.key = rec->key;
+			entry.games = header.ngames;
+		}
+
+		/* A game is counted once no matter how often the position occurred */
+		if (entry.ngames == 0 || rec->game != last_game) {
+			if (fwrite(&rec->game, sizeof(uint32_t), 1, gfp) != 1)
+				goto out;
+			last_game = rec->game;
+			++header.ngames;
+			++entry.ngames;
+			if (rec->result < CHESS_RESULT_UNKNOWN)
+				++entry.count[rec->result];
+		}
+
+		if (!source_next(&src[heap[0]]))
+			heap[0] = heap[--top];
+		heap_sift(heap, top, 0, src);
+	}
+	if (entry.ngames > 0) {
+		if (fwrite(&entry, sizeof(entry), 1, fp) != 1)
+			goto out;
+		++header.nentries;
+	}
+	for (unsigned i = 0; i < builder->nruns; i++) {
+		if (ferror(src[i].fp))
+			goto out;
+	}
+
+	/* Step 3: Append game ids and fences, then fill in the header */
+	header.games = header.entries + header.nentries * sizeof(struct chess_index_entry);
+	if (fflush(gfp) != 0 || fseek(gfp, 0, SEEK_SET) != 0 || copy_file(fp, gfp) < 0)
+		goto out;
+	header.fences = header.games + header.ngames * sizeof(uint32_t);
+	pad = (8 - header.fences % 8) % 8;
+	header.fences += pad;
+	while (pad-- > 0) {
+		if (fputc(0, fp) == EOF)
+			goto out;
+	}
+	if (header.nfences > 0 && fwrite(fences, sizeof(uint64_t), header.nfences, fp) != header.nfences)
+		goto out;
+	if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1)
+		goto out;
+
+	ret = 0;
+out:
+	save_errno = errno;
+	if (fp != NULL && fclose(fp) != 0 && ret == 0) {
+		save_errno = errno;
+		ret = -1;
+	}
+	if (ret < 0)
+		unlink(builder->path);
+	if (gfp != NULL) {
+		fclose(gfp);
+		unlink(gname);
+	}
+	for (unsigned i = 0; src != NULL && i < builder->nruns; i++) {
+		if (src[i].fp != NULL)
+			fclose(src[i].fp);
+	}
+	free(chunks);
+	free(src);
+	free(heap);
+	free(gname);
+	free(fences);
+	chess_index_builder_free(builder);
+	errno = save_errno;
+	return ret;
+}
@@ -0,0 +1,347 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <assert.h>
+#include <sys/types.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chess.h"
+#include "chess_pgn.h"
+
+struct pgn_tag {
+	char *name;
+	char *value;
+};
+
+struct chess_pgn {
+	FILE *fp;
+	char *line;			/**< Current line */
+	size_t linecap;			/**< Allocated size of the line */
+	bool pending;			/**< Line is read but not consumed yet */
+
+	struct pgn_tag *tags;		/**< Tag pairs of the last game */
+	unsigned ntags, tagcap;
+
+	unsigned *moves;		/**< Main line of the last game */
+	struct chess_undo *undo;	/**< Used to return to the starting position */
+	unsigned nmoves, movecap;
+
+	int result;			/**< Result of the last game */
+};
+
+struct chess_pgn *
+chess_pgn_init(FILE *fp)
+{
+	struct chess_pgn *pgn;
+
+	pgn = calloc(1, sizeof(struct chess_pgn));
+	if (pgn == NULL)
+		return NULL;
+
+	pgn->fp = fp;
+	pgn->result = CHESS_RESULT_UNKNOWN;
+
+	return pgn;
+}
+
+static void
+pgn_clear(struct chess_pgn *pgn)
+{
+	for (unsigned i = 0; i < pgn->ntags; i++) {
+		free(pgn->tags[i].name);
+		free(pgn->tags[i].value);
+	}
+	pgn->ntags = 0;
+	pgn->nmoves = 0;
+	pgn->result = CHESS_RESULT_UNKNOWN;
+}
+
+void
+chess_pgn_free(struct chess_pgn *pgn)
+{
+	pgn_clear(pgn);
+	free(pgn->tags);
+	free(pgn->moves);
+	free(pgn->undo);
+	free(pgn->line);
+	free(pgn);
+}
+
+static bool
+pgn_getline(struct chess_pgn *pgn)
+{
+	if (pgn->pending) {
+		pgn->pending = false;
+		return true;
+	}
+	return getline(&pgn->line, &pgn->linecap, pgn->fp) >= 0;
+}
+
+/* Parses a tag pair line: [Name "Value"] */
+static int
+pgn_add_tag(struct chess_pgn *pgn, const char *line)
+{
+	size_t len;
+	const char *p, *name;
+	char *value, *v;
+
+	p = line + 1;
+	while (isspace((unsigned char)*p))
+		++p;
+	name = p;
+	while (*p != '\0' && !isspace((unsigned char)*p) && *p != '"')
+		++p;
+	len = p - name;
+	while (isspace((unsigned char)*p))
+		++p;
+	if (len == 0 || *p != '"')
+		return 0; /* Ignore malformed tags */
+	++p;
+
+	if (pgn->ntags == pgn->tagcap) {
+		unsigned cap = pgn->tagcap ? pgn->tagcap * 2 : 16;
+		struct pgn_tag *tags = realloc(pgn->tags, cap * sizeof(struct pgn_tag));
+		if (tags == NULL)
+			return -1;
+		pgn->tags = tags;
+		pgn->tagcap = cap;
+	}
+
+	value = malloc(strlen(p) + 1);
+	if (value == NULL)
+		return -1;
+	for (v = value; *p != '\0' && *p != '"'; p++) {
+		if (*p == '\\' && p[1] != '\0')
+			++p;
+		*v++ = *p;
+	}
+	*v = '\0';
+
+	pgn->tags[pgn->ntags].name = strndup(name, len);
+	if (pgn->tags[pgn->ntags].name == NULL) {
+		free(value);
+		return -1;
+	}
+	pgn->tags[pgn->ntags++].value = value;
+	return 0;
+}
+
+static int
+pgn_add_move(struct chess_pgn *pgn, struct chess_board *board, unsigned move)
+{
+	if (pgn->nmoves == pgn->movecap) {
+		unsigned cap = pgn->movecap ? pgn->movecap * 2 : 256;
+		unsigned *moves;
+		struct chess_undo *undo;
+
+		moves = realloc(pgn->moves, cap * sizeof(unsigned));
+		if (moves == NULL)
+			return -1;
+		pgn->moves = moves;
+		undo = realloc(pgn->undo, cap * sizeof(struct chess_undo));
+		if (undo == NULL)
+			return -1;
+		pgn->undo = undo;
+		pgn->movecap = cap;
+	}
+
+	chess_board_make_move(board, move, &pgn->undo[pgn->nmoves]);
+	pgn->moves[pgn->nmoves++] = move;
+	return 0;
+}
+
+static int
+pgn_result(const char *token)
+{
+	if (strcmp(token, "1-0") == 0)
+		return CHESS_RESULT_WHITE_WINS;
+	if (strcmp(token, "0-1") == 0)
+		return CHESS_RESULT_BLACK_WINS;
+	if (strcmp(token, "1/2-1/2") == 0)
+		return CHESS_RESULT_DRAW;
+	if (strcmp(token, "*") == 0)
+		return CHESS_RESULT_UNKNOWN;
+	return -1;
+}
+
+int
+chess_pgn_read_game(struct chess_pgn *pgn, struct chess_board *board)
+{
+	int ret, result;
+	unsigned move, comment, variation;
+	size_t len;
+	bool movetext, bad, done;
+	const char *fen, *start, *p;
+	char *token;
+	char buf[64];
+
+	pgn_clear(pgn);
+
+	/* Step 1: Tag pairs */
+	movetext = false;
+	for (;;) {
+		if (!pgn_getline(pgn)) {
+			if (ferror(pgn->fp))
+				return -1;
+			if (pgn->ntags == 0)
+				return 0;
+			break;
+		}
+		p = pgn->line;
+		while (isspace((unsigned char)*p))
+			++p;
+		if (*p == '\0' || *p == '%')
+			continue;
+		if (*p != '[') {
+			pgn->pending = true;
+			movetext = true;
+			break;
+		}
+		if (pgn_add_tag(pgn, p) < 0)
+			return -1;
+	}
+
+	fen = chess_pgn_get_tag(pgn, "FEN");
+	bad = !chess_board_set_fen(board, fen ? fen : CHESS_FEN_STARTPOS);
+
+	/* Step 2: Movetext */
+	comment = variation = 0;
+	done = !movetext;
+	while (!done && pgn_getline(pgn)) {
+		p = pgn->line;
+		if (comment == 0 && variation == 0 && *p == '[') {
+			/* Next game without a game termination marker */
+			pgn->pending = true;
+			break;
+		}
+		if (*p == '%')
+			continue;
+
+		while (*p != '\0' && !done) {
+			if (comment) {
+				if (*p++ == '}')
+					--comment;
+				continue;
+			}
+			if (*p == '{') {
+				++comment;
+				++p;
+				continue;
+			}
+			if (*p == ';')
+				break;
+			if (*p == '(') {
+				++variation;
+				++p;
+				continue;
+			}
+			if (*p == ')') {
+				if (variation)
+					--variation;
+				++p;
+				continue;
+			}
+			if (isspace((unsigned char)*p)) {
+				++p;
+				continue;
+			}
+
+			start = p;
+			while (*p != '\0' && !isspace((unsigned char)*p) && strchr("{}();", *p) == NULL)
+				++p;
+			len = p - start;
+			if (len >= sizeof(buf)) {
+				bad = true;
+				continue;
+			}
+			memcpy(buf, start, len);
+			buf[len] = '\0';
+			token = buf;
+
+			if ((result = pgn_result(token)) >= 0) {
+				if (variation == 0) {
+					pgn->result = result;
+					done = true;
+				}
+				continue;
+			}
+			if (variation || bad || *token == '$')
+				continue;
+
+			/* Move number indication: 12. or 12... possibly followed by a move */
+			len = strspn(token, "0123456789");
+			if (len > 0 && (token[len] == '.' || token[len] == '\0')) {
+				token += len;
+				while (*token == '.')
+					++token;
+				if (*token == '\0')
+					continue;
+			}
+
+			move = chess_board_parse_san(board, token);
+			if (move == CHESS_MOVE_NONE)
+				bad = true;
+			else if (pgn_add_move(pgn, board, move) < 0)
+				return -1;
+		}
+	}
+
+	if (ferror(pgn->fp))
+		return -1;
+
+	/* Return to the starting position */
+	for (unsigned i = pgn->nmoves; i > 0; i--)
+		chess_board_unmake_move(board, pgn->moves[i - 1], &pgn->undo[i - 1]);
+
+	ret = 1;
+	if (bad) {
+		errno = EINVAL;
+		ret = -1;
+	}
+	return ret;
+}
+
+const unsigned *
+chess_pgn_get_moves(const struct chess_pgn *pgn, unsigned *nmoves)
+{
+	*nmoves = pgn->nmoves;
+	return pgn->moves;
+}
+
+int
+chess_pgn_get_result(const struct chess_pgn *pgn)
+{
+	return pgn->result;
+}
+
+const char *
+chess_pgn_get_tag(const struct chess_pgn *pgn, const char *name)
+{
+	for (unsigned i = 0; i < pgn->ntags; i++) {
+		if (strcmp(pgn->tags[i].name, name) == 0)
+			return pgn->tags[i].value;
+	}
+	return NULL;
+}
@@ -0,0 +1,934 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_eval.h"
+#include "chess_private.h"
+#include "chess_search.h"
+
+#define SCORE_INFINITE (CHESS_SCORE_MATE + 1)
+
+/* History scores are halved when one reaches this */
+#define HISTORY_MAX	(1 << 20)
+
+enum tt_bound {
+	BOUND_NONE = 0,
+	BOUND_UPPER,
+	BOUND_LOWER,
+	BOUND_EXACT,
+};
+
+/* Transposition table entries are two words written with plain atomic stores,
+ * the key is stored xored with the data so that an entry torn by concurrent
+ * writers, possibly in other processes, fails the key check. The data carries
+ * the generation of the search that stored it.
+ */
+struct tt_entry {
+	uint64_t check;		/**< Key xor data */
+	uint64_t data;		/**< Move, score, depth, bound and generation */
+};
+
+#define TT_DATA(move, score, depth, bound, generation)			\
+	((uint64_t)(move) | (uint64_t)(uint16_t)(score) << 24		\
+	 | (uint64_t)(depth) << 40 | (uint64_t)(bound) << 48		\
+	 | (uint64_t)(generation) << 56)
+#define TT_MOVE(data)		((unsigned)((data) & 0xffffff))
+#define TT_SCORE(data)		((int)(int16_t)((data) >> 24))
+#define TT_DEPTH(data)		((int)(((data) >> 40) & 0xff))
+#define TT_BOUND(data)		((int)(((data) >> 48) & 0xff))
+#define TT_GENERATION(data)	((unsigned)((data) >> 56))
+
+/* The table is preceded by this header, in shared memory it is the same for
+ * all processes attached. Counters are added at the end of every search.
+ */
+#define TT_MAGIC "LCHESSTT"
+#define TT_VERSION 1
+
+struct tt_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t generation;	/**< Bumped by every search */
+	uint64_t size;		/**< Number of entries, a power of two */
+	uint64_t probes, hits, stores, overwrites;
+} __attribute__((aligned(64)));
+
+/* State of a background search, the searching thread posts every completed
+ * iteration and the notifier thread passes the last one posted to the
+ * callback, so a slow callback skips iterations instead of holding the search.
+ */
+struct search_async {
+	pthread_t thread, notifier;
+	struct chess_board *board;	/**< Copy of the caller's board */
+	void (*callback)(const struct chess_search_info *lines, unsigned nlines, void *data);
+	void *data;
+	unsigned nlines;
+	struct chess_search_info *lines;	/**< Result, nlines structures */
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool pending, done;
+	unsigned nposted;
+	struct chess_search_info *posted;	/**< Last iteration not yet delivered */
+	struct chess_search_info *delivered;	/**< Iteration being passed to the callback */
+};
+
+struct chess_search {
+	struct tt_header *header;
+	struct tt_entry *table;		/**< Transposition table, right after the header */
+	size_t mask;			/**< Number of entries minus one */
+	size_t mapsize;			/**< Size of the shared memory mapping or 0 */
+	uint64_t probes, hits, stores, overwrites;
+	unsigned generation;
+
+	struct chess_search_limits limits;
+	struct timespec start;
+	unsigned long long nodes;
+	unsigned long long nodebase;	/**< Nodes searched before the ponder hit */
+	unsigned rootdepth;
+	bool stopped;
+
+	struct search_async *async;	/**< Background search or NULL */
+	int abort;			/**< Set by chess_search_stop() */
+	int pondering;			/**< Cleared by chess_search_ponderhit() */
+	bool ponder;			/**< Whether the searching thread still ponders */
+
+	/* Root moves of the better lines of the current multi-PV iteration */
+	unsigned excluded[CHESS_MOVES_MAX];
+	unsigned nexcluded;
+	struct chess_search_info lines[CHESS_MOVES_MAX];
+
+	unsigned killers[CHESS_SEARCH_DEPTH_MAX + 1][2];
+	int history[2][64][64];
+	unsigned pv[CHESS_SEARCH_DEPTH_MAX + 1][CHESS_SEARCH_DEPTH_MAX + 1];
+	unsigned npv[CHESS_SEARCH_DEPTH_MAX + 1];
+};
+
+/* Largest power of two number of entries fitting in memory */
+static size_t
+tt_entries(size_t memory)
+{
+	size_t n;
+
+	for (n = 1; n * 2 * sizeof(struct tt_entry) <= memory; n *= 2)
+		;
+	return n;
+}
+
+struct chess_search *
+chess_search_init(size_t memory)
+{
+	size_t n;
+	struct chess_search *search;
+
+	search = calloc(1, sizeof(struct chess_search));
+	if (search == NULL)
+		return NULL;
+
+	n = tt_entries(memory);
+	search->header = calloc(1, sizeof(struct tt_header) + n * sizeof(struct tt_entry));
+	if (search->header == NULL) {
+		free(search);
+		errno = ENOMEM;
+		return NULL;
+	}
+	memcpy(search->header->magic, TT_MAGIC, sizeof(search->header->magic));
+	search->header->version = TT_VERSION;
+	search->header->size = n;
+	search->table = (struct tt_entry *)(search->header + 1);
+	search->mask = n - 1;
+
+	return search;
+}
+
+/* Maps the segment once its creator has sized and stamped it */
+static struct tt_header *
+tt_attach(int fd, size_t *mapsize)
+{
+	struct stat st;
+	struct tt_header *header;
+	const struct timespec delay = { 0, 1000000 };
+
+	for (int tries = 0; tries < 1000; tries++) {
+		if (fstat(fd, &st) < 0)
+			return NULL;
+		if ((size_t)st.st_size >= sizeof(struct tt_header)) {
+			header = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (header == MAP_FAILED)
+				return NULL;
+			if (__atomic_load_n(&header->version, __ATOMIC_ACQUIRE) != 0) {
+				if (header->version != TT_VERSION
+						|| memcmp(header->magic, TT_MAGIC, sizeof(header->magic)) != 0
+						|| header->size == 0 || (header->size & (header->size - 1)) != 0
+						|| (size_t)st.st_size != sizeof(struct tt_header)
+							+ header->size * sizeof(struct tt_entry)) {
+					munmap(header, st.st_size);
+					errno = EINVAL;
+					return NULL;
+				}
+				*mapsize = st.st_size;
+				return header;
+			}
+			munmap(header, st.st_size);
+		}
+		nanosleep(&delay, NULL);
+	}
+	errno = EAGAIN;
+	return NULL;
+}
+
+struct chess_search *
+chess_search_init_shared(const char *name, size_t memory, int flags)
+{
+	int fd, save_errno;
+	size_t n, mapsize;
+	bool created;
+	struct tt_header *header;
+	struct chess_search *search;
+
+	search = calloc(1, sizeof(struct chess_search));
+	if (search == NULL)
+		return NULL;
+
+	created = !(flags & CHESS_SEARCH_SHARED_EXISTING);
+	fd = created ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) : -1;
+	if (!created || (fd < 0 && errno == EEXIST)) {
+		created = false;
+		fd = shm_open(name, O_RDWR, 0600);
+	}
+	if (fd < 0)
+		goto fail;
+
+	if (created) {
+		n = tt_entries(memory);
+		mapsize = sizeof(struct tt_header) + n * sizeof(struct tt_entry);
+		if (ftruncate(fd, mapsize) < 0)
+			goto fail_unlink;
+		header = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (header == MAP_FAILED)
+			goto fail_unlink;
+#ifdef MADV_HUGEPAGE
+		if (flags & CHESS_SEARCH_SHARED_HUGEPAGES)
+			madvise(header, mapsize, MADV_HUGEPAGE);
+#endif
+		/* The new segment is zero filled, the version is stored last to
+		 * tell attaching processes that it is ready.
+		 */
+		memcpy(header->magic, TT_MAGIC, sizeof(header->magic));
+		header->size = n;
+		__atomic_store_n(&header->version, TT_VERSION, __ATOMIC_RELEASE);
+	}
+	else {
+		header = tt_attach(fd, &mapsize);
+		if (header == NULL)
+			goto fail;
+#ifdef MADV_HUGEPAGE
+		if (flags & CHESS_SEARCH_SHARED_HUGEPAGES)
+			madvise(header, mapsize, MADV_HUGEPAGE);
+#endif
+	}
+	close(fd);
+
+	search->header = header;
+	search->table = (struct tt_entry *)(header + 1);
+	search->mask = header->size - 1;
+	search->mapsize = mapsize;
+	return search;
+
+fail_unlink:
+	save_errno = errno;
+	shm_unlink(name);
+	errno = save_errno;
+fail:
+	save_errno = errno;
+	if (fd >= 0)
+		close(fd);
+	free(search);
+	errno = save_errno;
+	return NULL;
+}
+
+int
+chess_search_unlink_shared(const char *name)
+{
+	return shm_unlink(name);
+}
+
+void
+chess_search_free(struct chess_search *search)
+{
+	if (search->async != NULL) {
+		chess_search_stop(search);
+		chess_search_wait(search, NULL);
+	}
+	if (search->mapsize)
+		munmap(search->header, search->mapsize);
+	else
+		free(search->header);
+	free(search);
+}
+
+void
+chess_search_clear(struct chess_search *search)
+{
+	memset(search->table, 0, (search->mask + 1) * sizeof(struct tt_entry));
+	memset(search->killers, 0, sizeof(search->killers));
+	memset(search->history, 0, sizeof(search->history));
+}
+
+void
+chess_search_get_table_stats(const struct chess_search *search, struct chess_search_table_stats *stats)
+{
+	const struct tt_header *header = search->header;
+	uint64_t check, data;
+	unsigned generation;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->size = header->size;
+	stats->shared = search->mapsize != 0;
+	generation = __atomic_load_n(&header->generation, __ATOMIC_RELAXED) & 0xff;
+	for (size_t i = 0; i <= search->mask; i++) {
+		check = __atomic_load_n(&search->table[i].check, __ATOMIC_RELAXED);
+		data = __atomic_load_n(&search->table[i].data, __ATOMIC_RELAXED);
+		if (TT_BOUND(data) == BOUND_NONE)
+			continue;
+		++stats->used;
+		if (TT_GENERATION(data) == generation)
+			++stats->current;
+		/* A torn entry hashes its key to another slot */
+		if (((check ^ data) & search->mask) != i)
+			++stats->torn;
+	}
+	stats->searches = __atomic_load_n(&header->generation, __ATOMIC_RELAXED);
+	stats->probes = __atomic_load_n(&header->probes, __ATOMIC_RELAXED);
+	stats->hits = __atomic_load_n(&header->hits, __ATOMIC_RELAXED);
+	stats->stores = __atomic_load_n(&header->stores, __ATOMIC_RELAXED);
+	stats->overwrites = __atomic_load_n(&header->overwrites, __ATOMIC_RELAXED);
+}
+
+static inline bool
+tt_probe(struct chess_search *search, uint64_t key, uint64_t *data)
+{
+	const struct tt_entry *entry;
+	uint64_t check, d;
+
+	entry = &search->table[key & search->mask];
+	check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+	d = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+	++search->probes;
+	if ((check ^ d) != key || TT_BOUND(d) == BOUND_NONE)
+		return false;
+	++search->hits;
+	*data = d;
+	return true;
+}
+
+static inline void
+tt_store(struct chess_search *search, uint64_t key, unsigned move, int score, int depth, int bound)
+{
+	struct tt_entry *entry;
+	uint64_t check, data;
+
+	entry = &search->table[key & search->mask];
+	check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+	data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+	if (TT_BOUND(data) != BOUND_NONE && (check ^ data) != key)
+		++search->overwrites;
+	++search->stores;
+
+	data = TT_DATA(move, score, depth, bound, search->generation);
+	__atomic_store_n(&entry->check, key ^ data, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->data, data, __ATOMIC_RELAXED);
+}
+
+static unsigned long
+search_elapsed(const struct chess_search *search)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long)((now.tv_sec - search->start.tv_sec) * 1000
+			+ (now.tv_nsec - search->start.tv_nsec) / 1000000);
+}
+
+/* The limits apply from the ponder hit on, as if the search started then */
+static inline bool
+search_pondering(struct chess_search *search)
+{
+	if (!search->ponder)
+		return false;
+	if (__atomic_load_n(&search->pondering, __ATOMIC_ACQUIRE))
+		return true;
+	search->ponder = false;
+	search->nodebase = search->nodes;
+	clock_gettime(CLOCK_MONOTONIC, &search->start);
+	return false;
+}
+
+static inline bool
+search_nodes_exhausted(const struct chess_search *search)
+{
+	return search->limits.nodes && search->nodes - search->nodebase >= search->limits.nodes;
+}
+
+static inline bool
+search_should_stop(struct chess_search *search)
+{
+	if (search->stopped)
+		return true;
+	if (search->rootdepth <= 1)
+		return false; /* Complete the first iteration to have a move */
+
+	/* The stop flag is checked at every node to stop within a millisecond */
+	if (__atomic_load_n(&search->abort, __ATOMIC_RELAXED))
+		search->stopped = true;
+	else if (search_pondering(search))
+		return false;
+	else if (search_nodes_exhausted(search))
+		search->stopped = true;
+	else if (search->limits.time && (search->nodes & 1023) == 0
+			&& search_elapsed(search) >= search->limits.time)
+		search->stopped = true;
+	return search->stopped;
+}
+
+/* Mate scores are stored relative to the node, not to the root */
+static inline int
+tt_score_to(int score, unsigned ply)
+{
+	if (score >= CHESS_SCORE_MATE_BOUND)
+		return score + ply;
+	if (score <= -CHESS_SCORE_MATE_BOUND)
+		return score - ply;
+	return score;
+}
+
+static inline int
+tt_score_from(int score, unsigned ply)
+{
+	if (score >= CHESS_SCORE_MATE_BOUND)
+		return score - ply;
+	if (score <= -CHESS_SCORE_MATE_BOUND)
+		return score + ply;
+	return score;
+}
+
+static inline bool
+search_is_excluded(const struct chess_search *search, unsigned move)
+{
+	for (unsigned i = 0; i < search->nexcluded; i++)
+		if (search->excluded[i] == move)
+			return true;
+	return false;
+}
+
+static inline int
+move_captured(const struct chess_board *board, unsigned move)
+{
+	if (chess_move_flags(move) & CHESS_MOVE_FLAG_ENPASSANT)
+		return CHESS_PIECE_PAWN;
+	if (chess_move_flags(move) & CHESS_MOVE_FLAG_CASTLE)
+		return 0;
+	return board->cboard[chess_move_to(move)];
+}
+
+static inline bool
+move_is_tactical(const struct chess_board *board, unsigned move)
+{
+	return move_captured(board, move) || chess_move_promotion(move) == CHESS_PIECE_QUEEN;
+}
+
+static void
+search_update_quiet(struct chess_search *search, const struct chess_board *board,
+		unsigned move, int depth, unsigned ply)
+{
+	int *h;
+
+	if (search->killers[ply][0] != move) {
+		search->killers[ply][1] = search->killers[ply][0];
+		search->killers[ply][0] = move;
+	}
+
+	h = &search->history[board->side][chess_move_from(move)][chess_move_to(move)];
+	*h += depth * depth;
+	if (*h >= HISTORY_MAX) {
+		for (int s = 0; s < 2; s++)
+			for (int f = 0; f < 64; f++)
+				for (int t = 0; t < 64; t++)
+					search->history[s][f][t] /= 2;
+	}
+}
+
+static int
+search_quiesce(struct chess_search *search, struct chess_board *board, int alpha, int beta, unsigned ply)
+{
+	int best, score;
+	unsigned move;
+	bool check;
+	struct chess_undo undo;
+	struct chess_picker picker;
+
+	++search->nodes;
+	search->npv[ply] = 0;
+	if (search_should_stop(search))
+		return 0;
+	if (ply >= CHESS_SEARCH_DEPTH_MAX)
+		return chess_evaluate(board);
+
+	check = chess_board_in_check(board);
+	best = -CHESS_SCORE_MATE + (int)ply;
+	if (!check) {
+		/* Stand pat and only look at captures and queen promotions */
+		best = chess_evaluate(board);
+		if (best >= beta)
+			return best;
+		if (best > alpha)
+			alpha = best;
+	}
+
+	chess_picker_init(&picker, CHESS_MOVE_NONE, CHESS_MOVE_NONE, CHESS_MOVE_NONE,
+			CHESS_PICKER_MVV_LVA | (check ? 0 : CHESS_PICKER_TACTICAL));
+	while ((move = chess_picker_next(&picker, board)) != CHESS_MOVE_NONE) {
+		chess_board_make_move(board, move, &undo);
+		score = -search_quiesce(search, board, -beta, -alpha, ply + 1);
+		chess_board_unmake_move(board, move, &undo);
+		if (search->stopped)
+			return 0;
+
+		if (score > best) {
+			best = score;
+			if (score > alpha) {
+				alpha = score;
+				if (score >= beta)
+					break;
+			}
+		}
+	}
+	return best;
+}
+
+static int
+search_alphabeta(struct chess_search *search, struct chess_board *board,
+		int depth, int alpha, int beta, unsigned ply)
+{
+	int best, score, oldalpha;
+	unsigned n, move, bestmove, hashmove;
+	bool check;
+	uint64_t data;
+	struct chess_undo undo;
+	struct chess_picker picker;
+
+	if (depth <= 0)
+		return search_quiesce(search, board, alpha, beta, ply);
+
+	++search->nodes;
+	search->npv[ply] = 0;
+	if (search_should_stop(search))
+		return 0;
+	if (ply >= CHESS_SEARCH_DEPTH_MAX)
+		return chess_evaluate(board);
+
+	if (ply > 0) {
+		if (board->rhmc >= 100 || chess_board_is_repetition(board))
+			return 0;
+
+		/* Mate distance pruning */
+		if (alpha < -CHESS_SCORE_MATE + (int)ply)
+			alpha = -CHESS_SCORE_MATE + (int)ply;
+		if (beta > CHESS_SCORE_MATE - (int)ply - 1)
+			beta = CHESS_SCORE_MATE - (int)ply - 1;
+		if (alpha >= beta)
+			return alpha;
+	}
+
+	hashmove = CHESS_MOVE_NONE;
+	if (tt_probe(search, board->hash, &data)) {
+		hashmove = TT_MOVE(data);
+		if (ply > 0 && TT_DEPTH(data) >= depth) {
+			score = tt_score_from(TT_SCORE(data), ply);
+			if (TT_BOUND(data) == BOUND_EXACT
+					|| (TT_BOUND(data) == BOUND_LOWER && score >= beta)
+					|| (TT_BOUND(data) == BOUND_UPPER && score <= alpha))
+				return score;
+		}
+	}
+
+	check = chess_board_in_check(board);
+	if (check)
+		++depth;
+
+	/* Most nodes cut off on the first few moves, the picker only generates
+	 * the next stage when the previous one is exhausted.
+	 */
+	chess_picker_init(&picker, hashmove, search->killers[ply][0], search->killers[ply][1],
+			CHESS_PICKER_MVV_LVA);
+	picker.history = (const int (*)[64])search->history[board->side];
+
+	best = -SCORE_INFINITE;
+	bestmove = CHESS_MOVE_NONE;
+	oldalpha = alpha;
+	n = 0;
+	while ((move = chess_picker_next(&picker, board)) != CHESS_MOVE_NONE) {
+		if (ply == 0 && search->nexcluded && search_is_excluded(search, move))
+			continue;
+		chess_board_make_move(board, move, &undo);
+		if (n++ == 0)
+			score = -search_alphabeta(search, board, depth - 1, -beta, -alpha, ply + 1);
+		else {
+			/* Principal variation search: prove the move is worse with a null window */
+			score = -search_alphabeta(search, board, depth - 1, -alpha - 1, -alpha, ply + 1);
+			if (score > alpha && score < beta)
+				score = -search_alphabeta(search, board, depth - 1, -beta, -alpha, ply + 1);
+		}
+		chess_board_unmake_move(board, move, &undo);
+		if (search->stopped)
+			return 0;
+
+		if (score > best) {
+			best = score;
+			bestmove = move;
+			if (score > alpha) {
+				alpha = score;
+				search->pv[ply][0] = move;
+				memcpy(&search->pv[ply][1], search->pv[ply + 1], search->npv[ply + 1] * sizeof(unsigned));
+				search->npv[ply] = search->npv[ply + 1] + 1;
+				if (score >= beta) {
+					if (!move_is_tactical(board, move))
+						search_update_quiet(search, board, move, depth, ply);
+					break;
+				}
+			}
+		}
+	}
+	if (n == 0)
+		return check ? -CHESS_SCORE_MATE + (int)ply : 0;
+
+	/* The score of a root search with excluded moves is not the position's */
+	if (ply == 0 && search->nexcluded)
+		return best;
+	tt_store(search, board->hash, bestmove, tt_score_to(best, ply), depth,
+			(best >= beta) ? BOUND_LOWER : (best > oldalpha) ? BOUND_EXACT : BOUND_UPPER);
+
+	return best;
+}
+
+/* A mate found within the horizon can not get any shorter */
+static inline bool
+search_mate_resolved(int score, unsigned depth)
+{
+	return (score >= CHESS_SCORE_MATE_BOUND && CHESS_SCORE_MATE - score <= (int)depth)
+		|| (score <= -CHESS_SCORE_MATE_BOUND && CHESS_SCORE_MATE + score <= (int)depth);
+}
+
+static void
+search_post(struct search_async *async, const struct chess_search_info *lines, unsigned nlines)
+{
+	pthread_mutex_lock(&async->lock);
+	memcpy(async->posted, lines, nlines * sizeof(struct chess_search_info));
+	async->nposted = nlines;
+	async->pending = true;
+	pthread_cond_signal(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+}
+
+/* Iterative deepening with the limits already set */
+static unsigned
+search_iterate(struct chess_search *search, struct chess_board *board,
+		struct chess_search_info *lines, unsigned nlines)
+{
+	int score;
+	unsigned maxdepth, nmoves, j, k;
+	bool resolved;
+	struct chess_search_info line, *current = search->lines;
+	const struct timespec delay = { 0, 1000000 };
+
+	search->nodes = 0;
+	search->nodebase = 0;
+	search->stopped = false;
+	search->nexcluded = 0;
+	memset(search->killers, 0, sizeof(search->killers));
+	search->probes = search->hits = search->stores = search->overwrites = 0;
+	search->generation = (__atomic_add_fetch(&search->header->generation, 1, __ATOMIC_RELAXED)) & 0xff;
+	clock_gettime(CLOCK_MONOTONIC, &search->start);
+
+	nmoves = chess_board_count_moves(board);
+	if (nlines > nmoves)
+		nlines = nmoves;
+
+	maxdepth = CHESS_SEARCH_DEPTH_MAX;
+	if (search->limits.depth && search->limits.depth < maxdepth)
+		maxdepth = search->limits.depth;
+
+	for (unsigned depth = 1; nlines > 0 && depth <= CHESS_SEARCH_DEPTH_MAX; depth++) {
+		if (depth > maxdepth && !search_pondering(search))
+			break;
+
+		/* Each line is the best move left once the better lines' root
+		 * moves are excluded, all lines share the table and the move
+		 * ordering heuristics so the later ones are cheap.
+		 */
+		search->rootdepth = depth;
+		search->nexcluded = 0;
+		for (k = 0; k < nlines; k++) {
+			score = search_alphabeta(search, board, depth, -SCORE_INFINITE, SCORE_INFINITE, 0);
+			if (search->stopped)
+				break;
+			memset(&current[k], 0, sizeof(current[k]));
+			current[k].depth = depth;
+			current[k].score = score;
+			current[k].npv = search->npv[0];
+			memcpy(current[k].pv, search->pv[0], current[k].npv * sizeof(unsigned));
+			search->excluded[search->nexcluded++] = search->pv[0][0];
+		}
+		search->nexcluded = 0;
+		if (search->stopped)
+			break;
+
+		/* Scores of the later lines may exceed the earlier ones through
+		 * the table, the lines are reported best first.
+		 */
+		resolved = true;
+		for (k = 0; k < nlines; k++) {
+			line = current[k];
+			line.nodes = search->nodes;
+			line.time = search_elapsed(search);
+			for (j = k; j > 0 && lines[j - 1].score < line.score; j--)
+				lines[j] = lines[j - 1];
+			lines[j] = line;
+			resolved = resolved && search_mate_resolved(line.score, depth);
+		}
+		if (search->async != NULL && search->async->callback != NULL)
+			search_post(search->async, lines, nlines);
+
+		if (search_pondering(search))
+			continue;
+		if (resolved)
+			break;
+		if (search_nodes_exhausted(search))
+			break;
+		if (search->limits.time && search_elapsed(search) >= search->limits.time)
+			break;
+	}
+
+	/* A ponder search does not return before the ponder hit or a stop */
+	while (search_pondering(search) && !__atomic_load_n(&search->abort, __ATOMIC_RELAXED))
+		nanosleep(&delay, NULL);
+
+	STATS_ADD(SEARCH_NODES, search->nodes);
+	__atomic_add_fetch(&search->header->probes, search->probes, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&search->header->hits, search->hits, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&search->header->stores, search->stores, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&search->header->overwrites, search->overwrites, __ATOMIC_RELAXED);
+	for (k = 0; k < nlines; k++) {
+		lines[k].nodes = search->nodes;
+		lines[k].time = search_elapsed(search);
+	}
+	return nlines;
+}
+
+unsigned
+chess_search_run_multipv(struct chess_search *search, struct chess_board *board,
+		const struct chess_search_limits *limits, struct chess_search_info *lines, unsigned nlines)
+{
+	search->limits = *limits;
+	search->abort = 0;
+	search->ponder = false;
+	return search_iterate(search, board, lines, nlines);
+}
+
+unsigned
+chess_search_run(struct chess_search *search, struct chess_board *board,
+		const struct chess_search_limits *limits, struct chess_search_info *info)
+{
+	struct chess_search_info result;
+
+	if (chess_search_run_multipv(search, board, limits, &result, 1) == 0) {
+		memset(&result, 0, sizeof(result));
+		result.score = chess_board_in_check(board) ? -CHESS_SCORE_MATE : 0;
+	}
+	if (info != NULL)
+		*info = result;
+	return result.npv ? result.pv[0] : CHESS_MOVE_NONE;
+}
+
+static void *
+search_thread(void *arg)
+{
+	struct chess_search *search = arg;
+	struct search_async *async = search->async;
+
+	if (search_iterate(search, async->board, async->lines, async->nlines) == 0)
+		async->lines[0].score = chess_board_in_check(async->board) ? -CHESS_SCORE_MATE : 0;
+
+	pthread_mutex_lock(&async->lock);
+	async->done = true;
+	pthread_cond_signal(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+	return NULL;
+}
+
+static void *
+search_notifier(void *arg)
+{
+	unsigned n;
+	struct search_async *async = arg;
+
+	pthread_mutex_lock(&async->lock);
+	for (;;) {
+		while (!async->pending && !async->done)
+			pthread_cond_wait(&async->cond, &async->lock);
+		if (!async->pending)
+			break;
+		n = async->nposted;
+		memcpy(async->delivered, async->posted, n * sizeof(struct chess_search_info));
+		async->pending = false;
+
+		pthread_mutex_unlock(&async->lock);
+		async->callback(async->delivered, n, async->data);
+		pthread_mutex_lock(&async->lock);
+	}
+	pthread_mutex_unlock(&async->lock);
+	return NULL;
+}
+
+static void
+search_async_free(struct search_async *async)
+{
+	pthread_cond_destroy(&async->cond);
+	pthread_mutex_destroy(&async->lock);
+	free(async->board);
+	free(async);
+}
+
+int
+chess_search_start(struct chess_search *search, const struct chess_board *board,
+		const struct chess_search_limits *limits, unsigned nlines, int flags,
+		void (*callback)(const struct chess_search_info *lines, unsigned nlines, void *data),
+		void *data)
+{
+	int ret;
+	struct search_async *async;
+
+	if (search->async != NULL) {
+		errno = EBUSY;
+		return -1;
+	}
+	if (nlines == 0)
+		nlines = 1;
+	else if (nlines > CHESS_MOVES_MAX)
+		nlines = CHESS_MOVES_MAX;
+
+	async = calloc(1, sizeof(struct search_async) + 3 * nlines * sizeof(struct chess_search_info));
+	if (async == NULL)
+		return -1;
+	async->board = chess_board_init();
+	if (async->board == NULL) {
+		free(async);
+		return -1;
+	}
+	chess_board_copy(async->board, board);
+	async->callback = callback;
+	async->data = data;
+	async->nlines = nlines;
+	async->lines = (struct chess_search_info *)(async + 1);
+	async->posted = async->lines + nlines;
+	async->delivered = async->posted + nlines;
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_cond_init(&async->cond, NULL);
+
+	search->limits = *limits;
+	search->abort = 0;
+	search->pondering = (flags & CHESS_SEARCH_PONDER) != 0;
+	search->ponder = search->pondering;
+	search->async = async;
+
+	if (callback != NULL) {
+		ret = pthread_create(&async->notifier, NULL, search_notifier, async);
+		if (ret != 0)
+			goto fail;
+	}
+	ret = pthread_create(&async->thread, NULL, search_thread, search);
+	if (ret != 0) {
+		if (callback != NULL) {
+			pthread_mutex_lock(&async->lock);
+			async->done = true;
+			pthread_cond_signal(&async->cond);
+			pthread_mutex_unlock(&async->lock);
+			pthread_join(async->notifier, NULL);
+		}
+		goto fail;
+	}
+	return 0;
+
+fail:
+	search->async = NULL;
+	search_async_free(async);
+	errno = ret;
+	return -1;
+}
+
+void
+chess_search_stop(struct chess_search *search)
+{
+	__atomic_store_n(&search->abort, 1, __ATOMIC_RELAXED);
+}
+
+void
+chess_search_ponderhit(struct chess_search *search)
+{
+	__atomic_store_n(&search->pondering, 0, __ATOMIC_RELEASE);
+}
+
+unsigned
+chess_search_wait(struct chess_search *search, struct chess_search_info *lines)
+{
+	unsigned best;
+	struct search_async *async = search->async;
+
+	if (async == NULL)
+		return CHESS_MOVE_NONE;
+
+	pthread_join(async->thread, NULL);
+	if (async->callback != NULL)
+		pthread_join(async->notifier, NULL);
+
+	best = async->lines[0].npv ? async->lines[0].pv[0] : CHESS_MOVE_NONE;
+	if (lines != NULL)
+		memcpy(lines, async->lines, async->nlines * sizeof(struct chess_search_info));
+	search->async = NULL;
+	search_async_free(async);
+	return best;
+}
@@ -0,0 +1,73 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sliders.h"
+
+struct sliders_mask sliders_masks[64];
+unsigned char sliders_rank[8][64];
+
+/* Squares reached from sq stepping (df, dr) until the edge of the board */
+static unsigned long long
+sliders_ray(int sq, int df, int dr)
+{
+	int f, r;
+	unsigned long long b;
+
+	b = 0;
+	for (f = (sq & 7) + df, r = (sq >> 3) + dr; f >= 0 && f < 8 && r >= 0 && r < 8; f += df, r += dr)
+		b |= 1ULL << (r * 8 + f);
+	return b;
+}
+
+void
+sliders_init(void)
+{
+	int f;
+	unsigned occ, att;
+
+	for (int sq = 0; sq < 64; sq++) {
+		sliders_masks[sq].file = sliders_ray(sq, 0, 1) | sliders_ray(sq, 0, -1);
+		sliders_masks[sq].diag = sliders_ray(sq, 1, 1) | sliders_ray(sq, -1, -1);
+		sliders_masks[sq].anti = sliders_ray(sq, 1, -1) | sliders_ray(sq, -1, 1);
+	}
+
+	/* Indexed by the file and the occupancy of files b to g */
+	for (int file = 0; file < 8; file++) {
+		for (unsigned inner = 0; inner < 64; inner++) {
+			occ = inner << 1;
+			att = 0;
+			for (f = file + 1; f < 8; f++) {
+				att |= 1U << f;
+				if (occ & (1U << f))
+					break;
+			}
+			for (f = file - 1; f >= 0; f--) {
+				att |= 1U << f;
+				if (occ & (1U << f))
+					break;
+			}
+			sliders_rank[file][inner] = att;
+		}
+	}
+}
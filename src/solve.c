@@ -0,0 +1,490 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_private.h"
+#include "chess_solve.h"
+
+/* Proof and disproof numbers of solved nodes, sums saturate here */
+#define PN_INFINITE	0x3fffffffU
+
+/* Lines longer than this are given up as not mating, by default */
+#define SOLVE_PLY_MAX	127
+
+/* Nodes a thread searches between updates of the shared node count */
+#define SOLVE_NODES_BATCH 1024
+
+/* Keys are salted with the attacking side and the move generation, results
+ * are only valid for the same ones.
+ */
+static const uint64_t SOLVE_SALT_SIDE[2] = { 0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL };
+static const uint64_t SOLVE_SALT_ALL_MOVES = 0x3c6ef372fe94f82bULL;
+
+struct solve_entry {
+	uint64_t key;
+	uint32_t pn, dn;	/**< Proof and disproof numbers of the attacker's mate */
+	uint64_t work;		/**< Nodes searched below the entry, kept over smaller subtrees */
+};
+
+/* Buckets are a cache line each, guarded by a spin lock */
+#define BUCKET_ENTRIES 2
+
+struct solve_bucket {
+	uint32_t lock;
+	struct solve_entry entries[BUCKET_ENTRIES];
+} __attribute__((aligned(64)));
+
+struct chess_solver {
+	struct solve_bucket *table;
+	size_t mask;			/**< Number of buckets minus one */
+
+	/* State of the current run, shared by the threads */
+	int flags;
+	int attacker;
+	uint64_t salt;
+	unsigned plymax;		/**< Lines longer than this are given up as not mating */
+	unsigned long long limit;
+	unsigned long long nodes;
+	int done;			/**< Set when a thread solved the root or the limit is reached */
+};
+
+struct solve_thread {
+	pthread_t thread;
+	struct chess_solver *solver;
+	struct chess_board *board;
+	unsigned id;
+	unsigned long long random;	/**< Breaks ties between children for id > 0 */
+	unsigned long long nodes;	/**< Nodes not added to the shared count yet */
+};
+
+struct chess_solver *
+chess_solver_init(size_t memory)
+{
+	size_t n;
+	struct chess_solver *solver;
+
+	solver = calloc(1, sizeof(struct chess_solver));
+	if (solver == NULL)
+		return NULL;
+
+	for (n = 1; n * 2 * sizeof(struct solve_bucket) <= memory; n *= 2)
+		;
+	errno = posix_memalign((void **)&solver->table, sizeof(struct solve_bucket),
+			n * sizeof(struct solve_bucket));
+	if (errno != 0) {
+		free(solver);
+		return NULL;
+	}
+	solver->mask = n - 1;
+	solver->plymax = SOLVE_PLY_MAX;
+	chess_solver_clear(solver);
+
+	return solver;
+}
+
+void
+solve_set_ply_max(struct chess_solver *solver, unsigned plymax)
+{
+	solver->plymax = plymax;
+}
+
+void
+chess_solver_free(struct chess_solver *solver)
+{
+	free(solver->table);
+	free(solver);
+}
+
+void
+chess_solver_clear(struct chess_solver *solver)
+{
+	memset(solver->table, 0, (solver->mask + 1) * sizeof(struct solve_bucket));
+}
+
+static inline void
+bucket_lock(struct solve_bucket *bucket)
+{
+	while (__atomic_exchange_n(&bucket->lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&bucket->lock, __ATOMIC_RELAXED))
+			;
+}
+
+static inline void
+bucket_unlock(struct solve_bucket *bucket)
+{
+	__atomic_store_n(&bucket->lock, 0, __ATOMIC_RELEASE);
+}
+
+static bool
+solve_lookup(struct chess_solver *solver, uint64_t key, uint32_t *pn, uint32_t *dn, uint64_t *work)
+{
+	bool found = false;
+	struct solve_bucket *bucket = &solver->table[key & solver->mask];
+
+	bucket_lock(bucket);
+	for (int i = 0; i < BUCKET_ENTRIES; i++) {
+		if (bucket->entries[i].key == key && bucket->entries[i].work) {
+			*pn = bucket->entries[i].pn;
+			*dn = bucket->entries[i].dn;
+			if (work != NULL)
+				*work = bucket->entries[i].work;
+			found = true;
+			break;
+		}
+	}
+	bucket_unlock(bucket);
+	return found;
+}
+
+static void
+solve_store(struct chess_solver *solver, uint64_t key, uint32_t pn, uint32_t dn, uint64_t work)
+{
+	struct solve_entry *entry;
+	struct solve_bucket *bucket = &solver->table[key & solver->mask];
+
+	bucket_lock(bucket);
+	entry = &bucket->entries[0];
+	for (int i = 0; i < BUCKET_ENTRIES; i++) {
+		if (bucket->entries[i].key == key) {
+			entry = &bucket->entries[i];
+			work += entry->work;
+			break;
+		}
+		/* The entry with the smallest subtree is the cheapest to redo */
+		if (bucket->entries[i].work < entry->work)
+			entry = &bucket->entries[i];
+	}
+	entry->key = key;
+	entry->pn = pn;
+	entry->dn = dn;
+	entry->work = work;
+	bucket_unlock(bucket);
+}
+
+static inline uint32_t
+pn_add(uint32_t a, uint32_t b)
+{
+	return (a + b >= PN_INFINITE) ? PN_INFINITE : a + b;
+}
+
+static unsigned long long
+solve_random(unsigned long long *state)
+{
+	unsigned long long z;
+
+	/* splitmix64 */
+	z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Attacking nodes only try checks unless all moves are asked for */
+static inline unsigned
+solve_generate(const struct chess_solver *solver, const struct chess_board *board, unsigned *moves)
+{
+	if (board->side == solver->attacker && !(solver->flags & CHESS_SOLVER_ALL_MOVES))
+		return chess_board_generate_checks(board, moves);
+	return chess_board_generate_moves(board, moves);
+}
+
+static inline bool
+solve_stopped(struct solve_thread *thread)
+{
+	struct chess_solver *solver = thread->solver;
+
+	if (++thread->nodes >= SOLVE_NODES_BATCH) {
+		if (__atomic_add_fetch(&solver->nodes, thread->nodes, __ATOMIC_RELAXED) >= solver->limit
+				&& solver->limit)
+			__atomic_store_n(&solver->done, 1, __ATOMIC_RELAXED);
+		thread->nodes = 0;
+	}
+	return __atomic_load_n(&solver->done, __ATOMIC_RELAXED);
+}
+
+/* Expands the node until its proof or disproof number reaches its threshold,
+ * returns the number of nodes searched.
+ */
+static uint64_t
+solve_mid(struct solve_thread *thread, unsigned ply, uint32_t thpn, uint32_t thdn,
+		uint32_t *pn_r, uint32_t *dn_r)
+{
+	bool or;
+	unsigned n, best, m;
+	uint32_t pn, dn, second, cthpn, cthdn;
+	uint64_t key, work;
+	unsigned moves[CHESS_MOVES_MAX];
+	uint64_t keys[CHESS_MOVES_MAX];
+	uint32_t cpn[CHESS_MOVES_MAX], cdn[CHESS_MOVES_MAX];
+	bool fixed[CHESS_MOVES_MAX];
+	struct chess_undo undo;
+	struct chess_board *board = thread->board;
+	struct chess_solver *solver = thread->solver;
+
+	key = board->hash ^ solver->salt;
+	or = board->side == solver->attacker;
+	work = 1;
+
+	n = solve_generate(solver, board, moves);
+	if (n == 0 || ply >= solver->plymax) {
+		/* The attacker is out of checks, or the defender is mated or stalemated */
+		if (!or && n == 0 && chess_board_in_check(board))
+			pn = 0, dn = PN_INFINITE;
+		else
+			pn = PN_INFINITE, dn = 0;
+		if (n == 0)
+			solve_store(solver, key, pn, dn, work);
+		*pn_r = pn;
+		*dn_r = dn;
+		return work;
+	}
+
+	/* Children are made once to get their keys and settle the terminal
+	 * ones. A repetition is a draw on this path only and is not stored.
+	 */
+	for (unsigned i = 0; i < n; i++) {
+		chess_board_make_move(board, moves[i], &undo);
+		keys[i] = board->hash ^ solver->salt;
+		fixed[i] = true;
+		m = 1;
+		if (chess_board_is_repetition(board) || board->rhmc >= 100)
+			cpn[i] = PN_INFINITE, cdn[i] = 0;
+		else if (or && (m = chess_board_count_moves(board)) == 0) {
+			if (chess_board_in_check(board))
+				cpn[i] = 0, cdn[i] = PN_INFINITE;
+			else
+				cpn[i] = PN_INFINITE, cdn[i] = 0;
+		}
+		else {
+			/* Defences are proved fastest where the defender has the fewest replies */
+			fixed[i] = false;
+			cpn[i] = or ? m : 1;
+			cdn[i] = 1;
+		}
+		chess_board_unmake_move(board, moves[i], &undo);
+	}
+
+	for (;;) {
+		pn = or ? PN_INFINITE : 0;
+		dn = or ? 0 : PN_INFINITE;
+		best = 0;
+		second = PN_INFINITE;
+		for (unsigned i = 0; i < n; i++) {
+			uint32_t p, d, v, bv;
+
+			p = cpn[i];
+			d = cdn[i];
+			if (!fixed[i])
+				solve_lookup(solver, keys[i], &p, &d, NULL);
+			cpn[i] = p;
+			cdn[i] = d;
+
+			/* Or nodes follow the smallest proof number, and nodes
+			 * the smallest disproof number.
+			 */
+			v = or ? p : d;
+			bv = or ? cpn[best] : cdn[best];
+			if (i > 0 && (v < bv || (v == bv && thread->id && (solve_random(&thread->random) & 1)))) {
+				second = bv;
+				best = i;
+			}
+			else if (i > 0 && v < second)
+				second = v;
+			if (or) {
+				pn = (p < pn) ? p : pn;
+				dn = pn_add(dn, d);
+			}
+			else {
+				pn = pn_add(pn, p);
+				dn = (d < dn) ? d : dn;
+			}
+		}
+		if (pn >= thpn || dn >= thdn || solve_stopped(thread))
+			break;
+
+		if (or) {
+			cthpn = (thpn < second + 1) ? thpn : second + 1;
+			cthdn = pn_add(thdn - dn, cdn[best]);
+		}
+		else {
+			cthdn = (thdn < second + 1) ? thdn : second + 1;
+			cthpn = pn_add(thpn - pn, cpn[best]);
+		}
+		chess_board_make_move(board, moves[best], &undo);
+		work += solve_mid(thread, ply + 1, cthpn, cthdn, &cpn[best], &cdn[best]);
+		chess_board_unmake_move(board, moves[best], &undo);
+
+		/* Children given up at the ply limit are not stored, the table
+		 * may hold other numbers for them from shallower plies.
+		 */
+		if (ply + 1 >= solver->plymax)
+			fixed[best] = true;
+	}
+
+	solve_store(solver, key, pn, dn, work);
+	*pn_r = pn;
+	*dn_r = dn;
+	return work;
+}
+
+static void *
+solve_thread_run(void *arg)
+{
+	uint32_t pn, dn;
+	struct solve_thread *thread = arg;
+	struct chess_solver *solver = thread->solver;
+
+	solve_mid(thread, 0, PN_INFINITE, PN_INFINITE, &pn, &dn);
+	__atomic_add_fetch(&solver->nodes, thread->nodes, __ATOMIC_RELAXED);
+	thread->nodes = 0;
+	if (pn == 0 || dn == 0)
+		__atomic_store_n(&solver->done, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/* Follows proven children, the cheapest attack and the defence with the
+ * largest subtree.
+ */
+static void
+solve_pv(struct chess_solver *solver, struct chess_board *board, struct chess_solver_result *result)
+{
+	bool or;
+	unsigned n, best;
+	uint32_t pn, dn;
+	uint64_t work, bestwork;
+	unsigned moves[CHESS_MOVES_MAX];
+	struct chess_undo scratch, undo[CHESS_SOLVER_PV_MAX];
+
+	result->npv = 0;
+	while (result->npv < CHESS_SOLVER_PV_MAX) {
+		or = board->side == solver->attacker;
+		n = solve_generate(solver, board, moves);
+		best = n;
+		bestwork = 0;
+		for (unsigned i = 0; i < n; i++) {
+			chess_board_make_move(board, moves[i], &scratch);
+			if (chess_board_count_moves(board) == 0 && chess_board_in_check(board))
+				pn = 0, work = 0;
+			else if (!solve_lookup(solver, board->hash ^ solver->salt, &pn, &dn, &work))
+				pn = PN_INFINITE;
+			chess_board_unmake_move(board, moves[i], &scratch);
+
+			if (pn != 0)
+				continue;
+			if (best == n || (or ? work < bestwork : work > bestwork)) {
+				best = i;
+				bestwork = work;
+			}
+		}
+		if (best == n)
+			break;
+		result->pv[result->npv] = moves[best];
+		chess_board_make_move(board, moves[best], &undo[result->npv++]);
+	}
+	for (unsigned i = result->npv; i > 0; i--)
+		chess_board_unmake_move(board, result->pv[i - 1], &undo[i - 1]);
+}
+
+int
+chess_solver_run(struct chess_solver *solver, const struct chess_board *board,
+		unsigned long long nodes, unsigned nthreads, int flags,
+		struct chess_solver_result *result)
+{
+	int status;
+	uint32_t pn, dn;
+	unsigned started;
+	struct timespec start, end;
+	struct solve_thread *threads;
+	struct chess_solver_result res;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (nthreads == 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+	solver->flags = flags;
+	solver->attacker = board->side;
+	solver->salt = SOLVE_SALT_SIDE[board->side] ^ ((flags & CHESS_SOLVER_ALL_MOVES) ? SOLVE_SALT_ALL_MOVES : 0);
+	solver->limit = nodes;
+	solver->nodes = 0;
+	solver->done = 0;
+
+	memset(&res, 0, sizeof(res));
+	threads = calloc(nthreads, sizeof(struct solve_thread));
+	if (threads == NULL)
+		nthreads = 0;
+
+	/* The calling thread searches as the first one */
+	started = 0;
+	for (unsigned i = 0; i < nthreads; i++) {
+		threads[i].solver = solver;
+		threads[i].id = i;
+		threads[i].random = i;
+		threads[i].board = chess_board_init();
+		if (threads[i].board == NULL)
+			break;
+		chess_board_copy(threads[i].board, board);
+		if (i > 0 && pthread_create(&threads[i].thread, NULL, solve_thread_run, &threads[i]) != 0) {
+			free(threads[i].board);
+			break;
+		}
+		++started;
+	}
+	if (started > 0)
+		solve_thread_run(&threads[0]);
+	for (unsigned i = 0; i < started; i++) {
+		if (i > 0)
+			pthread_join(threads[i].thread, NULL);
+	}
+
+	status = CHESS_SOLVER_UNKNOWN;
+	if (solve_lookup(solver, board->hash ^ solver->salt, &pn, &dn, NULL)) {
+		if (pn == 0)
+			status = CHESS_SOLVER_PROVEN;
+		else if (dn == 0)
+			status = CHESS_SOLVER_DISPROVEN;
+	}
+	if (status == CHESS_SOLVER_PROVEN && started > 0)
+		solve_pv(solver, threads[0].board, &res);
+
+	for (unsigned i = 0; i < started; i++)
+		free(threads[i].board);
+	free(threads);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	res.status = status;
+	res.nodes = solver->nodes;
+	res.time = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+	if (result != NULL)
+		*result = res;
+	return status;
+}
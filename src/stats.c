@@ -0,0 +1,181 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess_private.h"
+#include "chess_stats.h"
+
+static const char *const stats_names[CHESS_STATS_MAX] = {
+	"set_piece",
+	"clear_piece",
+	"attacks",
+	"get_fen",
+	"set_fen",
+	"generate_moves",
+	"make_move",
+	"evaluate",
+	"search_nodes",
+};
+
+#ifdef ENABLE_STATS
+__thread struct stats_block *stats_local;
+
+/* Blocks of live threads, and the sum of the blocks of exited threads */
+static struct stats_block *stats_blocks;
+static unsigned long long stats_retired[CHESS_STATS_MAX];
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+static void
+stats_retire(void *arg)
+{
+	struct stats_block *block = arg, **p;
+
+	pthread_mutex_lock(&stats_lock);
+	for (int i = 0; i < CHESS_STATS_MAX; i++)
+		stats_retired[i] += block->counters[i];
+	for (p = &stats_blocks; *p != NULL; p = &(*p)->next) {
+		if (*p == block) {
+			*p = block->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&stats_lock);
+
+	free(block);
+}
+
+static void
+stats_key_init(void)
+{
+	pthread_key_create(&stats_key, stats_retire);
+}
+
+struct stats_block *
+stats_register(void)
+{
+	static struct stats_block fallback;
+	struct stats_block *block;
+
+	pthread_once(&stats_key_once, stats_key_init);
+
+	/* Without memory count in a shared block rather than fail */
+	if (posix_memalign((void **)&block, sizeof(struct stats_block), sizeof(struct stats_block)) != 0)
+		return &fallback;
+	memset(block, 0, sizeof(struct stats_block));
+
+	pthread_mutex_lock(&stats_lock);
+	block->next = stats_blocks;
+	stats_blocks = block;
+	pthread_mutex_unlock(&stats_lock);
+
+	pthread_setspecific(stats_key, block);
+	stats_local = block;
+	return block;
+}
+#endif /* ENABLE_STATS */
+
+bool
+chess_stats_enabled(void)
+{
+#ifdef ENABLE_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+const char *
+chess_stats_name(int counter)
+{
+	if (counter < 0 || counter >= CHESS_STATS_MAX)
+		return NULL;
+	return stats_names[counter];
+}
+
+void
+chess_stats_snapshot(struct chess_stats *stats)
+{
+	memset(stats, 0, sizeof(struct chess_stats));
+
+#ifdef ENABLE_STATS
+	pthread_mutex_lock(&stats_lock);
+	for (int i = 0; i < CHESS_STATS_MAX; i++)
+		stats->counters[i] = stats_retired[i];
+	for (struct stats_block *block = stats_blocks; block != NULL; block = block->next) {
+		for (int i = 0; i < CHESS_STATS_MAX; i++)
+			stats->counters[i] += __atomic_load_n(&block->counters[i], __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&stats_lock);
+#endif
+}
+
+int
+chess_stats_export(const char *path)
+{
+	int save_errno;
+	bool failed;
+	size_t len;
+	char *tmp;
+	FILE *fp;
+	struct chess_stats stats;
+
+	chess_stats_snapshot(&stats);
+
+	len = strlen(path) + sizeof(".tmp");
+	tmp = malloc(len);
+	if (tmp == NULL)
+		return -1;
+	snprintf(tmp, len, "%s.tmp", path);
+
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		free(tmp);
+		return -1;
+	}
+	for (int i = 0; i < CHESS_STATS_MAX; i++) {
+		fprintf(fp, "# TYPE libchess_%s_total counter\n", stats_names[i]);
+		fprintf(fp, "libchess_%s_total %llu\n", stats_names[i], stats.counters[i]);
+	}
+	failed = ferror(fp) != 0;
+	failed = (fclose(fp) != 0) || failed;
+	if (failed || rename(tmp, path) < 0) {
+		save_errno = errno;
+		unlink(tmp);
+		free(tmp);
+		errno = save_errno;
+		return -1;
+	}
+
+	free(tmp);
+	return 0;
+}
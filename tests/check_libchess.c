@@ -18,12 +18,30 @@
  * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <check.h>
 
 #include "chess.h"
+/* Tests compare the inline accessors to the exported ones */
+#define CHESS_INLINE_NO_MACROS 1
+#include "chess_inline.h"
+#include "chess_batch.h"
+#include "chess_eval.h"
+#include "chess_filter.h"
+#include "chess_index.h"
+#include "chess_pgn.h"
+#include "chess_private.h"
+#include "chess_search.h"
+#include "chess_solve.h"
+#include "chess_stats.h"
+#include "magicmoves.h"
+#include "sliders.h"
 
 START_TEST(test_chess_switch_side)
 {
@@ -547,6 +565,1436 @@ START_TEST(test_chess_board_get_fen)
 }
 END_TEST
 
+START_TEST(test_chess_board_set_fen)
+{
+#define FEN_MAX 256
+	unsigned i;
+	char fen[FEN_MAX];
+	struct chess_board *board;
+	const char *valid[] = {
+		CHESS_FEN_STARTPOS,
+		"8/8/8/8/8/8/8/8 w - - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+		"4k3/8/8/8/8/8/8/4K3 b - - 42 97",
+	};
+	const char *invalid[] = {
+		"",
+		"8/8/8/8/8/8/8 w - - 0 1",
+		"9/8/8/8/8/8/8/8 w - - 0 1",
+		"8/8/8/8/8/8/8/7X w - - 0 1",
+		"8/8/8/8/8/8/8/8 x - - 0 1",
+		"8/8/8/8/8/8/8/8 w KX - 0 1",
+		"8/8/8/8/8/8/8/8 w - e4 0 1",
+	};
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	for (i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+		fail_unless(chess_board_set_fen(board, valid[i]), "`%s'", valid[i]);
+		fail_unless(chess_board_get_fen(board, fen, FEN_MAX) != NULL);
+		fail_unless(strcmp(fen, valid[i]) == 0, "`%s' != `%s'", fen, valid[i]);
+	}
+
+	/* Move counters are optional */
+	fail_unless(chess_board_set_fen(board, "8/8/8/8/8/8/8/8 b - -"));
+	fail_unless(chess_board_get_rhmc(board) == 0);
+	fail_unless(chess_board_get_fmc(board) == 1);
+
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+		fail_if(chess_board_set_fen(board, invalid[i]), "`%s'", invalid[i]);
+
+#undef FEN_MAX
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_board_hash)
+{
+	int i;
+	unsigned long long hash;
+	unsigned moves[4];
+	struct chess_board *board, *other;
+	struct chess_undo undo[4];
+	const char *line[] = { "g1f3", "g8f6", "b1c3", "b8c6" };
+	const char *transposed[] = { "b1c3", "b8c6", "g1f3", "g8f6" };
+
+	board = chess_board_init();
+	other = chess_board_init();
+	fail_unless(board != NULL && other != NULL);
+
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(chess_board_set_fen(other, CHESS_FEN_STARTPOS));
+	hash = chess_board_get_hash(board);
+
+	for (i = 0; i < 4; i++) {
+		moves[i] = chess_board_parse_move(board, line[i]);
+		fail_if(moves[i] == CHESS_MOVE_NONE, "%s", line[i]);
+		chess_board_make_move(board, moves[i], &undo[i]);
+		chess_board_make_move(other, chess_board_parse_move(other, transposed[i]), &undo[i]);
+		fail_if(chess_board_get_hash(board) == hash);
+	}
+	fail_unless(chess_board_get_hash(board) == chess_board_get_hash(other));
+
+	/* The key matches the one of the same position set up from FEN */
+	fail_unless(chess_board_set_fen(other, "r1bqkb1r/pppppppp/2n2n2/8/8/2N2N2/PPPPPPPP/R1BQKB1R w KQkq - 4 3"));
+	fail_unless(chess_board_get_hash(board) == chess_board_get_hash(other));
+
+	/* The key depends on the side to move and castling rights */
+	fail_unless(chess_board_set_fen(other, "r1bqkb1r/pppppppp/2n2n2/8/8/2N2N2/PPPPPPPP/R1BQKB1R b KQkq - 4 3"));
+	fail_if(chess_board_get_hash(board) == chess_board_get_hash(other));
+	fail_unless(chess_board_set_fen(other, "r1bqkb1r/pppppppp/2n2n2/8/8/2N2N2/PPPPPPPP/R1BQKB1R w Kkq - 4 3"));
+	fail_if(chess_board_get_hash(board) == chess_board_get_hash(other));
+
+	/* Unmaking the moves restores the key */
+	for (i = 3; i >= 0; i--)
+		chess_board_unmake_move(board, moves[i], &undo[i]);
+	fail_unless(chess_board_get_hash(board) == hash);
+
+	free(board);
+	free(other);
+}
+END_TEST
+
+START_TEST(test_chess_board_perft)
+{
+	unsigned i;
+	struct chess_board *board;
+	struct {
+		const char *fen;
+		unsigned depth;
+		unsigned long long nodes;
+	} positions[] = {
+		{ CHESS_FEN_STARTPOS, 4, 197281ULL },
+		/* Castling, en passant and promotions */
+		{ "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97862ULL },
+		/* Pinned en passant captures */
+		{ "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 43238ULL },
+		{ "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3, 9467ULL },
+		{ "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379ULL },
+	};
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	for (i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+		fail_unless(chess_board_set_fen(board, positions[i].fen), "`%s'", positions[i].fen);
+		fail_unless(chess_board_perft(board, positions[i].depth) == positions[i].nodes,
+				"`%s' depth %u", positions[i].fen, positions[i].depth);
+	}
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_board_parse_san)
+{
+	unsigned move;
+	char str[8];
+	struct chess_board *board;
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	move = chess_board_parse_san(board, "Nf3");
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "g1f3") == 0, "%s", str);
+	move = chess_board_parse_san(board, "e4!?");
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "e2e4") == 0, "%s", str);
+	fail_unless(chess_board_parse_san(board, "e5") == CHESS_MOVE_NONE);
+	fail_unless(chess_board_parse_san(board, "O-O") == CHESS_MOVE_NONE);
+
+	/* Disambiguation */
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/8/8/2N3N1/8/R3K2R w KQ - 0 1"));
+	fail_unless(chess_board_parse_san(board, "Ne4") == CHESS_MOVE_NONE);
+	move = chess_board_parse_san(board, "Nge4");
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "g3e4") == 0, "%s", str);
+	move = chess_board_parse_san(board, "Rad1");
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "a1d1") == 0, "%s", str);
+	move = chess_board_parse_san(board, "O-O-O");
+	fail_unless(chess_move_flags(move) == CHESS_MOVE_FLAG_CASTLE);
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "e1c1") == 0, "%s", str);
+
+	/* Promotions and en passant */
+	fail_unless(chess_board_set_fen(board, "4k3/1P6/8/3pP3/8/8/8/4K3 w - d6 0 1"));
+	move = chess_board_parse_san(board, "b8=N+");
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "b7b8n") == 0, "%s", str);
+	move = chess_board_parse_san(board, "exd6");
+	fail_unless(chess_move_flags(move) == CHESS_MOVE_FLAG_ENPASSANT);
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_pgn_read_game)
+{
+	unsigned nmoves;
+	FILE *fp;
+	struct chess_board *board;
+	struct chess_pgn *pgn;
+	const char *games =
+		"[Event \"Test\"]\n"
+		"[White \"A \\\"B\\\" C\"]\n"
+		"[Result \"1-0\"]\n"
+		"\n"
+		"1. e4 e5 2. Nf3 {comment} Nc6 (2... d6 3. d4) 3. Bb5 $1 a6 ; rest\n"
+		"4. O-O 1-0\n"
+		"\n"
+		"[FEN \"4k3/1P6/8/3pP3/8/8/8/4K3 w - d6 0 1\"]\n"
+		"\n"
+		"1. exd6 Kd7 2. b8=N+ Kxd6 0-1\n"
+		"\n"
+		"[Event \"Illegal\"]\n"
+		"\n"
+		"1. e4 e5 2. Qxf7 *\n";
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+	fp = fmemopen((void *)games, strlen(games), "r");
+	fail_unless(fp != NULL);
+	pgn = chess_pgn_init(fp);
+	fail_unless(pgn != NULL);
+
+	fail_unless(chess_pgn_read_game(pgn, board) == 1);
+	fail_unless(chess_pgn_get_result(pgn) == CHESS_RESULT_WHITE_WINS);
+	fail_unless(strcmp(chess_pgn_get_tag(pgn, "White"), "A \"B\" C") == 0);
+	fail_unless(chess_pgn_get_tag(pgn, "Black") == NULL);
+	chess_pgn_get_moves(pgn, &nmoves);
+	fail_unless(nmoves == 7, "%u", nmoves);
+
+	fail_unless(chess_pgn_read_game(pgn, board) == 1);
+	fail_unless(chess_pgn_get_result(pgn) == CHESS_RESULT_BLACK_WINS);
+	fail_unless(chess_board_get_enpassant_square(board) == chess_square_index("d6"));
+	chess_pgn_get_moves(pgn, &nmoves);
+	fail_unless(nmoves == 4, "%u", nmoves);
+
+	fail_unless(chess_pgn_read_game(pgn, board) == -1);
+	chess_pgn_get_moves(pgn, &nmoves);
+	fail_unless(nmoves == 2, "%u", nmoves);
+
+	fail_unless(chess_pgn_read_game(pgn, board) == 0);
+
+	chess_pgn_free(pgn);
+	fclose(fp);
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_index)
+{
+	const uint32_t *games;
+	const struct chess_index_entry *entry;
+	struct chess_index_builder *builder;
+	struct chess_index *index;
+	const char *path = "check_libchess.idx";
+
+	/* Little memory so that several runs are spilled and merged */
+	builder = chess_index_builder_init(path, 64 * 1024, 4);
+	fail_unless(builder != NULL);
+
+	/* Game g visits positions k * 7919 for k in [0, g % 100], twice */
+	for (uint32_t g = 0; g < 1000; g++) {
+		for (uint64_t k = 0; k <= g % 100; k++) {
+			fail_unless(chess_index_builder_add(builder, k * 7919, g, g % 3) == 0);
+			fail_unless(chess_index_builder_add(builder, k * 7919, g, g % 3) == 0);
+		}
+	}
+	fail_unless(chess_index_builder_finish(builder) == 0);
+
+	index = chess_index_open(path);
+	fail_unless(index != NULL);
+	fail_unless(chess_index_get_size(index) == 100);
+
+	for (uint64_t k = 0; k < 100; k++) {
+		unsigned expected = 0;
+
+		for (uint32_t g = 0; g < 1000; g++)
+			expected += (g % 100 >= k);
+
+		entry = chess_index_lookup(index, k * 7919);
+		fail_unless(entry != NULL, "%llu", (unsigned long long)k);
+		fail_unless(entry->ngames == expected, "%u != %u", entry->ngames, expected);
+		fail_unless(entry->count[0] + entry->count[1] + entry->count[2] == expected);
+
+		games = chess_index_get_games(index, entry);
+		for (uint32_t i = 1; i < entry->ngames; i++)
+			fail_unless(games[i - 1] < games[i]);
+		fail_unless(games[0] == k);
+	}
+
+	/* Missing keys */
+	fail_unless(chess_index_lookup(index, 1) == NULL);
+	fail_unless(chess_index_lookup(index, 100 * 7919) == NULL);
+	fail_unless(chess_index_lookup(index, ~0ULL) == NULL);
+
+	chess_index_close(index);
+	unlink(path);
+}
+END_TEST
+
+START_TEST(test_chess_board_chess960)
+{
+#define FEN_MAX 256
+	unsigned i, move;
+	unsigned long long hash;
+	char fen[FEN_MAX], str[8];
+	struct chess_board *board;
+	struct chess_undo undo;
+	struct {
+		const char *fen;
+		unsigned depth;
+		unsigned long long nodes;
+	} positions[] = {
+		{ "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9", 3, 12189ULL },
+		{ "2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9", 3, 18002ULL },
+		{ "b1q1rrkb/pppppppp/3nn3/8/P7/1PPP4/4PPPP/BQNNRKRB w GE - 1 9", 3, 10471ULL },
+	};
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	for (i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+		fail_unless(chess_board_set_fen(board, positions[i].fen), "`%s'", positions[i].fen);
+		fail_unless(chess_board_perft(board, positions[i].depth) == positions[i].nodes,
+				"`%s' %llu", positions[i].fen, chess_board_perft(board, positions[i].depth));
+	}
+
+	/* Shredder-FEN and X-FEN */
+	fail_unless(chess_board_set_fen(board, "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9"));
+	fail_unless(chess_board_get_initial_king_square(board) == chess_square_index("g1"));
+	fail_unless(chess_board_get_initial_krook_square(board) == chess_square_index("h1"));
+	fail_unless(chess_board_get_initial_qrook_square(board) == chess_square_index("f1"));
+	fail_unless(chess_board_get_fen(board, fen, FEN_MAX) != NULL);
+	fail_unless(strcmp(fen, "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w KQkq - 2 9") == 0, "%s", fen);
+	hash = chess_board_get_hash(board);
+	fail_unless(chess_board_set_fen(board, fen));
+	fail_unless(chess_board_get_hash(board) == hash);
+	fail_unless(chess_board_get_initial_qrook_square(board) == chess_square_index("f1"));
+
+	/* An outer rook forces the file letter in X-FEN */
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/8/8/8/8/R1R1K3 w C - 0 1"));
+	fail_unless(chess_board_get_fen(board, fen, FEN_MAX) != NULL);
+	fail_unless(strcmp(fen, "4k3/8/8/8/8/8/8/R1R1K3 w C - 0 1") == 0, "%s", fen);
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(chess_board_get_shredder_fen(board, fen, FEN_MAX) != NULL);
+	fail_unless(strcmp(fen, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w HAha - 0 1") == 0, "%s", fen);
+	fail_unless(chess_board_set_fen(board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w HAha - 0 1"));
+
+	/* Inconsistent and invalid rights */
+	fail_if(chess_board_set_fen(board, "1r2k1r1/8/8/8/8/8/8/R3K2R w Hg - 0 1"));
+	fail_if(chess_board_set_fen(board, "4k3/8/8/8/8/8/8/R3K2R w E - 0 1"));
+	fail_if(chess_board_set_fen(board, "8/8/8/8/8/8/8/8 w H - 0 1"));
+
+	/* The king stays and the rook jumps over it */
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/8/8/8/8/4RK1R w E - 0 1"));
+	move = chess_board_parse_move(board, "f1e1");
+	fail_unless(chess_move_flags(move) == CHESS_MOVE_FLAG_CASTLE);
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "f1c1") == 0, "%s", str);
+	hash = chess_board_get_hash(board);
+	chess_board_make_move(board, move, &undo);
+	fail_unless(chess_board_get_fen(board, fen, FEN_MAX) != NULL);
+	fail_unless(strcmp(fen, "4k3/8/8/8/8/8/8/2KR3R b - - 1 1") == 0, "%s", fen);
+	chess_board_unmake_move(board, move, &undo);
+	fail_unless(chess_board_get_hash(board) == hash);
+
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/8/8/8/8/5RKR w F - 0 1"));
+	move = chess_board_parse_san(board, "O-O-O");
+	fail_unless(move != CHESS_MOVE_NONE);
+	chess_board_make_move(board, move, &undo);
+	fail_unless(chess_board_get_fen(board, fen, FEN_MAX) != NULL);
+	fail_unless(strcmp(fen, "4k3/8/8/8/8/8/8/2KR3R b - - 1 1") == 0, "%s", fen);
+
+	/* The rook leaving uncovers an attack on the king's target square */
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/8/8/8/8/rRK5 w B - 0 1"));
+	fail_unless(chess_board_parse_san(board, "O-O-O") == CHESS_MOVE_NONE);
+
+#undef FEN_MAX
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_board_repetition)
+{
+	unsigned move;
+	struct chess_board *board;
+	struct chess_undo undo[16];
+	const char *shuffle[] = { "g1f3", "g8f6", "f3g1", "f6g8" };
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+
+	for (unsigned i = 0; i < 8; i++) {
+		move = chess_board_parse_move(board, shuffle[i % 4]);
+		fail_if(move == CHESS_MOVE_NONE);
+		chess_board_make_move(board, move, &undo[i]);
+		fail_unless(chess_board_get_repetitions(board) == (i + 1) / 4, "%u", i);
+		fail_unless(chess_board_is_repetition(board) == (i >= 3), "%u", i);
+		fail_unless(chess_board_is_threefold_repetition(board) == (i >= 7), "%u", i);
+	}
+
+	/* An irreversible move hides the earlier positions */
+	move = chess_board_parse_move(board, "e2e4");
+	chess_board_make_move(board, move, &undo[8]);
+	fail_if(chess_board_is_repetition(board));
+	chess_board_unmake_move(board, move, &undo[8]);
+	fail_unless(chess_board_is_threefold_repetition(board));
+
+	/* Setting a position forgets the history */
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(chess_board_get_repetitions(board) == 0);
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_board_draw)
+{
+	unsigned i;
+	struct chess_board *board;
+	const char *insufficient[] = {
+		"4k3/8/8/8/8/8/8/4K3 w - - 0 1",
+		"4k3/8/8/8/8/8/8/4KN2 w - - 0 1",
+		"4kb2/8/8/8/8/8/8/4K3 w - - 0 1",
+		"4kb2/8/8/8/8/8/8/2B1K3 w - - 0 1",
+		"4k3/8/8/8/8/8/8/B1B1K1B1 b - - 0 1",
+	};
+	const char *sufficient[] = {
+		"4k3/8/8/8/8/8/8/4K2R w - - 0 1",
+		"4k3/p7/8/8/8/8/8/4K3 w - - 0 1",
+		"4k3/8/8/8/8/8/8/3NKN2 w - - 0 1",
+		"4k3/8/8/8/8/8/8/2B1KB2 w - - 0 1",
+		"4kn2/8/8/8/8/8/8/4KB2 w - - 0 1",
+	};
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	for (i = 0; i < sizeof(insufficient) / sizeof(insufficient[0]); i++) {
+		fail_unless(chess_board_set_fen(board, insufficient[i]));
+		fail_unless(chess_board_is_insufficient_material(board), "`%s'", insufficient[i]);
+	}
+	for (i = 0; i < sizeof(sufficient) / sizeof(sufficient[0]); i++) {
+		fail_unless(chess_board_set_fen(board, sufficient[i]));
+		fail_if(chess_board_is_insufficient_material(board), "`%s'", sufficient[i]);
+	}
+
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/8/8/8/8/4K2R w - - 99 80"));
+	fail_if(chess_board_is_fifty_moves(board));
+	chess_board_set_rhmc(board, 100);
+	fail_unless(chess_board_is_fifty_moves(board));
+
+	/* Counters beyond the board's field saturate */
+	chess_board_set_rhmc(board, 70000);
+	fail_unless(chess_board_get_rhmc(board) == CHESS_RHMC_MAX);
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/8/8/8/8/4K2R w - - 65537 80"));
+	fail_unless(chess_board_get_rhmc(board) == CHESS_RHMC_MAX);
+	fail_unless(chess_board_is_fifty_moves(board));
+
+	/* Checkmate takes precedence */
+	fail_unless(chess_board_set_fen(board, "R5k1/5ppp/8/8/8/8/8/6K1 b - - 100 80"));
+	fail_if(chess_board_is_fifty_moves(board));
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_evaluate)
+{
+	int score;
+	struct chess_board *board;
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(chess_evaluate(board) == 0);
+
+	/* The score is relative to the side to move */
+	fail_unless(chess_board_set_fen(board, "rnb1kbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"));
+	score = chess_evaluate(board);
+	fail_unless(score > 800, "%d", score);
+	fail_unless(chess_board_set_fen(board, "rnb1kbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b KQkq - 0 1"));
+	fail_unless(chess_evaluate(board) == -score);
+
+	/* Colour symmetry */
+	fail_unless(chess_board_set_fen(board, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+	score = chess_evaluate(board);
+	fail_unless(chess_board_set_fen(board, "r3k2r/pppbbppp/2n2q1P/1P2p3/3pn3/BN2PNP1/P1PPQPB1/R3K2R b KQkq - 0 1"));
+	fail_unless(chess_evaluate(board) == score);
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_evaluate_batch)
+{
+	unsigned n, seed;
+	char fens[200][128];
+	const char *fenp[201];
+	int scores[201], expected[200];
+	struct chess_board *boards[200];
+	struct chess_undo undo;
+	unsigned moves[CHESS_MOVES_MAX];
+
+	/* Positions of a random game, more than a few blocks but not a multiple */
+	seed = 1;
+	for (unsigned i = 0; i < 200; i++) {
+		boards[i] = chess_board_init();
+		fail_unless(boards[i] != NULL);
+		if (i == 0)
+			fail_unless(chess_board_set_fen(boards[i], CHESS_FEN_STARTPOS));
+		else
+			chess_board_copy(boards[i], boards[i - 1]);
+		n = chess_board_generate_moves(boards[i], moves);
+		if (n == 0)
+			fail_unless(chess_board_set_fen(boards[i], CHESS_FEN_STARTPOS));
+		else {
+			seed = seed * 1103515245 + 12345;
+			chess_board_make_move(boards[i], moves[(seed >> 16) % n], &undo);
+		}
+		expected[i] = chess_evaluate(boards[i]);
+		chess_board_get_fen(boards[i], fens[i], sizeof(fens[i]));
+		fenp[i] = fens[i];
+	}
+	fenp[200] = "invalid";
+
+	for (unsigned nthreads = 0; nthreads <= 4; nthreads += 2) {
+		memset(scores, 0, sizeof(scores));
+		chess_evaluate_batch((const struct chess_board *const *)boards, 200, scores, nthreads);
+		fail_unless(memcmp(scores, expected, sizeof(expected)) == 0, "%u threads", nthreads);
+
+		memset(scores, 0, sizeof(scores));
+		fail_unless(chess_evaluate_batch_fen(fenp, 201, scores, nthreads) == 0);
+		fail_unless(memcmp(scores, expected, sizeof(expected)) == 0, "%u threads", nthreads);
+		fail_unless(scores[200] == CHESS_EVAL_INVALID);
+	}
+	chess_evaluate_batch((const struct chess_board *const *)boards, 0, scores, 0);
+
+	for (unsigned i = 0; i < 200; i++)
+		free(boards[i]);
+}
+END_TEST
+
+START_TEST(test_chess_eval_params)
+{
+	int score;
+	int defaults[CHESS_EVAL_PARAMS], params[CHESS_EVAL_PARAMS];
+	struct chess_board *board;
+	const char *path = "check_libchess.eval";
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+	chess_eval_get_params(defaults);
+	fail_unless(defaults[CHESS_EVAL_MATERIAL(0, CHESS_PIECE_QUEEN)] == 1025);
+
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(chess_evaluate_phase(board) == CHESS_EVAL_PHASE_MAX);
+	fail_unless(chess_board_set_fen(board, "4k3/pppp4/8/8/8/8/PPPPP3/4K3 w - - 0 1"));
+	fail_unless(chess_evaluate_phase(board) == 0);
+	score = chess_evaluate(board);
+
+	/* An extra pawn in the end game is worth the end game pawn value */
+	memcpy(params, defaults, sizeof(params));
+	params[CHESS_EVAL_MATERIAL(1, CHESS_PIECE_PAWN)] += 100;
+	chess_eval_set_params(params);
+	fail_unless(chess_evaluate(board) == score + 100, "%d", chess_evaluate(board));
+
+	/* Piece-square values are from white's point of view and mirrored */
+	memcpy(params, defaults, sizeof(params));
+	params[CHESS_EVAL_PST(1, CHESS_PIECE_KING, 4)] += 50;
+	chess_eval_set_params(params);
+	fail_unless(chess_evaluate(board) == score);
+
+	/* Saved parameters load back */
+	fail_unless(chess_eval_save(path) == 0);
+	chess_eval_set_params(defaults);
+	fail_unless(chess_eval_load(path) == 0);
+	chess_eval_get_params(defaults);
+	fail_unless(memcmp(params, defaults, sizeof(params)) == 0);
+	params[CHESS_EVAL_PST(1, CHESS_PIECE_KING, 4)] -= 50;
+	chess_eval_set_params(params);
+	fail_unless(chess_evaluate(board) == score);
+
+	unlink(path);
+	fail_unless(chess_eval_load(path) < 0 && errno == ENOENT);
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_search_run)
+{
+	unsigned move;
+	char str[8];
+	struct chess_board *board;
+	struct chess_search *search;
+	struct chess_search_limits limits;
+	struct chess_search_info info;
+
+	board = chess_board_init();
+	search = chess_search_init(1 << 20);
+	fail_unless(board != NULL && search != NULL);
+	memset(&limits, 0, sizeof(limits));
+
+	/* Mate in one */
+	limits.depth = 4;
+	fail_unless(chess_board_set_fen(board, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"));
+	move = chess_search_run(search, board, &limits, &info);
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "a1a8") == 0, "%s", str);
+	fail_unless(info.score == CHESS_SCORE_MATE - 1, "%d", info.score);
+	fail_unless(info.npv == 1 && info.pv[0] == move);
+
+	/* Mate in two */
+	chess_search_clear(search);
+	fail_unless(chess_board_set_fen(board, "k7/8/2K5/8/8/8/8/7R w - - 0 1"));
+	move = chess_search_run(search, board, &limits, &info);
+	fail_unless(info.score == CHESS_SCORE_MATE - 3, "%d", info.score);
+	fail_unless(chess_board_get_side(board) == CHESS_SIDE_WHITE);
+
+	/* Winning a hanging queen with the node limit */
+	chess_search_clear(search);
+	limits.depth = 0;
+	limits.nodes = 20000;
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/3q4/8/8/3R4/4K3 w - - 0 1"));
+	move = chess_search_run(search, board, &limits, &info);
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "d2d5") == 0, "%s", str);
+	fail_unless(info.depth >= 1);
+
+	/* Checkmated and stalemated */
+	fail_unless(chess_board_set_fen(board, "R5k1/5ppp/8/8/8/8/8/6K1 b - - 1 1"));
+	fail_unless(chess_search_run(search, board, &limits, &info) == CHESS_MOVE_NONE);
+	fail_unless(info.score == -CHESS_SCORE_MATE);
+	fail_unless(chess_board_set_fen(board, "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1"));
+	fail_unless(chess_search_run(search, board, &limits, &info) == CHESS_MOVE_NONE);
+	fail_unless(info.score == 0);
+
+	chess_search_free(search);
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_search_multipv)
+{
+	unsigned n;
+	char str[8];
+	struct chess_board *board;
+	struct chess_search *search;
+	struct chess_search_limits limits;
+	struct chess_search_info lines[5];
+
+	board = chess_board_init();
+	search = chess_search_init(1 << 20);
+	fail_unless(board != NULL && search != NULL);
+	memset(&limits, 0, sizeof(limits));
+	limits.depth = 3;
+
+	/* The hanging queen first, then distinct moves in decreasing order */
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/3q4/8/8/3R4/4K3 w - - 0 1"));
+	n = chess_search_run_multipv(search, board, &limits, lines, 3);
+	fail_unless(n == 3, "%u", n);
+	chess_move_get_string(lines[0].pv[0], str, sizeof(str));
+	fail_unless(strcmp(str, "d2d5") == 0, "%s", str);
+	for (unsigned i = 0; i < n; i++) {
+		fail_unless(lines[i].depth == 3 && lines[i].npv >= 1);
+		fail_unless(chess_board_is_legal_move(board, lines[i].pv[0]));
+		for (unsigned j = 0; j < i; j++)
+			fail_unless(lines[j].pv[0] != lines[i].pv[0]);
+		if (i > 0)
+			fail_unless(lines[i].score <= lines[i - 1].score);
+	}
+	fail_unless(lines[0].score > lines[1].score + 500, "%d %d", lines[0].score, lines[1].score);
+
+	/* No more lines than legal moves */
+	fail_unless(chess_board_set_fen(board, "k7/8/8/8/8/8/8/7K w - - 0 1"));
+	fail_unless(chess_search_run_multipv(search, board, &limits, lines, 5) == 3);
+	fail_unless(chess_board_set_fen(board, "R5k1/5ppp/8/8/8/8/8/6K1 b - - 1 1"));
+	fail_unless(chess_search_run_multipv(search, board, &limits, lines, 5) == 0);
+
+	chess_search_free(search);
+	free(board);
+}
+END_TEST
+
+struct async_progress {
+	unsigned calls;
+	unsigned depth;
+	unsigned nlines;
+	unsigned long long nodes;
+};
+
+static void
+async_callback(const struct chess_search_info *lines, unsigned nlines, void *data)
+{
+	struct async_progress *progress = data;
+
+	++progress->calls;
+	progress->depth = lines[0].depth;
+	progress->nlines = nlines;
+	__atomic_store_n(&progress->nodes, lines[0].nodes, __ATOMIC_RELAXED);
+}
+
+START_TEST(test_chess_search_async)
+{
+	unsigned move;
+	unsigned long long nodes;
+	char str[8];
+	struct timespec before, after;
+	const struct timespec delay = { 0, 50000000 };
+	const struct timespec tick = { 0, 100000 };
+	struct chess_board *board, *copy;
+	struct chess_search *search;
+	struct chess_search_limits limits;
+	struct chess_search_info lines[2];
+	struct async_progress progress;
+
+	board = chess_board_init();
+	copy = chess_board_init();
+	search = chess_search_init(1 << 20);
+	fail_unless(board != NULL && copy != NULL && search != NULL);
+	memset(&limits, 0, sizeof(limits));
+	memset(&progress, 0, sizeof(progress));
+
+	/* The board is copied, the last iteration is delivered before the wait returns */
+	limits.depth = 4;
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/3q4/8/8/3R4/4K3 w - - 0 1"));
+	chess_board_copy(copy, board);
+	fail_unless(chess_board_get_hash(copy) == chess_board_get_hash(board));
+	fail_unless(chess_search_start(search, copy, &limits, 2, 0, async_callback, &progress) == 0);
+	fail_unless(chess_search_start(search, copy, &limits, 2, 0, NULL, NULL) < 0 && errno == EBUSY);
+	fail_unless(chess_board_set_fen(copy, CHESS_FEN_STARTPOS));
+	move = chess_search_wait(search, lines);
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "d2d5") == 0, "%s", str);
+	fail_unless(lines[0].depth == 4 && lines[1].depth == 4);
+	fail_unless(progress.calls >= 1 && progress.depth == 4 && progress.nlines == 2);
+	fail_unless(chess_search_wait(search, NULL) == CHESS_MOVE_NONE);
+
+	/* An unlimited search stops promptly */
+	limits.depth = 0;
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(chess_search_start(search, board, &limits, 1, 0, NULL, NULL) == 0);
+	nanosleep(&delay, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	chess_search_stop(search);
+	move = chess_search_wait(search, lines);
+	clock_gettime(CLOCK_MONOTONIC, &after);
+	fail_unless(chess_board_is_legal_move(board, move));
+	fail_unless((after.tv_sec - before.tv_sec) * 1000 + (after.tv_nsec - before.tv_nsec) / 1000000 < 20);
+
+	/* Pondering ignores the depth limit until the ponder hit */
+	limits.depth = 2;
+	memset(&progress, 0, sizeof(progress));
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/3q4/8/8/3R4/4K3 w - - 0 1"));
+	fail_unless(chess_search_start(search, board, &limits, 1, CHESS_SEARCH_PONDER,
+				async_callback, &progress) == 0);
+	nanosleep(&delay, NULL);
+	chess_search_ponderhit(search);
+	move = chess_search_wait(search, lines);
+	fail_unless(strcmp(chess_move_get_string(move, str, sizeof(str)), "d2d5") == 0, "%s", str);
+	fail_unless(lines[0].depth > 2 && progress.depth == lines[0].depth);
+
+	/* The node limit counts from the ponder hit as well: the hit follows
+	 * the first iteration past the limit, the search goes on for as many
+	 * nodes again.
+	 */
+	limits.depth = 0;
+	limits.nodes = 200000;
+	memset(&progress, 0, sizeof(progress));
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(chess_search_start(search, board, &limits, 1, CHESS_SEARCH_PONDER,
+				async_callback, &progress) == 0);
+	while ((nodes = __atomic_load_n(&progress.nodes, __ATOMIC_RELAXED)) <= limits.nodes)
+		nanosleep(&tick, NULL);
+	chess_search_ponderhit(search);
+	move = chess_search_wait(search, lines);
+	fail_unless(chess_board_is_legal_move(board, move));
+	fail_unless(lines[0].nodes >= nodes + limits.nodes, "%llu %llu", lines[0].nodes, nodes);
+
+	chess_search_free(search);
+	free(copy);
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_stats)
+{
+	char line[128];
+	unsigned long long value;
+	bool found;
+	FILE *fp;
+	struct chess_board *board;
+	struct chess_stats before, after;
+	const char *path = "check_libchess.prom";
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	chess_stats_snapshot(&before);
+	chess_board_set_piece(board, 0, CHESS_PIECE_ROOK, CHESS_SIDE_WHITE);
+	chess_board_set_piece(board, 1, CHESS_PIECE_ROOK, CHESS_SIDE_WHITE);
+	chess_board_clear_piece(board, 0, CHESS_PIECE_ROOK, CHESS_SIDE_WHITE);
+	chess_stats_snapshot(&after);
+
+	if (chess_stats_enabled()) {
+		fail_unless(after.counters[CHESS_STATS_SET_PIECE] - before.counters[CHESS_STATS_SET_PIECE] == 2);
+		fail_unless(after.counters[CHESS_STATS_CLEAR_PIECE] - before.counters[CHESS_STATS_CLEAR_PIECE] == 1);
+	}
+	else {
+		for (int i = 0; i < CHESS_STATS_MAX; i++)
+			fail_unless(after.counters[i] == 0);
+	}
+
+	fail_unless(strcmp(chess_stats_name(CHESS_STATS_SET_PIECE), "set_piece") == 0);
+	fail_unless(chess_stats_name(CHESS_STATS_MAX) == NULL);
+
+	fail_unless(chess_stats_export(path) == 0);
+	fp = fopen(path, "r");
+	fail_unless(fp != NULL);
+	found = false;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "libchess_set_piece_total %llu", &value) == 1) {
+			fail_unless(value >= after.counters[CHESS_STATS_SET_PIECE]);
+			found = true;
+		}
+	}
+	fail_unless(found);
+	fclose(fp);
+	unlink(path);
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_batch_attacks)
+{
+	unsigned n, seed, mobility[37], count;
+	unsigned moves[CHESS_MOVES_MAX];
+	unsigned long long attacks[37];
+	struct chess_board *board[37];
+	struct chess_batch *batch;
+	struct chess_undo undo;
+
+	batch = chess_batch_init(37);
+	fail_unless(batch != NULL);
+	fail_unless(chess_batch_get_size(batch) == 37);
+	fail_unless(chess_batch_set_backend(CHESS_BATCH_SCALAR));
+	fail_if(chess_batch_set_backend(-1));
+
+	/* Positions from random games, all with a different number of moves */
+	seed = 1;
+	for (unsigned i = 0; i < 37; i++) {
+		board[i] = chess_board_init();
+		fail_unless(board[i] != NULL);
+		chess_board_set_fen(board[i], CHESS_FEN_STARTPOS);
+		for (unsigned ply = 0; ply < i; ply++) {
+			n = chess_board_generate_moves(board[i], moves);
+			if (n == 0)
+				break;
+			seed = seed * 1103515245 + 12345;
+			chess_board_make_move(board[i], moves[(seed >> 16) % n], &undo);
+		}
+		chess_batch_set_board(batch, i, board[i]);
+	}
+
+	for (int backend = CHESS_BATCH_SCALAR; backend <= CHESS_BATCH_AVX512; backend++) {
+		if (!chess_batch_set_backend(backend))
+			continue;
+		fail_unless(chess_batch_get_backend() == backend);
+		for (int side = CHESS_SIDE_WHITE; side <= CHESS_SIDE_BLACK; side++) {
+			chess_batch_attacks(batch, side, attacks, mobility);
+			for (unsigned i = 0; i < 37; i++) {
+				count = 0;
+				for (int sq = 0; sq < 64; sq++) {
+					fail_unless(((attacks[i] >> sq) & 1) == chess_board_is_attacked(board[i], sq, side),
+							"backend %d, board %u, square %d", backend, i, sq);
+					if (((attacks[i] >> sq) & 1) && !chess_board_has_piece(board[i], sq, side))
+						++count;
+				}
+				fail_unless(mobility[i] == count);
+			}
+		}
+	}
+
+	for (unsigned i = 0; i < 37; i++)
+		free(board[i]);
+	chess_batch_free(batch);
+}
+END_TEST
+
+START_TEST(test_chess_sliders)
+{
+	unsigned long long seed, occ;
+
+	initmagicmoves();
+	sliders_init();
+
+	seed = 1;
+	for (int sq = 0; sq < 64; sq++) {
+		for (int i = 0; i < 256; i++) {
+			/* Sparse and dense occupancies, with and without the square */
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			occ = seed;
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			occ = (i & 1) ? occ & seed : occ | seed;
+			fail_unless(sliders_bishop(sq, occ) == Bmagic(sq, occ),
+					"bishop on %d, occupancy %llx", sq, occ);
+			fail_unless(sliders_rook(sq, occ) == Rmagic(sq, occ),
+					"rook on %d, occupancy %llx", sq, occ);
+		}
+		fail_unless(sliders_bishop(sq, 0) == Bmagic(sq, 0));
+		fail_unless(sliders_rook(sq, ~0ULL) == Rmagic(sq, ~0ULL));
+	}
+}
+END_TEST
+
+static int
+compare_moves(const void *a, const void *b)
+{
+	return *(const unsigned *)a - *(const unsigned *)b;
+}
+
+START_TEST(test_chess_picker)
+{
+	int them;
+	unsigned n, count, move, stage, seed, killer;
+	unsigned moves[CHESS_MOVES_MAX], picked[CHESS_MOVES_MAX];
+	bool tactical, legal;
+	struct chess_board *board;
+	struct chess_picker picker;
+	struct chess_undo undo;
+	const char *fens[] = {
+		CHESS_FEN_STARTPOS,
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+		"8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1",
+		"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+	};
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	seed = 7;
+	for (unsigned f = 0; f < sizeof(fens) / sizeof(fens[0]); f++) {
+		fail_unless(chess_board_set_fen(board, fens[f]));
+		for (unsigned ply = 0; ply < 8; ply++) {
+			n = chess_board_generate_moves(board, moves);
+			if (n == 0)
+				break;
+			qsort(moves, n, sizeof(unsigned), compare_moves);
+			them = chess_switch_side(chess_board_get_side(board));
+
+			/* The legality check agrees with the generator on every encoding */
+			for (move = 0; move < 0x10000; move++) {
+				legal = bsearch(&move, moves, n, sizeof(unsigned), compare_moves) != NULL;
+				fail_unless(chess_board_is_legal_move(board, move) == legal,
+						"%s, move %x", fens[f], move);
+			}
+
+			/* Every legal move exactly once, stage by stage */
+			seed = seed * 1103515245 + 12345;
+			killer = moves[(seed >> 16) % n];
+			chess_picker_init(&picker, moves[n / 2], killer, 0x0fff, CHESS_PICKER_MVV_LVA);
+			count = 0;
+			stage = 0;
+			while ((move = chess_picker_next(&picker, board)) != CHESS_MOVE_NONE) {
+				fail_unless(count < n);
+				picked[count++] = move;
+				tactical = chess_board_has_piece(board, chess_move_to(move), them)
+					|| (chess_move_flags(move) & CHESS_MOVE_FLAG_ENPASSANT)
+					|| chess_move_promotion(move) == CHESS_PIECE_QUEEN;
+				if (count == 1)
+					fail_unless(move == moves[n / 2]);
+				else if (tactical) {
+					fail_unless(stage <= 1);
+					stage = 1;
+				}
+				else if (move == killer) {
+					fail_unless(stage <= 2);
+					stage = 2;
+				}
+				else
+					stage = 3;
+			}
+			fail_unless(count == n);
+			qsort(picked, n, sizeof(unsigned), compare_moves);
+			fail_unless(memcmp(picked, moves, n * sizeof(unsigned)) == 0);
+
+			/* Only the tactical moves */
+			chess_picker_init(&picker, CHESS_MOVE_NONE, CHESS_MOVE_NONE, CHESS_MOVE_NONE,
+					CHESS_PICKER_TACTICAL);
+			while ((move = chess_picker_next(&picker, board)) != CHESS_MOVE_NONE)
+				fail_unless(chess_board_has_piece(board, chess_move_to(move), them)
+						|| (chess_move_flags(move) & CHESS_MOVE_FLAG_ENPASSANT)
+						|| chess_move_promotion(move) == CHESS_PIECE_QUEEN);
+
+			chess_board_make_move(board, moves[(seed >> 20) % n], &undo);
+		}
+	}
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_board_count_moves)
+{
+	unsigned n, seed;
+	unsigned moves[CHESS_MOVES_MAX];
+	struct chess_board *board;
+	struct chess_undo undo;
+	const char *fens[] = {
+		CHESS_FEN_STARTPOS,
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		"8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1",
+		"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+	};
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	/* Random games from positions with pins, checks and promotions */
+	seed = 3;
+	for (unsigned f = 0; f < sizeof(fens) / sizeof(fens[0]); f++) {
+		for (unsigned game = 0; game < 20; game++) {
+			fail_unless(chess_board_set_fen(board, fens[f]));
+			for (unsigned ply = 0; ply < 200; ply++) {
+				n = chess_board_generate_moves(board, moves);
+				fail_unless(chess_board_count_moves(board) == n, "%s, game %u, ply %u", fens[f], game, ply);
+				if (n == 0)
+					break;
+				seed = seed * 1103515245 + 12345;
+				chess_board_make_move(board, moves[(seed >> 16) % n], &undo);
+			}
+		}
+	}
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_board_gives_check)
+{
+	unsigned n, nchecks, count, seed, j;
+	bool check;
+	unsigned moves[CHESS_MOVES_MAX], checks[CHESS_MOVES_MAX];
+	struct chess_board *board;
+	struct chess_undo undo;
+	const char *fens[] = {
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+		/* Castling and en passant giving check */
+		"5k2/8/8/8/8/8/8/4K2R w K - 0 1",
+		"8/8/8/k2pP2R/8/8/8/4K3 w - d6 0 1",
+		/* Discovered checks and promotions */
+		"4k3/1P4P1/2P5/8/BK2N3/8/8/4R3 w - - 0 1",
+	};
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+
+	fail_unless(chess_board_set_fen(board, fens[4]));
+	n = chess_board_generate_checks(board, checks);
+	fail_unless(n == 3, "%u", n); /* O-O, Rf1 and Rh8 */
+	fail_unless(chess_board_set_fen(board, fens[5]));
+	fail_unless(chess_board_gives_check(board, chess_board_parse_move(board, "e5d6")));
+
+	/* Every move checks exactly when the position after it is in check, the
+	 * generated checks are those moves.
+	 */
+	seed = 5;
+	for (unsigned f = 0; f < sizeof(fens) / sizeof(fens[0]); f++) {
+		for (unsigned game = 0; game < 10; game++) {
+			fail_unless(chess_board_set_fen(board, fens[f]));
+			for (unsigned ply = 0; ply < 100; ply++) {
+				n = chess_board_generate_moves(board, moves);
+				nchecks = chess_board_generate_checks(board, checks);
+				count = 0;
+				for (unsigned i = 0; i < n; i++) {
+					chess_board_make_move(board, moves[i], &undo);
+					check = chess_board_in_check(board);
+					chess_board_unmake_move(board, moves[i], &undo);
+					fail_unless(chess_board_gives_check(board, moves[i]) == check,
+							"%s, game %u, ply %u", fens[f], game, ply);
+					if (!check)
+						continue;
+					for (j = 0; j < nchecks && checks[j] != moves[i]; j++)
+						;
+					fail_unless(j < nchecks, "%s, game %u, ply %u", fens[f], game, ply);
+					++count;
+				}
+				fail_unless(count == nchecks);
+				if (n == 0)
+					break;
+				seed = seed * 1103515245 + 12345;
+				chess_board_make_move(board, moves[(seed >> 16) % n], &undo);
+			}
+		}
+	}
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_board_bitboards)
+{
+	int piece, side, n;
+	unsigned seed;
+	unsigned long long b, occ, attackers;
+	unsigned moves[CHESS_MOVES_MAX];
+	struct chess_board *board;
+	struct chess_undo undo;
+
+	/* Exported and inline helpers agree */
+	b = 0;
+	for (unsigned i = 0; i < 1000; i++) {
+		b = b * 6364136223846793005ULL + 1442695040888963407ULL;
+		fail_unless(chess_bb_count(b) == chess_inline_bb_count(b));
+		fail_unless(chess_bb_lsb(b) == chess_inline_bb_lsb(b));
+		fail_unless(chess_bb_msb(b) == chess_inline_bb_msb(b));
+	}
+	fail_unless(chess_knight_attacks(0) == 0x0000000000020400ULL);
+	fail_unless(chess_rook_attacks(0, 0x0000000000000110ULL) == 0x000000000000011eULL);
+	fail_unless(chess_pawn_attacks(CHESS_SIDE_BLACK, 9) == 0x0000000000000005ULL);
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+	fail_unless(chess_board_set_fen(board, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+	seed = 7;
+	for (unsigned ply = 0; ply < 200; ply++) {
+		/* The bitboards match the mailbox */
+		for (int sq = 0; sq < 64; sq++) {
+			if (!chess_board_get_piece(board, sq, &piece, &side))
+				fail_unless(((chess_board_get_occupied(board, CHESS_SIDE_WHITE)
+							| chess_board_get_occupied(board, CHESS_SIDE_BLACK)) >> sq & 1) == 0);
+			else
+				fail_unless((chess_board_get_pieces(board, side, piece) >> sq & 1) != 0);
+		}
+
+		/* Attacks rebuilt from the public tables match the library's */
+		occ = chess_board_get_occupied(board, CHESS_SIDE_WHITE) | chess_board_get_occupied(board, CHESS_SIDE_BLACK);
+		for (int sq = 0; sq < 64; sq++) {
+			for (side = CHESS_SIDE_WHITE; side <= CHESS_SIDE_BLACK; side++) {
+				attackers = (chess_pawn_attacks(!side, sq) & chess_board_get_pieces(board, side, CHESS_PIECE_PAWN))
+					| (chess_knight_attacks(sq) & chess_board_get_pieces(board, side, CHESS_PIECE_KNIGHT))
+					| (chess_bishop_attacks(sq, occ) & chess_board_get_pieces(board, side, CHESS_PIECE_BISHOP))
+					| (chess_rook_attacks(sq, occ) & chess_board_get_pieces(board, side, CHESS_PIECE_ROOK))
+					| (chess_queen_attacks(sq, occ) & chess_board_get_pieces(board, side, CHESS_PIECE_QUEEN))
+					| (chess_king_attacks(sq) & chess_board_get_pieces(board, side, CHESS_PIECE_KING));
+				fail_unless((attackers != 0) == chess_board_is_attacked(board, sq, side));
+			}
+		}
+
+		n = chess_board_generate_moves(board, moves);
+		if (n == 0)
+			break;
+		seed = seed * 1103515245 + 12345;
+		chess_board_make_move(board, moves[(seed >> 16) % n], &undo);
+	}
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_inline)
+{
+	int piece, side, ipiece, iside, sq, n;
+	unsigned seed, move;
+	unsigned long long b;
+	unsigned moves[CHESS_MOVES_MAX];
+	struct chess_board *board;
+	struct chess_undo undo;
+
+	for (sq = 0; sq < 64; sq++) {
+		fail_unless(chess_inline_rank(sq) == chess_rank(sq));
+		fail_unless(chess_inline_file(sq) == chess_file(sq));
+		fail_unless(chess_inline_file_char(sq) == chess_file_char(sq));
+		fail_unless(chess_inline_square(chess_rank(sq), chess_file(sq)) == sq);
+		fail_unless(chess_inline_square_left(sq) == chess_square_left(sq));
+		fail_unless(chess_inline_square_right(sq) == chess_square_right(sq));
+		fail_unless(chess_inline_square_up(sq) == chess_square_up(sq));
+		fail_unless(chess_inline_square_down(sq) == chess_square_down(sq));
+		fail_unless(chess_inline_square_border(sq) == chess_square_border(sq));
+	}
+	fail_unless(chess_inline_switch_side(CHESS_SIDE_WHITE) == chess_switch_side(CHESS_SIDE_WHITE));
+
+	b = 0x8100000000000412ULL;
+	fail_unless(chess_inline_bb_count(b) == 5);
+	fail_unless(chess_inline_bb_lsb(b) == 1 && chess_inline_bb_msb(b) == 63);
+	n = 0;
+	while (b)
+		n += chess_inline_bb_pop(&b);
+	fail_unless(n == 1 + 4 + 10 + 56 + 63);
+
+	board = chess_board_init();
+	fail_unless(board != NULL);
+	fail_unless(chess_board_set_fen(board, "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"));
+	seed = 3;
+	for (unsigned ply = 0; ply < 200; ply++) {
+		fail_unless(chess_inline_board_get_side(board) == chess_board_get_side(board));
+		fail_unless(chess_inline_board_get_hash(board) == chess_board_get_hash(board));
+		fail_unless(chess_inline_board_get_enpassant_square(board) == chess_board_get_enpassant_square(board));
+		fail_unless(chess_inline_board_get_castling_flags(board) == chess_board_get_castling_flags(board));
+		fail_unless(chess_inline_board_get_rhmc(board) == chess_board_get_rhmc(board));
+		fail_unless(chess_inline_board_get_fmc(board) == chess_board_get_fmc(board));
+		for (sq = 0; sq < 64; sq++) {
+			fail_unless(chess_inline_board_get_piece(board, sq, &ipiece, &iside)
+					== chess_board_get_piece(board, sq, &piece, &side));
+			fail_unless(ipiece == piece && iside == side);
+			fail_unless(chess_inline_board_has_piece(board, sq, CHESS_SIDE_BLACK)
+					== chess_board_has_piece(board, sq, CHESS_SIDE_BLACK));
+		}
+
+		n = chess_board_generate_moves(board, moves);
+		if (n == 0)
+			break;
+		seed = seed * 1103515245 + 12345;
+		move = moves[(seed >> 16) % n];
+		fail_unless(chess_inline_move_from(move) == chess_move_from(move));
+		fail_unless(chess_inline_move_to(move) == chess_move_to(move));
+		fail_unless(chess_inline_move_promotion(move) == chess_move_promotion(move));
+		fail_unless(chess_inline_move_flags(move) == chess_move_flags(move));
+		chess_board_make_move(board, move, &undo);
+	}
+
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_board_flip)
+{
+	unsigned n, seed;
+	unsigned long long hash, flipped, canonical;
+	char fen[128], orig[128];
+	unsigned moves[CHESS_MOVES_MAX];
+	struct chess_board *board, *copy;
+	struct chess_undo undo;
+	const char *fens[] = {
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1",
+		"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+	};
+
+	board = chess_board_init();
+	copy = chess_board_init();
+	fail_unless(board != NULL && copy != NULL);
+
+	fail_unless(chess_board_set_fen(board, fens[2]));
+	chess_board_flip(board);
+	fail_unless(strcmp(chess_board_get_fen(board, fen, sizeof(fen)), "4k3/8/8/3pP3/2K5/8/8/8 w - d6 0 1") == 0, "%s", fen);
+	fail_unless(chess_board_mirror(board));
+	fail_unless(strcmp(chess_board_get_fen(board, fen, sizeof(fen)), "3k4/8/8/3Pp3/5K2/8/8/8 w - e6 0 1") == 0, "%s", fen);
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(!chess_board_mirror(board));
+
+	seed = 11;
+	for (unsigned f = 0; f < sizeof(fens) / sizeof(fens[0]); f++) {
+		fail_unless(chess_board_set_fen(board, fens[f]));
+		for (unsigned ply = 0; ply < 200; ply++) {
+			/* The transformed boards hash like boards set from their FEN
+			 * and have as many moves, the canonical key is shared.
+			 */
+			chess_board_get_fen(board, orig, sizeof(orig));
+			hash = chess_board_get_hash(board);
+			canonical = chess_board_get_canonical_hash(board);
+			n = chess_board_count_moves(board);
+
+			chess_board_copy(copy, board);
+			chess_board_flip(copy);
+			fail_unless(chess_board_get_canonical_hash(copy) == canonical, "%s", orig);
+			fail_unless(chess_board_count_moves(copy) == n, "%s", orig);
+			flipped = chess_board_get_hash(copy);
+			chess_board_get_fen(copy, fen, sizeof(fen));
+			fail_unless(chess_board_set_fen(copy, fen));
+			fail_unless(chess_board_get_hash(copy) == flipped, "%s", orig);
+			chess_board_flip(copy);
+			fail_unless(chess_board_get_hash(copy) == hash, "%s", orig);
+
+			if (chess_board_mirror(copy)) {
+				fail_unless(chess_board_get_canonical_hash(copy) == canonical, "%s", orig);
+				fail_unless(chess_board_count_moves(copy) == n, "%s", orig);
+				fail_unless(chess_board_mirror(copy));
+				fail_unless(chess_board_get_hash(copy) == hash, "%s", orig);
+			}
+			fail_unless(strcmp(chess_board_get_fen(copy, fen, sizeof(fen)), orig) == 0, "%s", orig);
+
+			n = chess_board_generate_moves(board, moves);
+			if (n == 0)
+				break;
+			seed = seed * 1103515245 + 12345;
+			chess_board_make_move(board, moves[(seed >> 16) % n], &undo);
+		}
+	}
+
+	free(copy);
+	free(board);
+}
+END_TEST
+
+/* Keys spread like Zobrist keys, from the SplitMix64 generator */
+static uint64_t
+filter_key(unsigned long long *seed)
+{
+	uint64_t z;
+
+	z = (*seed += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+START_TEST(test_chess_filter)
+{
+	unsigned long long seed, fp;
+	struct chess_filter *filter;
+	const char *path = "check_libchess.blm";
+
+	fail_unless(chess_filter_init(1000, 0) == NULL && errno == EINVAL);
+	filter = chess_filter_init(100000, 0.01);
+	fail_unless(filter != NULL);
+	fail_unless(chess_filter_get_size(filter) < 100000 * 12 / 8 + 4096, "%zu", chess_filter_get_size(filter));
+
+	/* No inserted key is missed and the false positive rate is kept */
+	seed = 1;
+	for (unsigned i = 0; i < 100000; i++)
+		fail_unless(!chess_filter_insert(filter, filter_key(&seed)) || i > 0);
+	fail_unless(chess_filter_get_count(filter) > 100000 - 2000);
+	seed = 1;
+	for (unsigned i = 0; i < 100000; i++)
+		fail_unless(chess_filter_contains(filter, filter_key(&seed)));
+	fp = 0;
+	for (unsigned i = 0; i < 100000; i++)
+		fp += chess_filter_contains(filter, filter_key(&seed));
+	fail_unless(fp > 500 && fp < 1500, "%llu", fp);
+	chess_filter_free(filter);
+
+	/* Persistence */
+	unlink(path);
+	filter = chess_filter_open(path, 1000, 0.001);
+	fail_unless(filter != NULL);
+	{
+		bool held[4];
+		uint64_t keys[4] = { 1, 2, 1, 3 };
+
+		fail_unless(chess_filter_insert_batch(filter, keys, 4, held) == 3);
+		fail_unless(!held[0] && !held[1] && held[2] && !held[3]);
+	}
+	fail_unless(chess_filter_sync(filter) == 0);
+	chess_filter_free(filter);
+
+	filter = chess_filter_open(path, 1, 0.5);
+	fail_unless(filter != NULL);
+	fail_unless(chess_filter_get_count(filter) == 3);
+	fail_unless(chess_filter_contains(filter, 1) && chess_filter_contains(filter, 3));
+	fail_unless(chess_filter_get_size(filter) > 1000);
+	chess_filter_free(filter);
+	unlink(path);
+}
+END_TEST
+
+START_TEST(test_chess_solver)
+{
+	char str[8];
+	struct chess_board *board;
+	struct chess_solver *solver;
+	struct chess_solver_result result;
+	struct chess_undo undo;
+
+	board = chess_board_init();
+	solver = chess_solver_init(1 << 20);
+	fail_unless(board != NULL && solver != NULL);
+
+	/* Mate in one */
+	fail_unless(chess_board_set_fen(board, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"));
+	fail_unless(chess_solver_run(solver, board, 0, 1, 0, &result) == CHESS_SOLVER_PROVEN);
+	fail_unless(result.npv == 1);
+	fail_unless(strcmp(chess_move_get_string(result.pv[0], str, sizeof(str)), "a1a8") == 0, "%s", str);
+
+	/* Smothered mate, with checks only */
+	fail_unless(chess_board_set_fen(board, "r1r4k/6pp/8/3Q2N1/8/8/8/6K1 w - - 0 1"));
+	fail_unless(chess_solver_run(solver, board, 0, 2, 0, &result) == CHESS_SOLVER_PROVEN);
+	fail_unless(result.npv == 7, "%u", result.npv);
+	fail_unless(strcmp(chess_move_get_string(result.pv[0], str, sizeof(str)), "g5f7") == 0, "%s", str);
+	for (unsigned i = 0; i < result.npv; i++)
+		chess_board_make_move(board, result.pv[i], &undo);
+	fail_unless(chess_board_in_check(board) && chess_board_count_moves(board) == 0);
+
+	/* The mate in two starts with a quiet move */
+	fail_unless(chess_board_set_fen(board, "k7/8/2K5/8/8/8/8/7R w - - 0 1"));
+	fail_unless(chess_solver_run(solver, board, 0, 1, 0, &result) == CHESS_SOLVER_DISPROVEN);
+	fail_unless(chess_solver_run(solver, board, 0, 1, CHESS_SOLVER_ALL_MOVES, &result) == CHESS_SOLVER_PROVEN);
+	fail_unless(result.npv == 3, "%u", result.npv);
+
+	/* No checks, and no mate within the node limit */
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_unless(chess_solver_run(solver, board, 0, 1, 0, &result) == CHESS_SOLVER_DISPROVEN);
+	fail_unless(chess_solver_run(solver, board, 5000, 2, CHESS_SOLVER_ALL_MOVES, &result) == CHESS_SOLVER_UNKNOWN);
+	fail_unless(result.nodes >= 5000);
+
+	/* Lines cut at the ply limit transpose into shallower ones, the cut
+	 * children keep their numbers and the checks run out.
+	 */
+	solve_set_ply_max(solver, 9);
+	fail_unless(chess_board_set_fen(board, "4k3/8/8/8/8/8/8/R3K2R w - - 0 1"));
+	fail_unless(chess_solver_run(solver, board, 1000000, 1, 0, &result) == CHESS_SOLVER_DISPROVEN,
+			"%llu", result.nodes);
+
+	chess_solver_free(solver);
+	free(board);
+}
+END_TEST
+
+START_TEST(test_chess_search_shared)
+{
+	char name[64];
+	struct chess_board *board;
+	struct chess_search *first, *second;
+	struct chess_search_limits limits;
+	struct chess_search_table_stats stats;
+
+	snprintf(name, sizeof(name), "/check_libchess_tt_%d", (int)getpid());
+	chess_search_unlink_shared(name);
+
+	fail_unless(chess_search_init_shared(name, 1 << 20, CHESS_SEARCH_SHARED_EXISTING) == NULL);
+	fail_unless(errno == ENOENT);
+
+	board = chess_board_init();
+	first = chess_search_init_shared(name, 1 << 20, 0);
+	second = chess_search_init_shared(name, 1 << 24, CHESS_SEARCH_SHARED_EXISTING);
+	fail_unless(board != NULL && first != NULL && second != NULL);
+
+	memset(&limits, 0, sizeof(limits));
+	limits.depth = 5;
+	fail_unless(chess_board_set_fen(board, CHESS_FEN_STARTPOS));
+	fail_if(chess_search_run(first, board, &limits, NULL) == CHESS_MOVE_NONE);
+
+	/* The attached search sees the first one's entries and counters */
+	chess_search_get_table_stats(second, &stats);
+	fail_unless(stats.shared);
+	fail_unless(stats.size == (1 << 20) / 16);
+	fail_unless(stats.used > 0 && stats.used <= stats.size);
+	fail_unless(stats.used == stats.current);
+	fail_unless(stats.torn == 0);
+	fail_unless(stats.searches == 1);
+	fail_unless(stats.stores > 0 && stats.probes > 0);
+
+	fail_if(chess_search_run(second, board, &limits, NULL) == CHESS_MOVE_NONE);
+	chess_search_get_table_stats(first, &stats);
+	fail_unless(stats.searches == 2);
+	fail_unless(stats.hits > 0);
+
+	fail_unless(chess_search_unlink_shared(name) == 0);
+	chess_search_free(first);
+	chess_search_free(second);
+	free(board);
+}
+END_TEST
+
 static Suite *chess_suite(void)
 {
 	Suite *s = suite_create("Chess");
@@ -574,6 +2022,33 @@ static Suite *chess_suite(void)
 	tcase_add_test(tc_chess, test_chess_board_fmc);
 	tcase_add_test(tc_chess, test_chess_board_piece);
 	tcase_add_test(tc_chess, test_chess_board_get_fen);
+	tcase_add_test(tc_chess, test_chess_board_set_fen);
+	tcase_add_test(tc_chess, test_chess_board_hash);
+	tcase_add_test(tc_chess, test_chess_board_perft);
+	tcase_add_test(tc_chess, test_chess_board_parse_san);
+	tcase_add_test(tc_chess, test_chess_pgn_read_game);
+	tcase_add_test(tc_chess, test_chess_index);
+	tcase_add_test(tc_chess, test_chess_board_chess960);
+	tcase_add_test(tc_chess, test_chess_board_repetition);
+	tcase_add_test(tc_chess, test_chess_board_draw);
+	tcase_add_test(tc_chess, test_chess_evaluate);
+	tcase_add_test(tc_chess, test_chess_evaluate_batch);
+	tcase_add_test(tc_chess, test_chess_eval_params);
+	tcase_add_test(tc_chess, test_chess_search_run);
+	tcase_add_test(tc_chess, test_chess_search_multipv);
+	tcase_add_test(tc_chess, test_chess_search_async);
+	tcase_add_test(tc_chess, test_chess_search_shared);
+	tcase_add_test(tc_chess, test_chess_board_gives_check);
+	tcase_add_test(tc_chess, test_chess_solver);
+	tcase_add_test(tc_chess, test_chess_board_flip);
+	tcase_add_test(tc_chess, test_chess_inline);
+	tcase_add_test(tc_chess, test_chess_board_bitboards);
+	tcase_add_test(tc_chess, test_chess_filter);
+	tcase_add_test(tc_chess, test_chess_stats);
+	tcase_add_test(tc_chess, test_chess_batch_attacks);
+	tcase_add_test(tc_chess, test_chess_sliders);
+	tcase_add_test(tc_chess, test_chess_picker);
+	tcase_add_test(tc_chess, test_chess_board_count_moves);
 
 	suite_add_tcase(s, tc_chess);
 
@@ -0,0 +1,565 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * chess-datagen: generate evaluation training data from self-play games
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_search.h"
+
+/*
+ * File format, integers are little endian:
+ *   header: "LCHESSDG", u32 version
+ *   blocks: u32 payload size, u32 number of games, payload
+ * A game in a payload is:
+ *   varint FEN length, FEN of the start position, u8 result (CHESS_RESULT_*),
+ *   varint number of plies, then for every ply the index of the move played
+ *   in the chess_board_generate_moves() order as a byte and the search score
+ *   of the position before it, from white's point of view, as a zigzag
+ *   varint delta from the previous score.
+ * Every position of a game is a (position, score, result) training tuple.
+ */
+#define DATAGEN_MAGIC	"LCHESSDG"
+#define DATAGEN_VERSION	1
+
+#define FEN_MAX		128
+#define PLIES_MAX	400		/* Longer games are adjudicated a draw */
+#define RECORD_MAX	(FEN_MAX + 16 + PLIES_MAX * 4)
+#define RING_SIZE	16		/* Games queued per worker */
+#define BLOCK_SIZE	(1 << 16)	/* Payload size a block is written at */
+
+/* A finished game, encoded by its worker */
+struct record {
+	unsigned game;			/**< Index of the game, the writer keeps their order */
+	size_t len;
+	unsigned char data[RECORD_MAX];
+};
+
+/* Single producer single consumer queue from a worker to the writer */
+struct ring {
+	size_t head __attribute__((aligned(64)));	/**< Written by the worker */
+	size_t tail __attribute__((aligned(64)));	/**< Written by the writer */
+	struct record slots[RING_SIZE];
+};
+
+struct datagen {
+	unsigned long long seed;
+	unsigned ngames;
+	unsigned opening;		/**< Random plies of the openings */
+	struct chess_search_limits limits;
+	size_t memory;
+	unsigned next;			/**< Next game to play, claimed atomically */
+	struct ring *rings;		/**< One per worker */
+};
+
+struct worker {
+	pthread_t thread;
+	struct datagen *datagen;
+	struct ring *ring;
+};
+
+static const struct timespec delay = { 0, 1000000 };
+
+static void
+usage(FILE *out, int code)
+{
+	fprintf(out, "Usage: chess-datagen play [-j THREADS] [-g GAMES] [-n NODES] [-p PLIES] [-s SEED] [-H MEGABYTES] OUTPUT\n");
+	fprintf(out, "       chess-datagen dump FILE\n");
+	fprintf(out, "play plays GAMES self-play games searching NODES nodes per move, each from the\n");
+	fprintf(out, "starting position followed by PLIES random moves drawn from SEED.\n");
+	fprintf(out, "dump prints the (FEN, score, result) tuples of a file.\n");
+	exit(code);
+}
+
+static unsigned long long
+datagen_random(unsigned long long *state)
+{
+	unsigned long long z;
+
+	/* splitmix64 */
+	z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static unsigned char *
+put_varint(unsigned char *p, unsigned long long v)
+{
+	while (v >= 0x80) {
+		*p++ = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+static const unsigned char *
+get_varint(const unsigned char *p, const unsigned char *end, unsigned long long *v)
+{
+	*v = 0;
+	for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+		*v |= (unsigned long long)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80))
+			return p;
+	}
+	return NULL;
+}
+
+static void
+put_u32(unsigned char *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = v >> (8 * i);
+}
+
+static uint32_t
+get_u32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Plays random moves from the starting position, false if the game ended */
+static bool
+play_opening(struct chess_board *board, unsigned plies, unsigned long long *state)
+{
+	unsigned n;
+	unsigned moves[CHESS_MOVES_MAX];
+	struct chess_undo undo;
+
+	chess_board_set_fen(board, CHESS_FEN_STARTPOS);
+	for (unsigned ply = 0; ply < plies; ply++) {
+		n = chess_board_generate_moves(board, moves);
+		if (n == 0)
+			return false;
+		chess_board_make_move(board, moves[datagen_random(state) % n], &undo);
+	}
+	return chess_board_count_moves(board) > 0;
+}
+
+/* Plays a game from the board's position and encodes it into the record */
+static void
+play_game(struct chess_board *board, struct chess_search *search,
+		const struct chess_search_limits *limits, struct record *record)
+{
+	int result, score, delta, last;
+	unsigned n, index, move, nplies;
+	size_t len;
+	char fen[FEN_MAX];
+	unsigned char plies[PLIES_MAX * 4], *p, *q;
+	unsigned moves[CHESS_MOVES_MAX];
+	struct chess_search_info info;
+	struct chess_undo undo;
+
+	chess_board_get_fen(board, fen, sizeof(fen));
+	chess_search_clear(search);
+
+	q = plies;
+	last = 0;
+	for (nplies = 0; ; nplies++) {
+		n = chess_board_generate_moves(board, moves);
+		if (n == 0) {
+			if (!chess_board_in_check(board))
+				result = CHESS_RESULT_DRAW;
+			else if (chess_board_get_side(board) == CHESS_SIDE_WHITE)
+				result = CHESS_RESULT_BLACK_WINS;
+			else
+				result = CHESS_RESULT_WHITE_WINS;
+			break;
+		}
+		if (nplies == PLIES_MAX || chess_board_is_fifty_moves(board)
+				|| chess_board_is_threefold_repetition(board)
+				|| chess_board_is_insufficient_material(board)) {
+			result = CHESS_RESULT_DRAW;
+			break;
+		}
+
+		move = chess_search_run(search, board, limits, &info);
+		for (index = 0; moves[index] != move; index++)
+			;
+		score = chess_board_get_side(board) == CHESS_SIDE_WHITE ? info.score : -info.score;
+		delta = score - last;
+		last = score;
+
+		*q++ = index;
+		q = put_varint(q, (delta < 0) ? ((unsigned)-delta << 1) - 1 : (unsigned)delta << 1);
+		chess_board_make_move(board, move, &undo);
+	}
+
+	len = strlen(fen);
+	p = put_varint(record->data, len);
+	memcpy(p, fen, len);
+	p += len;
+	*p++ = result;
+	p = put_varint(p, nplies);
+	memcpy(p, plies, q - plies);
+	record->len = (p - record->data) + (q - plies);
+}
+
+static void *
+worker(void *arg)
+{
+	unsigned game;
+	unsigned long long state;
+	struct chess_board *board;
+	struct chess_search *search;
+	struct worker *self = arg;
+	struct datagen *datagen = self->datagen;
+	struct ring *ring = self->ring;
+
+	board = chess_board_init();
+	search = chess_search_init(datagen->memory);
+	if (board == NULL || search == NULL) {
+		fprintf(stderr, "chess-datagen: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	while ((game = __atomic_fetch_add(&datagen->next, 1, __ATOMIC_RELAXED)) < datagen->ngames) {
+		/* Every game has its own random stream so the output only
+		 * depends on the seed, not on the number of threads.
+		 */
+		state = datagen->seed ^ ((unsigned long long)game * 0xd1b54a32d192ed03ULL);
+		while (!play_opening(board, datagen->opening, &state))
+			;
+
+		while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == RING_SIZE)
+			nanosleep(&delay, NULL);
+		play_game(board, search, &datagen->limits, &ring->slots[ring->head % RING_SIZE]);
+		ring->slots[ring->head % RING_SIZE].game = game;
+		__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+	}
+
+	chess_search_free(search);
+	free(board);
+	return NULL;
+}
+
+static bool
+write_block(FILE *fp, unsigned char *block, size_t len, unsigned ngames)
+{
+	put_u32(block, len - 8);
+	put_u32(block + 4, ngames);
+	return fwrite(block, 1, len, fp) == len;
+}
+
+/* Drains the rings into blocks in game order, so that the output only depends
+ * on the seed. Each worker plays its games in ascending order, the one with the
+ * next game never waits for the writer to make room for it.
+ */
+static bool
+writer(struct datagen *datagen, unsigned nworkers, FILE *fp, unsigned long long *npositions)
+{
+	bool idle;
+	unsigned ngames, next;
+	size_t len, head;
+	unsigned long long fenlen, nplies;
+	const unsigned char *p;
+	unsigned char *block;
+	struct record *record;
+
+	block = malloc(8 + BLOCK_SIZE + RECORD_MAX);
+	if (block == NULL)
+		return false;
+	len = 8;
+	ngames = 0;
+	next = 0;
+	*npositions = 0;
+
+	while (next < datagen->ngames) {
+		idle = true;
+		for (unsigned i = 0; i < nworkers; i++) {
+			struct ring *ring = &datagen->rings[i];
+
+			head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+			while (ring->tail != head && ring->slots[ring->tail % RING_SIZE].game == next) {
+				record = &ring->slots[ring->tail % RING_SIZE];
+				memcpy(block + len, record->data, record->len);
+				len += record->len;
+				++ngames;
+				++next;
+
+				/* Count the positions, past the FEN and the result */
+				p = get_varint(record->data, record->data + record->len, &fenlen);
+				get_varint(p + fenlen + 1, record->data + record->len, &nplies);
+				*npositions += nplies;
+
+				__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+				idle = false;
+
+				if (len - 8 >= BLOCK_SIZE) {
+					if (!write_block(fp, block, len, ngames))
+						goto fail;
+					len = 8;
+					ngames = 0;
+				}
+			}
+		}
+		if (idle)
+			nanosleep(&delay, NULL);
+	}
+
+	if (ngames && !write_block(fp, block, len, ngames))
+		goto fail;
+	free(block);
+	return true;
+
+fail:
+	free(block);
+	return false;
+}
+
+static int
+play(int argc, char **argv)
+{
+	int opt;
+	unsigned nthreads;
+	unsigned long long npositions;
+	long size;
+	double wall;
+	unsigned char header[12];
+	struct timespec start, end;
+	FILE *fp;
+	struct worker *workers;
+	struct datagen datagen;
+
+	memset(&datagen, 0, sizeof(datagen));
+	datagen.ngames = 100;
+	datagen.opening = 8;
+	datagen.limits.nodes = 5000;
+	datagen.memory = 16;
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	while ((opt = getopt(argc, argv, "j:g:n:p:s:H:")) != -1) {
+		switch (opt) {
+		case 'j':
+			nthreads = strtoul(optarg, NULL, 10);
+			break;
+		case 'g':
+			datagen.ngames = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			datagen.limits.nodes = strtoull(optarg, NULL, 10);
+			break;
+		case 'p':
+			datagen.opening = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			datagen.seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'H':
+			datagen.memory = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(stderr, 1);
+		}
+	}
+	if (argc - optind != 1)
+		usage(stderr, 1);
+	if (nthreads == 0)
+		nthreads = 1;
+	if (datagen.limits.nodes == 0)
+		datagen.limits.nodes = 1;
+	datagen.memory <<= 20;
+
+	fp = fopen(argv[optind], "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "chess-datagen: %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	memcpy(header, DATAGEN_MAGIC, 8);
+	put_u32(header + 8, DATAGEN_VERSION);
+	fwrite(header, 1, sizeof(header), fp);
+
+	workers = calloc(nthreads, sizeof(struct worker));
+	errno = posix_memalign((void **)&datagen.rings, 64, nthreads * sizeof(struct ring));
+	if (workers == NULL || errno != 0) {
+		fprintf(stderr, "chess-datagen: %s\n", strerror(errno ? errno : ENOMEM));
+		return 1;
+	}
+	memset(datagen.rings, 0, nthreads * sizeof(struct ring));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < nthreads; i++) {
+		workers[i].datagen = &datagen;
+		workers[i].ring = &datagen.rings[i];
+		errno = pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+		if (errno) {
+			fprintf(stderr, "chess-datagen: %s\n", strerror(errno));
+			return 1;
+		}
+	}
+
+	if (!writer(&datagen, nthreads, fp, &npositions) || fflush(fp) != 0) {
+		fprintf(stderr, "chess-datagen: %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	for (unsigned i = 0; i < nthreads; i++)
+		pthread_join(workers[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	size = ftell(fp);
+	if (fclose(fp) != 0) {
+		fprintf(stderr, "chess-datagen: %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	fprintf(stderr, "chess-datagen: %u games, %llu positions in %.1f s, %.1f bytes per position\n",
+			datagen.ngames, npositions, wall, npositions ? (double)size / npositions : 0.0);
+
+	free(datagen.rings);
+	free(workers);
+	return 0;
+}
+
+static const char *
+result_string(int result)
+{
+	switch (result) {
+	case CHESS_RESULT_WHITE_WINS:
+		return "1-0";
+	case CHESS_RESULT_BLACK_WINS:
+		return "0-1";
+	case CHESS_RESULT_DRAW:
+		return "1/2-1/2";
+	default:
+		return "*";
+	}
+}
+
+/* Prints the tuples of the games of a block, false if it is corrupt */
+static bool
+dump_block(const unsigned char *p, const unsigned char *end, unsigned ngames, struct chess_board *board)
+{
+	int result, score;
+	unsigned n;
+	unsigned long long len, nplies, delta;
+	char fen[FEN_MAX];
+	unsigned moves[CHESS_MOVES_MAX];
+	struct chess_undo undo;
+
+	for (unsigned game = 0; game < ngames; game++) {
+		p = get_varint(p, end, &len);
+		if (p == NULL || len >= FEN_MAX || len + 2 > (size_t)(end - p))
+			return false;
+		memcpy(fen, p, len);
+		fen[len] = '\0';
+		p += len;
+		result = *p++;
+		p = get_varint(p, end, &nplies);
+		if (p == NULL || !chess_board_set_fen(board, fen))
+			return false;
+
+		score = 0;
+		for (unsigned long long ply = 0; ply < nplies; ply++) {
+			n = chess_board_generate_moves(board, moves);
+			if (p >= end || *p >= n)
+				return false;
+			chess_board_get_fen(board, fen, sizeof(fen));
+			n = *p++;
+			p = get_varint(p, end, &delta);
+			if (p == NULL)
+				return false;
+			score += (delta & 1) ? -(int)((delta + 1) >> 1) : (int)(delta >> 1);
+			printf("%s;%d;%s\n", fen, score, result_string(result));
+			chess_board_make_move(board, moves[n], &undo);
+		}
+	}
+	return p == end;
+}
+
+static int
+dump(int argc, char **argv)
+{
+	uint32_t size, ngames;
+	unsigned char header[12];
+	unsigned char *block;
+	FILE *fp;
+	struct chess_board *board;
+
+	if (argc != 3)
+		usage(stderr, 1);
+
+	fp = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "chess-datagen: %s: %s\n", argv[2], strerror(errno));
+		return 1;
+	}
+	board = chess_board_init();
+	if (board == NULL) {
+		fprintf(stderr, "chess-datagen: %s\n", strerror(errno));
+		return 1;
+	}
+	if (fread(header, 1, sizeof(header), fp) != sizeof(header)
+			|| memcmp(header, DATAGEN_MAGIC, 8) != 0
+			|| get_u32(header + 8) != DATAGEN_VERSION) {
+		fprintf(stderr, "chess-datagen: %s: not a training data file\n", argv[2]);
+		return 1;
+	}
+
+	while (fread(header, 1, 8, fp) == 8) {
+		size = get_u32(header);
+		ngames = get_u32(header + 4);
+		block = malloc(size);
+		if (block == NULL || fread(block, 1, size, fp) != size
+				|| !dump_block(block, block + size, ngames, board)) {
+			fprintf(stderr, "chess-datagen: %s: corrupt block\n", argv[2]);
+			return 1;
+		}
+		free(block);
+	}
+
+	free(board);
+	if (fp != stdin)
+		fclose(fp);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		usage(stderr, 1);
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+		usage(stdout, 0);
+	if (strcmp(argv[1], "--version") == 0) {
+		printf("chess-datagen " VERSION "\n");
+		return 0;
+	}
+	if (strcmp(argv[1], "play") == 0)
+		return play(argc - 1, argv + 1);
+	if (strcmp(argv[1], "dump") == 0)
+		return dump(argc, argv);
+	usage(stderr, 1);
+	return 1;
+}
@@ -0,0 +1,257 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * chess-dedup: drop repeated positions from a stream
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_filter.h"
+
+#define DEDUP_LINES	1024	/* Lines hashed and filtered at once */
+#define DEDUP_KEYS	65536	/* Binary keys filtered at once */
+
+struct dedup {
+	struct chess_filter *filter;
+	struct chess_board *board;
+	bool binary;
+	bool canonical;
+	unsigned long long nread, nkept, ninvalid;
+
+	/* Batch of lines with their keys */
+	char *lines[DEDUP_LINES];
+	size_t caps[DEDUP_LINES];
+	uint64_t keys[DEDUP_KEYS];
+	bool held[DEDUP_KEYS];
+};
+
+static void
+usage(FILE *out, int code)
+{
+	fprintf(out, "Usage: chess-dedup [-n KEYS] [-p RATE] [-f FILTER] [-b] [-c] [INPUT...]\n");
+	fprintf(out, "Copy positions from the inputs, or the standard input, to the standard output\n");
+	fprintf(out, "leaving out those seen before, as told by a Bloom filter sized for KEYS\n");
+	fprintf(out, "positions (100000000) with false positive RATE (0.001). A few positions never\n");
+	fprintf(out, "seen may be left out at that rate, repeated ones are always left out.\n");
+	fprintf(out, "Positions are FEN lines, or with -b 64-bit hash keys in host byte order.\n");
+	fprintf(out, "With -c positions equal up to colours and mirroring count as repeated.\n");
+	fprintf(out, "With -f the filter is kept in the FILTER file, created if needed, so that\n");
+	fprintf(out, "positions seen by earlier runs are left out too.\n");
+	exit(code);
+}
+
+/* Filters the keys of a batch, returns false on write errors */
+static bool
+dedup_lines(struct dedup *dedup, size_t n)
+{
+	size_t len;
+
+	chess_filter_insert_batch(dedup->filter, dedup->keys, n, dedup->held);
+	for (size_t i = 0; i < n; i++) {
+		if (dedup->held[i])
+			continue;
+		len = strlen(dedup->lines[i]);
+		if (fwrite(dedup->lines[i], 1, len, stdout) != len)
+			return false;
+		if (len == 0 || dedup->lines[i][len - 1] != '\n')
+			putchar('\n');
+		++dedup->nkept;
+	}
+	return true;
+}
+
+static int
+dedup_fen(struct dedup *dedup, FILE *fp, const char *name)
+{
+	size_t n;
+	char *nl;
+
+	n = 0;
+	while (getline(&dedup->lines[n], &dedup->caps[n], fp) >= 0) {
+		++dedup->nread;
+		nl = strchr(dedup->lines[n], '\n');
+		if (nl != NULL)
+			*nl = '\0';
+		if (!chess_board_set_fen(dedup->board, dedup->lines[n])) {
+			++dedup->ninvalid;
+			continue;
+		}
+		if (nl != NULL)
+			*nl = '\n';
+		dedup->keys[n] = dedup->canonical
+			? chess_board_get_canonical_hash(dedup->board)
+			: chess_board_get_hash(dedup->board);
+
+		if (++n == DEDUP_LINES) {
+			if (!dedup_lines(dedup, n))
+				goto fail_write;
+			n = 0;
+		}
+	}
+	if (ferror(fp)) {
+		fprintf(stderr, "chess-dedup: %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+	if (!dedup_lines(dedup, n))
+		goto fail_write;
+	return 0;
+
+fail_write:
+	fprintf(stderr, "chess-dedup: write error: %s\n", strerror(errno));
+	return -1;
+}
+
+static int
+dedup_keys(struct dedup *dedup, FILE *fp, const char *name)
+{
+	size_t n, kept;
+
+	while ((n = fread(dedup->keys, sizeof(uint64_t), DEDUP_KEYS, fp)) > 0) {
+		dedup->nread += n;
+		chess_filter_insert_batch(dedup->filter, dedup->keys, n, dedup->held);
+
+		/* Compact the new keys in place and write them at once */
+		kept = 0;
+		for (size_t i = 0; i < n; i++) {
+			dedup->keys[kept] = dedup->keys[i];
+			kept += !dedup->held[i];
+		}
+		dedup->nkept += kept;
+		if (fwrite(dedup->keys, sizeof(uint64_t), kept, stdout) != kept) {
+			fprintf(stderr, "chess-dedup: write error: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	if (ferror(fp)) {
+		fprintf(stderr, "chess-dedup: %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt, ret;
+	unsigned long long nkeys;
+	double fpr;
+	const char *path, *name;
+	FILE *fp;
+	struct dedup *dedup;
+
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+		usage(stdout, 0);
+	if (argc > 1 && strcmp(argv[1], "--version") == 0) {
+		printf("chess-dedup " VERSION "\n");
+		return 0;
+	}
+
+	dedup = calloc(1, sizeof(struct dedup));
+	if (dedup == NULL) {
+		fprintf(stderr, "chess-dedup: %s\n", strerror(errno));
+		return 1;
+	}
+	nkeys = 100000000;
+	fpr = 0.001;
+	path = NULL;
+	while ((opt = getopt(argc, argv, "n:p:f:bc")) != -1) {
+		switch (opt) {
+		case 'n':
+			nkeys = strtoull(optarg, NULL, 10);
+			break;
+		case 'p':
+			fpr = strtod(optarg, NULL);
+			break;
+		case 'f':
+			path = optarg;
+			break;
+		case 'b':
+			dedup->binary = true;
+			break;
+		case 'c':
+			dedup->canonical = true;
+			break;
+		default:
+			usage(stderr, 1);
+		}
+	}
+	if (dedup->binary && dedup->canonical) {
+		fprintf(stderr, "chess-dedup: -c needs FEN input\n");
+		return 1;
+	}
+
+	dedup->filter = path != NULL ? chess_filter_open(path, nkeys, fpr) : chess_filter_init(nkeys, fpr);
+	if (dedup->filter == NULL) {
+		fprintf(stderr, "chess-dedup: %s: %s\n", path != NULL ? path : "filter", strerror(errno));
+		return 1;
+	}
+	dedup->board = chess_board_init();
+	if (dedup->board == NULL) {
+		fprintf(stderr, "chess-dedup: %s\n", strerror(errno));
+		return 1;
+	}
+
+	ret = 0;
+	for (int i = optind; ret == 0 && i < (optind < argc ? argc : optind + 1); i++) {
+		name = i < argc ? argv[i] : "-";
+		fp = strcmp(name, "-") == 0 ? stdin : fopen(name, dedup->binary ? "rb" : "r");
+		if (fp == NULL) {
+			fprintf(stderr, "chess-dedup: %s: %s\n", name, strerror(errno));
+			ret = -1;
+			break;
+		}
+		ret = dedup->binary ? dedup_keys(dedup, fp, name) : dedup_fen(dedup, fp, name);
+		if (fp != stdin)
+			fclose(fp);
+	}
+	if (fflush(stdout) != 0) {
+		fprintf(stderr, "chess-dedup: write error: %s\n", strerror(errno));
+		ret = -1;
+	}
+
+	fprintf(stderr, "chess-dedup: kept %llu of %llu positions", dedup->nkept, dedup->nread);
+	if (dedup->ninvalid)
+		fprintf(stderr, ", %llu invalid", dedup->ninvalid);
+	fprintf(stderr, ", filter of %zu MiB holds %llu\n", chess_filter_get_size(dedup->filter) >> 20,
+			(unsigned long long)chess_filter_get_count(dedup->filter));
+
+	if (path != NULL && chess_filter_sync(dedup->filter) < 0) {
+		fprintf(stderr, "chess-dedup: %s: %s\n", path, strerror(errno));
+		ret = -1;
+	}
+	chess_filter_free(dedup->filter);
+	for (size_t i = 0; i < DEDUP_LINES; i++)
+		free(dedup->lines[i]);
+	free(dedup->board);
+	free(dedup);
+	return ret == 0 ? 0 : 1;
+}
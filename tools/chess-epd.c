@@ -0,0 +1,420 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * chess-epd: run EPD test suites
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_search.h"
+
+#define EPD_MOVES_MAX 8
+
+struct epd {
+	char *fen;			/**< Position, the first four FEN fields */
+	char *id;			/**< id operand or NULL */
+	unsigned bm[EPD_MOVES_MAX];	/**< Best moves */
+	unsigned am[EPD_MOVES_MAX];	/**< Moves to avoid */
+	unsigned nbm, nam;
+
+	/* Filled by the workers */
+	unsigned move;
+	struct chess_search_info info;
+	bool solved;
+};
+
+struct runner {
+	struct epd *epds;
+	size_t nepds;
+	size_t next;			/**< Next position to search, claimed atomically */
+	struct chess_search_limits limits;
+	size_t memory;
+	const char *shared;		/**< Shared transposition table or NULL */
+	bool quiet;
+	pthread_mutex_t lock;		/**< Serializes output */
+	size_t done;
+};
+
+static void
+usage(FILE *out, int code)
+{
+	fprintf(out, "Usage: chess-epd [-j THREADS] [-n NODES] [-t MSEC] [-d DEPTH] [-H MEGABYTES] [-S NAME] [-q] EPD...\n");
+	fprintf(out, "Search every position of the EPD files and check the bm and am operations.\n");
+	fprintf(out, "Without limits every position is searched for 1000 milliseconds.\n");
+	fprintf(out, "With -S the threads share the transposition table in the named shared memory\n");
+	fprintf(out, "segment, see chess-tt.\n");
+	exit(code);
+}
+
+/* Splits off the next token of an operation, NUL terminating it */
+static char *
+epd_token(char **pp)
+{
+	char *p, *start;
+
+	p = *pp;
+	while (isspace((unsigned char)*p))
+		++p;
+	if (*p == '\0')
+		return NULL;
+
+	if (*p == '"') {
+		start = ++p;
+		while (*p != '\0' && *p != '"')
+			++p;
+	}
+	else {
+		start = p;
+		while (*p != '\0' && !isspace((unsigned char)*p))
+			++p;
+	}
+	if (*p != '\0')
+		*p++ = '\0';
+	*pp = p;
+	return start;
+}
+
+/* Splits off the next operation, which ends at a ';' outside of quotes */
+static char *
+epd_operation(char **pp)
+{
+	bool quoted;
+	char *p, *start;
+
+	start = p = *pp;
+	if (*p == '\0')
+		return NULL;
+
+	quoted = false;
+	while (*p != '\0' && (quoted || *p != ';')) {
+		if (*p == '"')
+			quoted = !quoted;
+		++p;
+	}
+	if (*p != '\0')
+		*p++ = '\0';
+	*pp = p;
+	return start;
+}
+
+static unsigned
+epd_move(const struct chess_board *board, const char *str)
+{
+	unsigned move;
+
+	move = chess_board_parse_san(board, str);
+	if (move == CHESS_MOVE_NONE)
+		move = chess_board_parse_move(board, str);
+	return move;
+}
+
+/* Parses an EPD record, returns false if the position is invalid */
+static bool
+epd_parse(struct epd *epd, char *line, struct chess_board *board, const char *name, unsigned lineno)
+{
+	unsigned i, move, *moves, *nmoves;
+	char *p, *op, *opcode, *operand;
+
+	memset(epd, 0, sizeof(struct epd));
+
+	p = line;
+	for (i = 0; i < 4; i++) {
+		while (isspace((unsigned char)*p))
+			++p;
+		while (*p != '\0' && !isspace((unsigned char)*p))
+			++p;
+	}
+	epd->fen = strndup(line, p - line);
+	if (epd->fen == NULL) {
+		fprintf(stderr, "chess-epd: %s\n", strerror(errno));
+		exit(1);
+	}
+	if (!chess_board_set_fen(board, epd->fen)) {
+		fprintf(stderr, "chess-epd: %s:%u: invalid position\n", name, lineno);
+		free(epd->fen);
+		return false;
+	}
+
+	while ((op = epd_operation(&p)) != NULL) {
+		opcode = epd_token(&op);
+		if (opcode == NULL)
+			continue;
+
+		moves = NULL;
+		nmoves = NULL;
+		if (strcmp(opcode, "bm") == 0) {
+			moves = epd->bm;
+			nmoves = &epd->nbm;
+		}
+		else if (strcmp(opcode, "am") == 0) {
+			moves = epd->am;
+			nmoves = &epd->nam;
+		}
+
+		while ((operand = epd_token(&op)) != NULL) {
+			if (strcmp(opcode, "id") == 0 && epd->id == NULL)
+				epd->id = strdup(operand);
+			else if (moves != NULL) {
+				move = epd_move(board, operand);
+				if (move == CHESS_MOVE_NONE)
+					fprintf(stderr, "chess-epd: %s:%u: invalid move `%s'\n", name, lineno, operand);
+				else if (*nmoves < EPD_MOVES_MAX)
+					moves[(*nmoves)++] = move;
+			}
+		}
+	}
+	return true;
+}
+
+static void
+epd_load(const char *name, struct epd **epds, size_t *nepds, struct chess_board *board)
+{
+	size_t cap, linecap;
+	unsigned lineno;
+	char *line, *p;
+	FILE *fp;
+
+	fp = strcmp(name, "-") == 0 ? stdin : fopen(name, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "chess-epd: %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+
+	cap = *nepds;
+	line = NULL;
+	linecap = 0;
+	lineno = 0;
+	while (getline(&line, &linecap, fp) >= 0) {
+		++lineno;
+		for (p = line; isspace((unsigned char)*p); p++)
+			;
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		if (*nepds == cap) {
+			cap = cap ? cap * 2 : 256;
+			*epds = realloc(*epds, cap * sizeof(struct epd));
+			if (*epds == NULL) {
+				fprintf(stderr, "chess-epd: %s\n", strerror(errno));
+				exit(1);
+			}
+		}
+		if (epd_parse(&(*epds)[*nepds], p, board, name, lineno))
+			++*nepds;
+	}
+	if (ferror(fp)) {
+		fprintf(stderr, "chess-epd: %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+}
+
+static bool
+epd_contains(const unsigned *moves, unsigned n, unsigned move)
+{
+	for (unsigned i = 0; i < n; i++) {
+		if (moves[i] == move)
+			return true;
+	}
+	return false;
+}
+
+static void *
+runner_worker(void *arg)
+{
+	size_t i;
+	char str[8];
+	struct epd *epd;
+	struct chess_board *board;
+	struct chess_search *search;
+	struct runner *runner = arg;
+
+	board = chess_board_init();
+	if (runner->shared != NULL)
+		search = chess_search_init_shared(runner->shared, runner->memory, 0);
+	else
+		search = chess_search_init(runner->memory);
+	if (board == NULL || search == NULL) {
+		fprintf(stderr, "chess-epd: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	while ((i = __atomic_fetch_add(&runner->next, 1, __ATOMIC_RELAXED)) < runner->nepds) {
+		epd = &runner->epds[i];
+		chess_board_set_fen(board, epd->fen);
+		/* Other processes may be using a shared table */
+		if (runner->shared == NULL)
+			chess_search_clear(search);
+		epd->move = chess_search_run(search, board, &runner->limits, &epd->info);
+		epd->solved = (epd->nbm || epd->nam)
+			&& (!epd->nbm || epd_contains(epd->bm, epd->nbm, epd->move))
+			&& !epd_contains(epd->am, epd->nam, epd->move);
+
+		pthread_mutex_lock(&runner->lock);
+		++runner->done;
+		if (!runner->quiet)
+			printf("%6zu/%zu %-16s %-6s %-8s score %6d depth %2u nodes %10llu time %6lu ms\n",
+					runner->done, runner->nepds,
+					epd->id ? epd->id : "-",
+					chess_move_get_string(epd->move, str, sizeof(str)) ? str : "-",
+					(epd->nbm || epd->nam) ? (epd->solved ? "solved" : "failed") : "-",
+					epd->info.score, epd->info.depth, epd->info.nodes, epd->info.time);
+		fflush(stdout);
+		pthread_mutex_unlock(&runner->lock);
+	}
+
+	chess_search_free(search);
+	free(board);
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt;
+	unsigned nthreads, nsolved, ntests;
+	unsigned long long nodes;
+	unsigned long searchtime;
+	double wall;
+	struct timespec start, end;
+	pthread_t *threads;
+	struct chess_board *board;
+	struct runner runner;
+
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+		usage(stdout, 0);
+	if (argc > 1 && strcmp(argv[1], "--version") == 0) {
+		printf("chess-epd " VERSION "\n");
+		return 0;
+	}
+
+	memset(&runner, 0, sizeof(runner));
+	runner.memory = 16;
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	while ((opt = getopt(argc, argv, "j:n:t:d:H:S:q")) != -1) {
+		switch (opt) {
+		case 'j':
+			nthreads = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			runner.limits.nodes = strtoull(optarg, NULL, 10);
+			break;
+		case 't':
+			runner.limits.time = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			runner.limits.depth = strtoul(optarg, NULL, 10);
+			break;
+		case 'H':
+			runner.memory = strtoul(optarg, NULL, 10);
+			break;
+		case 'S':
+			runner.shared = optarg;
+			break;
+		case 'q':
+			runner.quiet = true;
+			break;
+		default:
+			usage(stderr, 1);
+		}
+	}
+	if (optind >= argc)
+		usage(stderr, 1);
+	if (nthreads == 0)
+		nthreads = 1;
+	if (!runner.limits.nodes && !runner.limits.time && !runner.limits.depth)
+		runner.limits.time = 1000;
+	runner.memory <<= 20;
+
+	board = chess_board_init();
+	if (board == NULL) {
+		fprintf(stderr, "chess-epd: %s\n", strerror(errno));
+		return 1;
+	}
+	for (int i = optind; i < argc; i++)
+		epd_load(argv[i], &runner.epds, &runner.nepds, board);
+	free(board);
+
+	if (nthreads > runner.nepds)
+		nthreads = runner.nepds ? runner.nepds : 1;
+	threads = calloc(nthreads, sizeof(pthread_t));
+	if (threads == NULL) {
+		fprintf(stderr, "chess-epd: %s\n", strerror(errno));
+		return 1;
+	}
+	pthread_mutex_init(&runner.lock, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < nthreads; i++) {
+		errno = pthread_create(&threads[i], NULL, runner_worker, &runner);
+		if (errno) {
+			fprintf(stderr, "chess-epd: %s\n", strerror(errno));
+			return 1;
+		}
+	}
+	for (unsigned i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	nsolved = ntests = 0;
+	nodes = 0;
+	searchtime = 0;
+	for (size_t i = 0; i < runner.nepds; i++) {
+		struct epd *epd = &runner.epds[i];
+
+		ntests += (epd->nbm || epd->nam);
+		nsolved += epd->solved;
+		nodes += epd->info.nodes;
+		searchtime += epd->info.time;
+		free(epd->fen);
+		free(epd->id);
+	}
+
+	printf("positions %zu, solved %u/%u (%.1f%%)\n", runner.nepds, nsolved, ntests,
+			ntests ? 100.0 * nsolved / ntests : 0.0);
+	printf("nodes %llu, %.0f nodes/s with %u threads, %.0f nodes/s per thread\n", nodes,
+			wall > 0 ? nodes / wall : 0.0, nthreads,
+			searchtime ? 1000.0 * nodes / searchtime : 0.0);
+	printf("time %.3f s, %.1f ms per position\n", wall,
+			runner.nepds ? (double)searchtime / runner.nepds : 0.0);
+
+	pthread_mutex_destroy(&runner.lock);
+	free(runner.epds);
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,221 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * chess-index: build and query position indexes of game collections
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_index.h"
+#include "chess_pgn.h"
+
+#define GAMES_SHOWN 10
+
+static void
+usage(FILE *out, int code)
+{
+	fprintf(out, "Usage: chess-index build [-j THREADS] [-m MEGABYTES] INDEX PGN...\n");
+	fprintf(out, "       chess-index query INDEX FEN\n");
+	exit(code);
+}
+
+static int
+build(int argc, char **argv)
+{
+	int opt, ret;
+	unsigned nthreads, nmoves;
+	uint32_t game;
+	unsigned long long npos;
+	size_t memory;
+	const unsigned *moves;
+	FILE *fp;
+	struct chess_board *board;
+	struct chess_pgn *pgn;
+	struct chess_index_builder *builder;
+	struct chess_undo undo;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	memory = 1024;
+	while ((opt = getopt(argc, argv, "j:m:")) != -1) {
+		switch (opt) {
+		case 'j':
+			nthreads = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			memory = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(stderr, 1);
+		}
+	}
+	if (argc - optind < 2)
+		usage(stderr, 1);
+
+	board = chess_board_init();
+	builder = chess_index_builder_init(argv[optind], memory << 20, nthreads);
+	if (board == NULL || builder == NULL) {
+		fprintf(stderr, "chess-index: %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+
+	game = 0;
+	npos = 0;
+	for (int i = optind + 1; i < argc; i++) {
+		fp = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "r");
+		if (fp == NULL || (pgn = chess_pgn_init(fp)) == NULL) {
+			fprintf(stderr, "chess-index: %s: %s\n", argv[i], strerror(errno));
+			chess_index_builder_free(builder);
+			return 1;
+		}
+
+		while ((ret = chess_pgn_read_game(pgn, board)) != 0) {
+			if (ret < 0 && errno != EINVAL) {
+				fprintf(stderr, "chess-index: %s: %s\n", argv[i], strerror(errno));
+				chess_index_builder_free(builder);
+				return 1;
+			}
+			if (ret < 0)
+				fprintf(stderr, "chess-index: %s: game %u: invalid, indexing up to the error\n",
+						argv[i], game);
+
+			/* Positions are indexed before every move and at the end */
+			moves = chess_pgn_get_moves(pgn, &nmoves);
+			for (unsigned m = 0; m <= nmoves; m++) {
+				if (chess_index_builder_add(builder, chess_board_get_hash(board),
+							game, chess_pgn_get_result(pgn)) < 0) {
+					fprintf(stderr, "chess-index: %s\n", strerror(errno));
+					chess_index_builder_free(builder);
+					return 1;
+				}
+				if (m < nmoves)
+					chess_board_make_move(board, moves[m], &undo);
+			}
+			npos += nmoves + 1;
+			++game;
+		}
+
+		chess_pgn_free(pgn);
+		if (fp != stdin)
+			fclose(fp);
+	}
+
+	if (chess_index_builder_finish(builder) < 0) {
+		fprintf(stderr, "chess-index: %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	fprintf(stderr, "chess-index: indexed %llu positions from %u games\n", npos, game);
+
+	free(board);
+	return 0;
+}
+
+static void
+print_entry(const char *name, const struct chess_index_entry *entry)
+{
+	printf("%-8s %10u games %10u white %10u draws %10u black\n", name,
+			entry->ngames, entry->count[0], entry->count[1], entry->count[2]);
+}
+
+static int
+query(int argc, char **argv)
+{
+	unsigned n;
+	char str[8];
+	unsigned moves[CHESS_MOVES_MAX];
+	const uint32_t *games;
+	const struct chess_index_entry *entry;
+	struct chess_board *board;
+	struct chess_index *index;
+	struct chess_undo undo;
+
+	if (argc != 4)
+		usage(stderr, 1);
+
+	board = chess_board_init();
+	if (board == NULL || !chess_board_set_fen(board, argv[3])) {
+		fprintf(stderr, "chess-index: invalid FEN `%s'\n", argv[3]);
+		return 1;
+	}
+	index = chess_index_open(argv[2]);
+	if (index == NULL) {
+		fprintf(stderr, "chess-index: %s: %s\n", argv[2], strerror(errno));
+		return 1;
+	}
+
+	entry = chess_index_lookup(index, chess_board_get_hash(board));
+	if (entry == NULL) {
+		printf("position not found\n");
+		chess_index_close(index);
+		free(board);
+		return 1;
+	}
+	print_entry("total", entry);
+
+	games = chess_index_get_games(index, entry);
+	printf("games:");
+	for (unsigned i = 0; i < entry->ngames && i < GAMES_SHOWN; i++)
+		printf(" %u", games[i]);
+	printf("%s\n", entry->ngames > GAMES_SHOWN ? " ..." : "");
+
+	/* Explorer view: continuations played from this position */
+	n = chess_board_generate_moves(board, moves);
+	for (unsigned i = 0; i < n; i++) {
+		chess_board_make_move(board, moves[i], &undo);
+		entry = chess_index_lookup(index, chess_board_get_hash(board));
+		if (entry != NULL)
+			print_entry(chess_move_get_string(moves[i], str, sizeof(str)), entry);
+		chess_board_unmake_move(board, moves[i], &undo);
+	}
+
+	chess_index_close(index);
+	free(board);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		usage(stderr, 1);
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+		usage(stdout, 0);
+	if (strcmp(argv[1], "--version") == 0) {
+		printf("chess-index " VERSION "\n");
+		return 0;
+	}
+	if (strcmp(argv[1], "build") == 0)
+		return build(argc - 1, argv + 1);
+	if (strcmp(argv[1], "query") == 0)
+		return query(argc, argv);
+	usage(stderr, 1);
+	return 1;
+}
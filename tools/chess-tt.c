@@ -0,0 +1,144 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * chess-tt: manage shared memory transposition tables
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_search.h"
+
+static void
+usage(FILE *out, int code)
+{
+	fprintf(out, "Usage: chess-tt create [-H] [-m MEGABYTES] NAME\n");
+	fprintf(out, "       chess-tt stats NAME\n");
+	fprintf(out, "       chess-tt remove NAME\n");
+	fprintf(out, "NAME is a POSIX shared memory name like /libchess-tt.\n");
+	exit(code);
+}
+
+static double
+percent(unsigned long long part, unsigned long long whole)
+{
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+static int
+create(int argc, char **argv)
+{
+	int opt, flags;
+	size_t memory;
+	struct chess_search *search;
+
+	flags = 0;
+	memory = 256;
+	while ((opt = getopt(argc, argv, "Hm:")) != -1) {
+		switch (opt) {
+		case 'H':
+			flags |= CHESS_SEARCH_SHARED_HUGEPAGES;
+			break;
+		case 'm':
+			memory = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(stderr, 1);
+		}
+	}
+	if (argc - optind != 1)
+		usage(stderr, 1);
+
+	search = chess_search_init_shared(argv[optind], memory << 20, flags);
+	if (search == NULL) {
+		fprintf(stderr, "chess-tt: %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	chess_search_free(search);
+	return 0;
+}
+
+static int
+stats(int argc, char **argv)
+{
+	struct chess_search *search;
+	struct chess_search_table_stats st;
+
+	if (argc != 3)
+		usage(stderr, 1);
+
+	search = chess_search_init_shared(argv[2], 0, CHESS_SEARCH_SHARED_EXISTING);
+	if (search == NULL) {
+		fprintf(stderr, "chess-tt: %s: %s\n", argv[2], strerror(errno));
+		return 1;
+	}
+	chess_search_get_table_stats(search, &st);
+	chess_search_free(search);
+
+	printf("entries    %12llu (%llu MB)\n", st.size, (st.size * 16) >> 20);
+	printf("used       %12llu (%.1f%%)\n", st.used, percent(st.used, st.size));
+	printf("current    %12llu (%.1f%% of used, stored by the last search)\n",
+			st.current, percent(st.current, st.used));
+	printf("torn       %12llu\n", st.torn);
+	printf("searches   %12llu\n", st.searches);
+	printf("probes     %12llu\n", st.probes);
+	printf("hits       %12llu (%.1f%% of probes)\n", st.hits, percent(st.hits, st.probes));
+	printf("stores     %12llu\n", st.stores);
+	printf("overwrites %12llu (%.1f%% of stores)\n", st.overwrites, percent(st.overwrites, st.stores));
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		usage(stderr, 1);
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+		usage(stdout, 0);
+	if (strcmp(argv[1], "--version") == 0) {
+		printf("chess-tt " VERSION "\n");
+		return 0;
+	}
+	if (strcmp(argv[1], "create") == 0)
+		return create(argc - 1, argv + 1);
+	if (strcmp(argv[1], "stats") == 0)
+		return stats(argc, argv);
+	if (strcmp(argv[1], "remove") == 0) {
+		if (argc != 3)
+			usage(stderr, 1);
+		if (chess_search_unlink_shared(argv[2]) < 0) {
+			fprintf(stderr, "chess-tt: %s: %s\n", argv[2], strerror(errno));
+			return 1;
+		}
+		return 0;
+	}
+	usage(stderr, 1);
+	return 1;
+}
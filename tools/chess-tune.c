@@ -0,0 +1,394 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * chess-tune: tune the evaluation parameters on labelled positions
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_eval.h"
+
+#define FIELD_MAX 256
+
+/* Positions are loaded once into this form, the evaluation is linear in the
+ * parameters so the pieces and the phase are all it needs.
+ */
+struct position {
+	uint8_t npieces;
+	uint8_t phase;
+	uint8_t result;		/**< Half points of white */
+	uint16_t pieces[32];	/**< Middle game piece-square parameter, bit 15 set for black */
+};
+
+struct tuner {
+	struct position *positions;
+	size_t npositions, cap;
+	double params[CHESS_EVAL_PARAMS];
+	double k;		/**< Scale of the sigmoid mapping scores to results */
+};
+
+/* Every thread sums the error and the gradient of a slice of the positions */
+struct slice {
+	pthread_t thread;
+	const struct tuner *tuner;
+	size_t start, end;
+	double error;
+	double gradient[CHESS_EVAL_PARAMS];
+};
+
+static void
+usage(FILE *out, int code)
+{
+	fprintf(out, "Usage: chess-tune [-j THREADS] [-e EPOCHS] [-r RATE] [-K SCALE] [-i PARAMS] -o OUTPUT DATA...\n");
+	fprintf(out, "Tune the material and piece-square parameters of the evaluation so that it\n");
+	fprintf(out, "predicts the results of the positions, Texel style, and write them to OUTPUT\n");
+	fprintf(out, "for chess_eval_load(). DATA has a position per line, a FEN followed by fields\n");
+	fprintf(out, "separated by semicolons, the last one the result: 1-0, 1/2-1/2 or 0-1, as\n");
+	fprintf(out, "written by chess-datagen dump. Without -K the scale is fitted first.\n");
+	exit(code);
+}
+
+static int
+parse_result(const char *str)
+{
+	if (strncmp(str, "1-0", 3) == 0 || strncmp(str, "1.0", 3) == 0)
+		return 2;
+	if (strncmp(str, "0-1", 3) == 0 || strncmp(str, "0.0", 3) == 0)
+		return 0;
+	if (strncmp(str, "1/2-1/2", 7) == 0 || strncmp(str, "0.5", 3) == 0)
+		return 1;
+	return -1;
+}
+
+static void
+load(struct tuner *tuner, const char *name, struct chess_board *board)
+{
+	int piece, side, result;
+	size_t linecap;
+	unsigned lineno;
+	char *line, *p;
+	struct position *pos;
+	FILE *fp;
+
+	fp = strcmp(name, "-") == 0 ? stdin : fopen(name, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "chess-tune: %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+
+	line = NULL;
+	linecap = 0;
+	lineno = 0;
+	while (getline(&line, &linecap, fp) >= 0) {
+		++lineno;
+		p = strrchr(line, ';');
+		if (p == NULL || (result = parse_result(p + 1 + strspn(p + 1, " "))) < 0) {
+			fprintf(stderr, "chess-tune: %s:%u: no result\n", name, lineno);
+			continue;
+		}
+		*strchr(line, ';') = '\0';
+		if (!chess_board_set_fen(board, line)) {
+			fprintf(stderr, "chess-tune: %s:%u: invalid position\n", name, lineno);
+			continue;
+		}
+
+		if (tuner->npositions == tuner->cap) {
+			tuner->cap = tuner->cap ? tuner->cap * 2 : 1 << 16;
+			tuner->positions = realloc(tuner->positions, tuner->cap * sizeof(struct position));
+			if (tuner->positions == NULL) {
+				fprintf(stderr, "chess-tune: %s\n", strerror(errno));
+				exit(1);
+			}
+		}
+		pos = &tuner->positions[tuner->npositions++];
+		pos->npieces = 0;
+		pos->phase = chess_evaluate_phase(board);
+		pos->result = result;
+		for (int sq = 0; sq < 64 && pos->npieces < 32; sq++) {
+			if (!chess_board_get_piece(board, sq, &piece, &side))
+				continue;
+			if (side == CHESS_SIDE_WHITE)
+				pos->pieces[pos->npieces++] = CHESS_EVAL_PST(0, piece, sq);
+			else
+				pos->pieces[pos->npieces++] = CHESS_EVAL_PST(0, piece, sq ^ 56) | 0x8000;
+		}
+	}
+	if (ferror(fp)) {
+		fprintf(stderr, "chess-tune: %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+}
+
+/* Parameters of a piece, middle game then end game material and piece-square */
+static inline void
+piece_params(unsigned code, unsigned idx[4])
+{
+	unsigned pst = code & 0x7fff;
+	unsigned piece = (pst - CHESS_EVAL_PST(0, CHESS_PIECE_PAWN, 0)) / 64;
+
+	idx[0] = CHESS_EVAL_MATERIAL(0, CHESS_PIECE_PAWN) + piece;
+	idx[1] = CHESS_EVAL_MATERIAL(1, CHESS_PIECE_PAWN) + piece;
+	idx[2] = pst;
+	idx[3] = pst + CHESS_EVAL_PST(1, CHESS_PIECE_PAWN, 0) - CHESS_EVAL_PST(0, CHESS_PIECE_PAWN, 0);
+}
+
+static void *
+slice_run(void *arg)
+{
+	unsigned idx[4];
+	double mg, eg, wmg, weg, score, sigma, delta, sign;
+	const struct position *pos;
+	struct slice *slice = arg;
+	const struct tuner *tuner = slice->tuner;
+	const double *params = tuner->params;
+	const double scale = tuner->k * log(10.0) / 400.0;
+
+	slice->error = 0;
+	memset(slice->gradient, 0, sizeof(slice->gradient));
+	for (size_t i = slice->start; i < slice->end; i++) {
+		pos = &tuner->positions[i];
+		wmg = pos->phase / (double)CHESS_EVAL_PHASE_MAX;
+		weg = 1.0 - wmg;
+
+		mg = eg = 0;
+		for (unsigned j = 0; j < pos->npieces; j++) {
+			sign = (pos->pieces[j] & 0x8000) ? -1.0 : 1.0;
+			piece_params(pos->pieces[j], idx);
+			mg += sign * (params[idx[0]] + params[idx[2]]);
+			eg += sign * (params[idx[1]] + params[idx[3]]);
+		}
+		score = mg * wmg + eg * weg;
+		sigma = 1.0 / (1.0 + exp(-scale * score));
+		delta = sigma - pos->result / 2.0;
+		slice->error += delta * delta;
+
+		/* Derivative of the squared error by the score */
+		delta *= 2.0 * sigma * (1.0 - sigma) * scale;
+		for (unsigned j = 0; j < pos->npieces; j++) {
+			sign = (pos->pieces[j] & 0x8000) ? -delta : delta;
+			piece_params(pos->pieces[j], idx);
+			slice->gradient[idx[0]] += sign * wmg;
+			slice->gradient[idx[2]] += sign * wmg;
+			slice->gradient[idx[1]] += sign * weg;
+			slice->gradient[idx[3]] += sign * weg;
+		}
+	}
+	return NULL;
+}
+
+/* Returns the mean squared error, sums the gradient into gradient if not NULL */
+static double
+tuner_pass(const struct tuner *tuner, struct slice *slices, unsigned nthreads, double *gradient)
+{
+	size_t n;
+	double error;
+
+	n = tuner->npositions;
+	for (unsigned t = 0; t < nthreads; t++) {
+		slices[t].tuner = tuner;
+		slices[t].start = n * t / nthreads;
+		slices[t].end = n * (t + 1) / nthreads;
+		if (t > 0 && pthread_create(&slices[t].thread, NULL, slice_run, &slices[t]) != 0) {
+			fprintf(stderr, "chess-tune: %s\n", strerror(errno));
+			exit(1);
+		}
+	}
+	slice_run(&slices[0]);
+
+	/* The per-thread accumulators are reduced once the threads are done */
+	error = slices[0].error;
+	if (gradient != NULL)
+		memcpy(gradient, slices[0].gradient, sizeof(slices[0].gradient));
+	for (unsigned t = 1; t < nthreads; t++) {
+		pthread_join(slices[t].thread, NULL);
+		error += slices[t].error;
+		if (gradient != NULL)
+			for (unsigned i = 0; i < CHESS_EVAL_PARAMS; i++)
+				gradient[i] += slices[t].gradient[i];
+	}
+	if (gradient != NULL)
+		for (unsigned i = 0; i < CHESS_EVAL_PARAMS; i++)
+			gradient[i] /= n;
+	return error / n;
+}
+
+/* Fits the scale to the current parameters by ternary search */
+static void
+tuner_fit_k(struct tuner *tuner, struct slice *slices, unsigned nthreads)
+{
+	double lo, hi, e1, e2;
+
+	lo = 0.05;
+	hi = 4.0;
+	for (int i = 0; i < 40; i++) {
+		double k1 = lo + (hi - lo) / 3, k2 = hi - (hi - lo) / 3;
+
+		tuner->k = k1;
+		e1 = tuner_pass(tuner, slices, nthreads, NULL);
+		tuner->k = k2;
+		e2 = tuner_pass(tuner, slices, nthreads, NULL);
+		if (e1 < e2)
+			hi = k2;
+		else
+			lo = k1;
+	}
+	tuner->k = (lo + hi) / 2;
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt;
+	unsigned nthreads, epochs;
+	int params[CHESS_EVAL_PARAMS];
+	double rate, error, mhat, vhat;
+	const char *input, *output;
+	struct chess_board *board;
+	struct slice *slices;
+	struct tuner *tuner;
+	double *gradient, *m, *v;
+	const double beta1 = 0.9, beta2 = 0.999;
+
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+		usage(stdout, 0);
+	if (argc > 1 && strcmp(argv[1], "--version") == 0) {
+		printf("chess-tune " VERSION "\n");
+		return 0;
+	}
+
+	tuner = calloc(1, sizeof(struct tuner));
+	if (tuner == NULL) {
+		fprintf(stderr, "chess-tune: %s\n", strerror(errno));
+		return 1;
+	}
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	epochs = 500;
+	rate = 1.0;
+	input = output = NULL;
+	while ((opt = getopt(argc, argv, "j:e:r:K:i:o:")) != -1) {
+		switch (opt) {
+		case 'j':
+			nthreads = strtoul(optarg, NULL, 10);
+			break;
+		case 'e':
+			epochs = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rate = strtod(optarg, NULL);
+			break;
+		case 'K':
+			tuner->k = strtod(optarg, NULL);
+			break;
+		case 'i':
+			input = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(stderr, 1);
+		}
+	}
+	if (optind >= argc || output == NULL)
+		usage(stderr, 1);
+	if (nthreads == 0)
+		nthreads = 1;
+
+	if (input != NULL && chess_eval_load(input) < 0) {
+		fprintf(stderr, "chess-tune: %s: %s\n", input, strerror(errno));
+		return 1;
+	}
+	chess_eval_get_params(params);
+	for (unsigned i = 0; i < CHESS_EVAL_PARAMS; i++)
+		tuner->params[i] = params[i];
+
+	board = chess_board_init();
+	if (board == NULL) {
+		fprintf(stderr, "chess-tune: %s\n", strerror(errno));
+		return 1;
+	}
+	for (int i = optind; i < argc; i++)
+		load(tuner, argv[i], board);
+	free(board);
+	if (tuner->npositions == 0) {
+		fprintf(stderr, "chess-tune: no positions\n");
+		return 1;
+	}
+
+	slices = calloc(nthreads, sizeof(struct slice));
+	gradient = calloc(3 * CHESS_EVAL_PARAMS, sizeof(double));
+	if (slices == NULL || gradient == NULL) {
+		fprintf(stderr, "chess-tune: %s\n", strerror(errno));
+		return 1;
+	}
+	m = gradient + CHESS_EVAL_PARAMS;
+	v = m + CHESS_EVAL_PARAMS;
+
+	if (tuner->k <= 0)
+		tuner_fit_k(tuner, slices, nthreads);
+	fprintf(stderr, "chess-tune: %zu positions, scale %.4f, error %.6f\n", tuner->npositions,
+			tuner->k, tuner_pass(tuner, slices, nthreads, NULL));
+
+	/* Adam over the whole data set every epoch */
+	for (unsigned epoch = 1; epoch <= epochs; epoch++) {
+		error = tuner_pass(tuner, slices, nthreads, gradient);
+		for (unsigned i = 0; i < CHESS_EVAL_PARAMS; i++) {
+			m[i] = beta1 * m[i] + (1 - beta1) * gradient[i];
+			v[i] = beta2 * v[i] + (1 - beta2) * gradient[i] * gradient[i];
+			mhat = m[i] / (1 - pow(beta1, epoch));
+			vhat = v[i] / (1 - pow(beta2, epoch));
+			tuner->params[i] -= rate * mhat / (sqrt(vhat) + 1e-12);
+		}
+		if (epoch % 50 == 0 || epoch == epochs)
+			fprintf(stderr, "chess-tune: epoch %u, error %.6f\n", epoch, error);
+	}
+
+	for (unsigned i = 0; i < CHESS_EVAL_PARAMS; i++)
+		params[i] = lround(tuner->params[i]);
+	chess_eval_set_params(params);
+	if (chess_eval_save(output) < 0) {
+		fprintf(stderr, "chess-tune: %s: %s\n", output, strerror(errno));
+		return 1;
+	}
+
+	free(gradient);
+	free(slices);
+	free(tuner->positions);
+	free(tuner);
+	return 0;
+}
@@ -0,0 +1,760 @@
+/* vim: set cino= fo=croql sw=8 ts=8 sts=0 noet cin fdm=syntax : */
+
+/*
+ * Copyright (c) 2009, 2010 Ali Polatel <alip@exherbo.org>
+ *
+ * This file is part of the libchess library. libchess is free software; you
+ * can redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License version 2.1, as published by the Free Software
+ * Foundation.
+ *
+ * libchess is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * libchess-analyzd: analyse positions sent as newline delimited JSON jobs
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chess_search.h"
+
+#define MULTIPV_MAX 16
+#define FIELD_MAX 128
+
+/* A client, jobs hold a reference to write their result back */
+struct conn {
+	FILE *in;
+	int out;
+	pthread_mutex_t lock;		/**< Serializes results */
+	unsigned refs;
+};
+
+struct job {
+	struct conn *conn;
+	char id[FIELD_MAX];		/**< JSON value of the id member, echoed back */
+	char fen[FIELD_MAX];
+	struct chess_search_limits limits;
+	unsigned multipv;
+};
+
+/* Bounded lock-free multi-producer multi-consumer queue, every cell carries
+ * the position it may next be written (seq == pos) or read (seq == pos + 1)
+ * at. The semaphores count the jobs and the free cells so that workers sleep
+ * on an empty queue and readers stop reading, pushing back on their clients,
+ * on a full one.
+ */
+struct queue_cell {
+	size_t seq;
+	struct job *job;
+};
+
+struct queue {
+	struct queue_cell *cells;
+	size_t mask;
+	size_t head __attribute__((aligned(64)));	/**< Next position to write */
+	size_t tail __attribute__((aligned(64)));	/**< Next position to read */
+	sem_t jobs, slots;
+};
+
+struct daemon {
+	struct queue queue;
+	struct chess_search_limits limits;	/**< Default limits */
+	size_t memory;
+};
+
+static void
+usage(FILE *out, int code)
+{
+	fprintf(out, "Usage: libchess-analyzd [-j WORKERS] [-Q JOBS] [-H MEGABYTES] [-n NODES] [-t MSEC] [-d DEPTH] [-s SOCKET]\n");
+	fprintf(out, "Read jobs, one JSON object per line, from the Unix domain socket or standard\n");
+	fprintf(out, "input and write one JSON result per line as each job completes.\n");
+	fprintf(out, "A job is {\"id\": ..., \"fen\": \"...\", \"depth\": N, \"nodes\": N, \"time\": MSEC, \"multipv\": N},\n");
+	fprintf(out, "only fen is required. Without limits in the job the -n, -t and -d limits apply,\n");
+	fprintf(out, "without those a position is searched for 1000 milliseconds.\n");
+	fprintf(out, "At most JOBS jobs are queued, reading stops while the queue is full.\n");
+	exit(code);
+}
+
+static int
+queue_init(struct queue *queue, size_t size)
+{
+	size_t n;
+
+	for (n = 1; n < size; n *= 2)
+		;
+	queue->cells = calloc(n, sizeof(struct queue_cell));
+	if (queue->cells == NULL)
+		return -1;
+	for (size_t i = 0; i < n; i++)
+		queue->cells[i].seq = i;
+	queue->mask = n - 1;
+	queue->head = queue->tail = 0;
+	sem_init(&queue->jobs, 0, 0);
+	sem_init(&queue->slots, 0, n);
+	return 0;
+}
+
+static void
+queue_push(struct queue *queue, struct job *job)
+{
+	size_t pos, seq;
+	struct queue_cell *cell;
+
+	while (sem_wait(&queue->slots) < 0)
+		;
+	/* A cell is free since the slot is taken, claim the position */
+	pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	for (;;) {
+		cell = &queue->cells[pos & queue->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, true,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else
+			pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	}
+	cell->job = job;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&queue->jobs);
+}
+
+static struct job *
+queue_pop(struct queue *queue)
+{
+	size_t pos, seq;
+	struct job *job;
+	struct queue_cell *cell;
+
+	while (sem_wait(&queue->jobs) < 0)
+		;
+	pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		cell = &queue->cells[pos & queue->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos + 1) {
+			if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, true,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else
+			pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	}
+	job = cell->job;
+	__atomic_store_n(&cell->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+	sem_post(&queue->slots);
+	return job;
+}
+
+static struct conn *
+conn_init(FILE *in, int out)
+{
+	struct conn *conn;
+
+	conn = calloc(1, sizeof(struct conn));
+	if (conn == NULL)
+		return NULL;
+	conn->in = in;
+	conn->out = out;
+	conn->refs = 1;
+	pthread_mutex_init(&conn->lock, NULL);
+	return conn;
+}
+
+static void
+conn_release(struct conn *conn)
+{
+	if (__atomic_sub_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	if (conn->in != stdin)
+		fclose(conn->in);
+	pthread_mutex_destroy(&conn->lock);
+	free(conn);
+}
+
+/* Writes a result line, a client gone away only loses its results */
+static void
+conn_write(struct conn *conn, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	pthread_mutex_lock(&conn->lock);
+	while (len > 0) {
+		n = write(conn->out, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		buf += n;
+		len -= n;
+	}
+	pthread_mutex_unlock(&conn->lock);
+}
+
+static const char *
+json_space(const char *p)
+{
+	while (isspace((unsigned char)*p))
+		++p;
+	return p;
+}
+
+/* Parses a JSON string into buf, or only skips it if buf is NULL, returns the
+ * end of the string or NULL. Unicode escapes are stored as UTF-8.
+ */
+static const char *
+json_string(const char *p, char *buf, size_t len)
+{
+	size_t n;
+	unsigned c, low;
+	char *end;
+	char hex[5];
+
+	if (*p++ != '"')
+		return NULL;
+	for (n = 0; *p != '"'; p++) {
+		if (*p == '\0' || (buf != NULL && n + 4 >= len))
+			return NULL;
+		c = (unsigned char)*p;
+		if (c == '\\') {
+			switch (*++p) {
+			case '"': case '\\': case '/':
+				c = (unsigned char)*p;
+				break;
+			case 'b':
+				c = '\b';
+				break;
+			case 'f':
+				c = '\f';
+				break;
+			case 'n':
+				c = '\n';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'u':
+				memcpy(hex, p + 1, 4);
+				hex[4] = '\0';
+				c = strtoul(hex, &end, 16);
+				if (end != hex + 4 || !isxdigit((unsigned char)hex[0]))
+					return NULL;
+				p += 4;
+				if (c >= 0xdc00 && c <= 0xdfff)
+					return NULL;
+				if (c >= 0xd800 && c <= 0xdbff) {
+					/* A high surrogate must be followed by a low one */
+					if (p[1] != '\\' || p[2] != 'u')
+						return NULL;
+					memcpy(hex, p + 3, 4);
+					low = strtoul(hex, &end, 16);
+					if (end != hex + 4 || !isxdigit((unsigned char)hex[0]) || low < 0xdc00 || low > 0xdfff)
+						return NULL;
+					p += 6;
+					c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+				}
+				break;
+			default:
+				return NULL;
+			}
+		}
+		if (buf == NULL)
+			continue;
+		if (c < 0x80)
+			buf[n++] = c;
+		else if (c < 0x800) {
+			buf[n++] = 0xc0 | (c >> 6);
+			buf[n++] = 0x80 | (c & 0x3f);
+		}
+		else if (c < 0x10000) {
+			buf[n++] = 0xe0 | (c >> 12);
+			buf[n++] = 0x80 | ((c >> 6) & 0x3f);
+			buf[n++] = 0x80 | (c & 0x3f);
+		}
+		else {
+			buf[n++] = 0xf0 | (c >> 18);
+			buf[n++] = 0x80 | ((c >> 12) & 0x3f);
+			buf[n++] = 0x80 | ((c >> 6) & 0x3f);
+			buf[n++] = 0x80 | (c & 0x3f);
+		}
+	}
+	if (buf != NULL)
+		buf[n] = '\0';
+	return p + 1;
+}
+
+/* Skips an array or object value, returns its end or NULL */
+static const char *
+json_skip(const char *p)
+{
+	unsigned depth;
+
+	depth = 0;
+	do {
+		if (*p == '"') {
+			p = json_string(p, NULL, 0);
+			if (p == NULL)
+				return NULL;
+			continue;
+		}
+		if (*p == '[' || *p == '{')
+			++depth;
+		else if (*p == ']' || *p == '}')
+			--depth;
+		else if (*p == '\0')
+			return NULL;
+		++p;
+	} while (depth > 0);
+	return p;
+}
+
+/* Skips a JSON number, returns its end or NULL if there is none */
+static const char *
+json_number(const char *p)
+{
+	if (*p == '-')
+		++p;
+	if (*p == '0')
+		++p;
+	else if (*p >= '1' && *p <= '9') {
+		while (isdigit((unsigned char)*p))
+			++p;
+	}
+	else
+		return NULL;
+	if (*p == '.') {
+		if (!isdigit((unsigned char)*++p))
+			return NULL;
+		while (isdigit((unsigned char)*p))
+			++p;
+	}
+	if (*p == 'e' || *p == 'E') {
+		++p;
+		if (*p == '+' || *p == '-')
+			++p;
+		if (!isdigit((unsigned char)*p))
+			return NULL;
+		while (isdigit((unsigned char)*p))
+			++p;
+	}
+	return p;
+}
+
+/* Parses a job, returns an error message or NULL */
+static const char *
+job_parse(struct job *job, const char *line, const struct chess_search_limits *defaults)
+{
+	char key[FIELD_MAX], value[FIELD_MAX];
+	const char *p, *start, *number_end;
+	char *end;
+	unsigned long long number;
+	bool limited;
+
+	memset(job->id, 0, sizeof(job->id));
+	job->fen[0] = '\0';
+	memset(&job->limits, 0, sizeof(job->limits));
+	job->multipv = 1;
+	limited = false;
+
+	p = json_space(line);
+	if (*p++ != '{')
+		return "expected an object";
+	for (p = json_space(p); *p != '}'; ) {
+		p = json_string(p, key, sizeof(key));
+		if (p == NULL)
+			return "invalid key";
+		p = json_space(p);
+		if (*p++ != ':')
+			return "expected a colon";
+		p = json_space(p);
+
+		start = p;
+		if (*p == '"') {
+			p = json_string(p, value, sizeof(value));
+			if (p == NULL)
+				return "invalid string";
+		}
+		else if (*p == '[' || *p == '{') {
+			/* Members of no interest may hold any value */
+			p = json_skip(p);
+			if (p == NULL)
+				return "invalid value";
+			value[0] = '\0';
+		}
+		else {
+			while (*p != '\0' && *p != ',' && *p != '}' && !isspace((unsigned char)*p))
+				++p;
+			if (p == start || (size_t)(p - start) >= sizeof(value))
+				return "invalid value";
+			memcpy(value, start, p - start);
+			value[p - start] = '\0';
+		}
+
+		if (strcmp(key, "id") == 0) {
+			/* Echoed back verbatim, ids are strings or numbers */
+			if (*start != '"' && ((number_end = json_number(value)) == NULL || *number_end != '\0'))
+				return "id must be a string or a number";
+			if ((size_t)(p - start) >= sizeof(job->id))
+				return "id too long";
+			memcpy(job->id, start, p - start);
+			job->id[p - start] = '\0';
+		}
+		else if (strcmp(key, "fen") == 0) {
+			if (*start != '"')
+				return "fen must be a string";
+			strcpy(job->fen, value);
+		}
+		else if (strcmp(key, "depth") == 0 || strcmp(key, "nodes") == 0
+				|| strcmp(key, "time") == 0 || strcmp(key, "multipv") == 0) {
+			errno = 0;
+			number = strtoull(value, &end, 10);
+			if (*start == '"' || *value == '-' || end == value || *end != '\0' || errno != 0)
+				return "limits must be non-negative integers";
+			if (strcmp(key, "multipv") == 0)
+				job->multipv = number;
+			else {
+				limited = true;
+				if (key[0] == 'd')
+					job->limits.depth = number;
+				else if (key[0] == 'n')
+					job->limits.nodes = number;
+				else
+					job->limits.time = number;
+			}
+		}
+
+		p = json_space(p);
+		if (*p == ',')
+			p = json_space(p + 1);
+		else if (*p != '}')
+			return "expected a comma";
+	}
+
+	if (job->fen[0] == '\0')
+		return "missing fen";
+	if (job->multipv == 0)
+		job->multipv = 1;
+	else if (job->multipv > MULTIPV_MAX)
+		job->multipv = MULTIPV_MAX;
+	if (!limited)
+		job->limits = *defaults;
+	return NULL;
+}
+
+static void
+job_error(struct conn *conn, const char *id, const char *message)
+{
+	char buf[FIELD_MAX * 2];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "{\"id\":%s,\"error\":\"%s\"}\n", id[0] ? id : "null", message);
+	conn_write(conn, buf, len);
+}
+
+static void
+job_result(struct job *job, unsigned move, const struct chess_search_info *lines, unsigned nlines)
+{
+	char str[8];
+	char *buf;
+	size_t len;
+	FILE *fp;
+
+	buf = NULL;
+	fp = open_memstream(&buf, &len);
+	if (fp == NULL) {
+		job_error(job->conn, job->id, "out of memory");
+		return;
+	}
+
+	fprintf(fp, "{\"id\":%s,\"bestmove\":", job->id[0] ? job->id : "null");
+	if (move == CHESS_MOVE_NONE)
+		fprintf(fp, "null");
+	else
+		fprintf(fp, "\"%s\"", chess_move_get_string(move, str, sizeof(str)));
+	fprintf(fp, ",\"lines\":[");
+	for (unsigned i = 0; i < nlines; i++) {
+		fprintf(fp, "%s{\"depth\":%u,\"score\":%d,\"nodes\":%llu,\"time\":%lu,\"pv\":[",
+				i ? "," : "", lines[i].depth, lines[i].score,
+				lines[i].nodes, lines[i].time);
+		for (unsigned j = 0; j < lines[i].npv; j++)
+			fprintf(fp, "%s\"%s\"", j ? "," : "",
+					chess_move_get_string(lines[i].pv[j], str, sizeof(str)));
+		fprintf(fp, "]}");
+	}
+	fprintf(fp, "]}\n");
+
+	if (fclose(fp) == 0)
+		conn_write(job->conn, buf, len);
+	else
+		job_error(job->conn, job->id, "out of memory");
+	free(buf);
+}
+
+/* Workers own their board and search, a NULL job stops them */
+static void *
+worker(void *arg)
+{
+	unsigned n, move;
+	struct job *job;
+	struct chess_board *board;
+	struct chess_search *search;
+	struct chess_search_info lines[MULTIPV_MAX];
+	struct daemon *daemon = arg;
+
+	board = chess_board_init();
+	search = chess_search_init(daemon->memory);
+	if (board == NULL || search == NULL) {
+		fprintf(stderr, "libchess-analyzd: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	while ((job = queue_pop(&daemon->queue)) != NULL) {
+		if (!chess_board_set_fen(board, job->fen))
+			job_error(job->conn, job->id, "invalid fen");
+		else {
+			/* Entries of unrelated positions do not match, the table
+			 * is not cleared between jobs.
+			 */
+			n = chess_search_run_multipv(search, board, &job->limits, lines, job->multipv);
+			move = n ? lines[0].pv[0] : CHESS_MOVE_NONE;
+			job_result(job, move, lines, n);
+		}
+		conn_release(job->conn);
+		free(job);
+	}
+
+	chess_search_free(search);
+	free(board);
+	return NULL;
+}
+
+/* Queues the jobs of a client until it closes the connection */
+static void
+reader(struct daemon *daemon, struct conn *conn)
+{
+	const char *error;
+	char *line;
+	size_t linecap;
+	struct job *job;
+
+	line = NULL;
+	linecap = 0;
+	job = NULL;
+	while (getline(&line, &linecap, conn->in) >= 0) {
+		if (*json_space(line) == '\0')
+			continue;
+		if (job == NULL && (job = malloc(sizeof(struct job))) == NULL) {
+			job_error(conn, "", "out of memory");
+			continue;
+		}
+
+		error = job_parse(job, line, &daemon->limits);
+		if (error != NULL) {
+			job_error(conn, job->id, error);
+			continue;
+		}
+
+		job->conn = conn;
+		__atomic_add_fetch(&conn->refs, 1, __ATOMIC_RELAXED);
+		queue_push(&daemon->queue, job);
+		job = NULL;
+	}
+	free(job);
+	free(line);
+	conn_release(conn);
+}
+
+struct client {
+	struct daemon *daemon;
+	struct conn *conn;
+};
+
+static void *
+client_thread(void *arg)
+{
+	struct client *client = arg;
+
+	reader(client->daemon, client->conn);
+	free(client);
+	return NULL;
+}
+
+static int
+serve(struct daemon *daemon, const char *path)
+{
+	int fd, cfd;
+	FILE *in;
+	pthread_t thread;
+	struct sockaddr_un addr;
+	struct client *client;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0)
+		return -1;
+
+	for (;;) {
+		cfd = accept(fd, NULL, NULL);
+		if (cfd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return -1;
+		}
+
+		client = malloc(sizeof(struct client));
+		in = fdopen(cfd, "r");
+		if (client == NULL || in == NULL) {
+			fprintf(stderr, "libchess-analyzd: %s\n", strerror(errno));
+			free(client);
+			close(cfd);
+			continue;
+		}
+		client->daemon = daemon;
+		client->conn = conn_init(in, cfd);
+		if (client->conn == NULL
+				|| (errno = pthread_create(&thread, NULL, client_thread, client)) != 0) {
+			fprintf(stderr, "libchess-analyzd: %s\n", strerror(errno));
+			free(client->conn);
+			free(client);
+			fclose(in);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt;
+	unsigned nworkers;
+	size_t queuesize;
+	const char *path;
+	pthread_t *threads;
+	struct conn *conn;
+	struct daemon daemon;
+
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+		usage(stdout, 0);
+	if (argc > 1 && strcmp(argv[1], "--version") == 0) {
+		printf("libchess-analyzd " VERSION "\n");
+		return 0;
+	}
+
+	memset(&daemon, 0, sizeof(daemon));
+	daemon.memory = 16;
+	nworkers = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	queuesize = 1024;
+	path = NULL;
+	while ((opt = getopt(argc, argv, "j:Q:H:n:t:d:s:")) != -1) {
+		switch (opt) {
+		case 'j':
+			nworkers = strtoul(optarg, NULL, 10);
+			break;
+		case 'Q':
+			queuesize = strtoul(optarg, NULL, 10);
+			break;
+		case 'H':
+			daemon.memory = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			daemon.limits.nodes = strtoull(optarg, NULL, 10);
+			break;
+		case 't':
+			daemon.limits.time = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			daemon.limits.depth = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			path = optarg;
+			break;
+		default:
+			usage(stderr, 1);
+		}
+	}
+	if (optind != argc)
+		usage(stderr, 1);
+	if (nworkers == 0)
+		nworkers = 1;
+	if (queuesize == 0)
+		queuesize = 1;
+	if (!daemon.limits.nodes && !daemon.limits.time && !daemon.limits.depth)
+		daemon.limits.time = 1000;
+	daemon.memory <<= 20;
+
+	/* Results to a client gone away fail with EPIPE instead */
+	signal(SIGPIPE, SIG_IGN);
+
+	threads = calloc(nworkers, sizeof(pthread_t));
+	if (threads == NULL || queue_init(&daemon.queue, queuesize) < 0) {
+		fprintf(stderr, "libchess-analyzd: %s\n", strerror(errno));
+		return 1;
+	}
+	for (unsigned i = 0; i < nworkers; i++) {
+		errno = pthread_create(&threads[i], NULL, worker, &daemon);
+		if (errno) {
+			fprintf(stderr, "libchess-analyzd: %s\n", strerror(errno));
+			return 1;
+		}
+	}
+
+	if (path != NULL) {
+		serve(&daemon, path);
+		fprintf(stderr, "libchess-analyzd: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	conn = conn_init(stdin, STDOUT_FILENO);
+	if (conn == NULL) {
+		fprintf(stderr, "libchess-analyzd: %s\n", strerror(errno));
+		return 1;
+	}
+	reader(&daemon, conn);
+	for (unsigned i = 0; i < nworkers; i++)
+		queue_push(&daemon.queue, NULL);
+	for (unsigned i = 0; i < nworkers; i++)
+		pthread_join(threads[i], NULL);
+
+	free(daemon.queue.cells);
+	free(threads);
+	return 0;
+}